@@ -0,0 +1,120 @@
+/**@file AnimData.h
+ * Implementation of a decoder for the AnimData.d2 file
+ */
+#pragma once
+
+#include <stdint.h>
+#include <Stream.h>
+#include <Vector.h>
+
+namespace WorldStone
+{
+// clang-format off
+/**
+ * @brief Decoder for the AnimData.d2 file, which holds the timings of the COF animations.
+ *
+ * For each COF name (eg: AMA1HTH), the file gives the number of frames per direction, the speed of
+ * the animation and a trigger flag for each frame (see COF::Keyframe).
+ *
+ * Layout of the file:
+ * | Name                 | Type                    | Size in bytes      |
+ * | -------------------- | ----------------------- | ------------------ |
+ * | block[0].nbRecords   | uint32_t                | 4                  |
+ * | block[0].records     | AnimData::Record[]      | 160 * nbRecords    |
+ * | ... other blocks ... |||
+ * | block[255]           |                         |                    |
+ *
+ * A record is stored in the block given by the hash of its name, see @ref hashName.
+ * The blocks are only used to speed up the lookups in the game. Instead, the records are stored
+ * here in a single array, and looked up with an open addressing hash table of their names.
+ * @test{Decoders,AnimData}
+ */
+// clang-format on
+class AnimData
+{
+public:
+    static constexpr size_t nbBlocks      = 256;
+    static constexpr size_t maxFrames     = 144;
+    static constexpr size_t maxNameLength = 7; ///< Does not include the trailing '\0'
+
+    /// A record as stored in the file
+    struct Record
+    {
+        char     cofName[maxNameLength + 1]; ///< Name of the COF without extension, '\0' padded
+        uint32_t framesPerDirection;         ///< Number of frames of the animation
+        uint32_t animSpeed;                  ///< Frames per tick in 8-bit fixed-point: 256 == 1.f
+        uint8_t  frameData[maxFrames];       ///< Trigger of each frame, see COF::Keyframe
+    };
+
+    /// Timing information of an animation, see @ref getAnimation
+    struct Animation
+    {
+        uint32_t framesPerDirection; ///< Number of frames of the animation
+        uint32_t animSpeed;          ///< Frames per tick in 8-bit fixed-point: 256 == 1.f
+    };
+
+    /// The state of an animation to query with @ref getTimings
+    struct TimingQuery
+    {
+        uint32_t animation; ///< Index of the animation, from @ref findAnimation
+        uint32_t ticks;     ///< Number of ticks since the animation started
+    };
+
+    /// The frame to display for a TimingQuery
+    struct Timing
+    {
+        uint8_t frame;   ///< The current frame of the animation, it loops
+        uint8_t trigger; ///< The trigger of the frame, see COF::Keyframe
+    };
+
+    /// Returned by @ref findAnimation when there is no animation with the given name
+    static constexpr uint32_t notFound = UINT32_MAX;
+
+    /// @return The hash used by the game to find the block of a COF name, case insensitive
+    static uint8_t hashName(const char* cofName);
+
+    /**Reads the whole file at once and builds the lookup table.
+     * @return true on success, false if the file is truncated or has invalid records
+     */
+    bool read(const StreamPtr& streamPtr);
+
+    /**Finds an animation by its COF name, in constant time.
+     * @param cofName The name of the COF, case insensitive, without extension (eg: "AMA1HTH")
+     * @return The index of the animation, or notFound
+     */
+    uint32_t findAnimation(const char* cofName) const;
+
+    /// @return The number of animations in the file
+    size_t getAnimationsNumber() const { return animations.size(); }
+
+    /// @return The timings of the animation of the given index
+    const Animation& getAnimation(uint32_t animation) const { return animations[animation]; }
+
+    /// @return The trigger of each of the maxFrames frames of the animation of the given index
+    const uint8_t* getFrameTriggers(uint32_t animation) const
+    {
+        return &frameTriggers[animation * maxFrames];
+    }
+
+    /**Computes the current frame of many animations at once.
+     * @param queries The animations and their number of ticks since they started
+     * @param count   Number of queries
+     * @param output  Will hold the timing of each query, must hold at least count elements
+     *
+     * The timings and the triggers are stored in separate arrays, so that this only touches the
+     * data of the queried animations. Queries of animations that do not exist, such as
+     * @ref notFound, give the frame 0 without trigger.
+     */
+    void getTimings(const TimingQuery* queries, size_t count, Timing* output) const;
+
+private:
+    /// Timings of the animations, in the order of the file
+    Vector<Animation> animations;
+    /// maxFrames triggers per animation
+    Vector<uint8_t> frameTriggers;
+    /// The upper case names of the animations packed in 64 bits integers
+    Vector<uint64_t> names;
+    /// Open addressing table of the animations indices, notFound for empty slots
+    Vector<uint32_t> lookupTable;
+};
+} // namespace WorldStone
@@ -0,0 +1,111 @@
+/**@file COFCompositor.h
+ * Assembles the DCC layers of a COF into complete frames
+ */
+#pragma once
+
+#include <stdint.h>
+#include <Vector.h>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include "ImageView.h"
+#include "Palette.h"
+#include "cof.h"
+#include "dcc.h"
+
+namespace WorldStone
+{
+/**
+ * @brief Composites the components of a COF into a single sequence of 8bpp frames.
+ *
+ * A COF describes an animation as up to 16 layers, one per component (head, torso, ...), each
+ * one being a DCC. For each direction and frame, COF::getFrameLayerOrder gives the order in which
+ * the components are drawn. The compositor decodes the DCC direction of every layer, then draws
+ * them in this order into frames that cover the COF bounding box.
+ *
+ * Layers with COF::Layer::overrideTranslvl set are blended with what was drawn before them,
+ * using the tables of a PL2 selected by COF::Layer::newTranslvl:
+ * | newTranslvl | Table                          |
+ * | ----------- | ------------------------------ |
+ * | 0, 1, 2     | PL2::alphaBlend[newTranslvl]   |
+ * | 3           | PL2::additiveBlend             |
+ * | 4           | PL2::multiplicativeBlend       |
+ * | others      | None, the layer is opaque      |
+ * Translucent pixels drawn over a transparent pixel of the frame are copied as is, since there is
+ * nothing to blend with until the frame is drawn on screen.
+ *
+ * Composited directions are cached by (COF, equipment set, direction), the equipment set being
+ * the DCC used for each component. The cache stores pointers to the COF and DCCs, so they must
+ * outlive it, see @ref clearCache.
+ * @test{Decoders,COFCompositor}
+ */
+class COFCompositor
+{
+public:
+    /// The DCC of each component, indexed like COF::componentsNames. nullptr if not equipped.
+    using ComponentsDCCs = std::array<DCC*, COF::componentsNumber>;
+
+    /// The frames of a direction, all of them having the size of the COF bounding box
+    struct CompositedDirection
+    {
+        int32_t         xOrigin;  ///< Position of the left column, COF::Header::xMin
+        int32_t         yOrigin;  ///< Position of the top row, COF::Header::yMin
+        size_t          width;    ///< Width of the frames
+        size_t          height;   ///< Height of the frames
+        size_t          nbFrames; ///< Number of frames, COF::Header::frames
+        Vector<uint8_t> pixels;   ///< The pixels of all the frames, one frame after the other
+
+        /// @return The composited image of the given frame, 0 being transparent
+        ImageView<const uint8_t> getFrame(size_t frame) const
+        {
+            return {pixels.data() + frame * width * height, width, height, width};
+        }
+    };
+
+    /// @param pl2 The blending tables of the palette used to draw the layers, must outlive this
+    explicit COFCompositor(const PL2& pl2) : palette(pl2) {}
+
+    /**Composites a direction of a COF, or returns the cached result.
+     * @param cof       The COF describing the layers and their draw order
+     * @param dccs      The DCC of each component used by the layers of the COF
+     * @param direction The direction of the COF
+     * @return The composited frames, or nullptr if a DCC could not be decoded or does not have
+     *         the same number of directions or frames per direction as the COF.
+     *         Valid until the cache is cleared.
+     *
+     * Each DCC is only decoded once, even if it is used by several layers.
+     */
+    const CompositedDirection* getDirection(const COF& cof, const ComponentsDCCs& dccs,
+                                            uint32_t direction);
+
+    /// @return The number of directions in the cache
+    size_t getCacheSize() const { return cache.size(); }
+
+    /// Frees all the composited directions, previously returned pointers become invalid
+    void clearCache() { cache.clear(); }
+
+private:
+    struct CacheKey
+    {
+        const COF*     cof;
+        ComponentsDCCs dccs;
+        uint32_t       direction;
+
+        bool operator==(const CacheKey& rhs) const
+        {
+            return cof == rhs.cof && dccs == rhs.dccs && direction == rhs.direction;
+        }
+    };
+    struct CacheKeyHash
+    {
+        size_t operator()(const CacheKey& key) const;
+    };
+
+    bool composite(const COF& cof, const ComponentsDCCs& dccs, uint32_t direction,
+                   CompositedDirection& output);
+
+    const PL2&         palette;
+    DCCDecodeWorkspace workspace;
+    std::unordered_map<CacheKey, std::unique_ptr<CompositedDirection>, CacheKeyHash> cache;
+};
+} // namespace WorldStone
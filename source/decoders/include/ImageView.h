@@ -5,7 +5,9 @@
 
 #include <Platform.h>
 #include <Vector.h>
+#include <stdint.h>
 #include <string.h> // memcpy & memset
+#include <type_traits>
 
 namespace WorldStone
 {
@@ -123,6 +125,75 @@ struct ImageView
     }
 };
 
+/// A rectangle of pixels in an image
+struct ImageRect
+{
+    size_t x      = 0; ///< First column
+    size_t y      = 0; ///< First row
+    size_t width  = 0; ///< Number of columns
+    size_t height = 0; ///< Number of rows
+};
+
+namespace Detail
+{
+/// Checks 8 pixels at a time if a part of a scanline has non-zero pixels
+inline bool hasOpaquePixels(const uint8_t* pixels, size_t count)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= count; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, pixels + i, sizeof(word));
+        if (word) return true;
+    }
+    for (; i < count; i++)
+        if (pixels[i]) return true;
+    return false;
+}
+} // namespace Detail
+
+/**Computes the smallest rectangle containing all the non-zero (non transparent) pixels.
+ * Scanlines are scanned 8 pixels at a time, and only the columns outside of the current bounds
+ * are scanned once a first opaque row was found.
+ * @return The bounds, with a width and height of 0 if all the pixels are 0
+ * @test{Decoders,OpaqueBounds}
+ */
+inline ImageRect computeOpaqueBounds(ImageView<const uint8_t> image)
+{
+    ImageRect bounds;
+    if (!image.isValid()) return bounds;
+    size_t firstRow = 0;
+    while (firstRow < image.height && !Detail::hasOpaquePixels(&image(0, firstRow), image.width))
+        firstRow++;
+    if (firstRow == image.height) return bounds;
+    size_t lastRow = image.height - 1;
+    while (!Detail::hasOpaquePixels(&image(0, lastRow), image.width))
+        lastRow--;
+
+    size_t left = image.width, right = 0; // right is excluded
+    for (size_t y = firstRow; y <= lastRow; y++)
+    {
+        const uint8_t* row = &image(0, y);
+        if (left && Detail::hasOpaquePixels(row, left)) {
+            size_t x = 0;
+            while (!row[x])
+                x++;
+            left = x;
+        }
+        if (right < image.width && Detail::hasOpaquePixels(row + right, image.width - right)) {
+            size_t x = image.width;
+            while (!row[x - 1])
+                x--;
+            right = x;
+        }
+    }
+    bounds.x      = left;
+    bounds.y      = firstRow;
+    bounds.width  = right - left;
+    bounds.height = lastRow + 1 - firstRow;
+    return bounds;
+}
+
 /**An interface of a class that can provide images views.
  * One example would be to reuse the same texture to store multiple images.
  */
@@ -141,8 +212,10 @@ class SimpleImageProvider : public IImageProvider<Color>
 {
     struct Image
     {
-        size_t        width  = 0;
-        size_t        height = 0;
+        size_t        width   = 0;
+        size_t        height  = 0;
+        size_t        offsetX = 0; ///< Columns removed on the left by trimImages()
+        size_t        offsetY = 0; ///< Rows removed on the top by trimImages()
         Vector<Color> buffer;
         Image(size_t _width, size_t _height)
             : width(_width), height(_height), buffer(_width * _height)
@@ -177,6 +250,47 @@ public:
         return {img.buffer.data(), img.width, img.height, img.width};
     }
 
+    /**Shrinks each image to the bounding box of its non-zero pixels, see computeOpaqueBounds.
+     * Use getImageBounds() to know where the trimmed images were in the original ones.
+     * Images that are fully transparent become empty, getImage() returns an invalid view for them.
+     * @return The number of bytes saved
+     * @test{Decoders,TrimImages}
+     */
+    size_t trimImages()
+    {
+        static_assert(std::is_same<Color, uint8_t>::value, "Only palette indices can be trimmed");
+        size_t bytesSaved = 0;
+        for (Image& img : images)
+        {
+            const ImageView<Color> view{img.buffer.data(), img.width, img.height, img.width};
+            const ImageRect        bounds = computeOpaqueBounds(view);
+            if (bounds.width == img.width && bounds.height == img.height) continue;
+
+            Vector<Color> trimmed(bounds.width * bounds.height);
+            view.subView(bounds.x, bounds.y, bounds.width, bounds.height)
+                .copyTo({trimmed.data(), bounds.width, bounds.height, bounds.width});
+            bytesSaved += (img.buffer.size() - trimmed.size()) * sizeof(Color);
+            img.width  = bounds.width;
+            img.height = bounds.height;
+            img.offsetX += bounds.x;
+            img.offsetY += bounds.y;
+            img.buffer = std::move(trimmed);
+        }
+        return bytesSaved;
+    }
+
+    /// @return The rectangle covered by the imageIndex-th image in the one that was allocated
+    ImageRect getImageBounds(size_t imageIndex) const
+    {
+        const Image& img = images[imageIndex];
+        ImageRect    rect;
+        rect.x      = img.offsetX;
+        rect.y      = img.offsetY;
+        rect.width  = img.width;
+        rect.height = img.height;
+        return rect;
+    }
+
     /**Move an image buffer out of the provider.
      * @param imageIndex The index of the image to return, in order of allocation.
      * @note  This means further calls to getImage(imageIndex) will return an invalid ImageView.
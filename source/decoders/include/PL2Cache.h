@@ -0,0 +1,67 @@
+/**@file PL2Cache.h
+ * A persistent cache of the PL2 generated for custom palettes
+ */
+#pragma once
+
+#include <stdint.h>
+#include <IOBase.h>
+#include <MemoryMappedFile.h>
+#include <TaskExecutor.h>
+#include <unordered_map>
+#include "Palette.h"
+
+namespace WorldStone
+{
+/**
+ * @brief Stores the PL2 created from palettes in a directory, and maps them back in memory.
+ *
+ * Generating a PL2 with PL2::CreateFromPalette is too slow to be done for each palette every time
+ * the program starts. Instead, the first time a palette is used, its PL2 is written to the cache
+ * directory in a file named after the hash of the palette, see @ref hashPalette.
+ * The files have the same format as the .pl2 files of the game.
+ *
+ * Entries are memory mapped and used in place, without copy. The pages are shared by all the
+ * processes using the same entry. An entry is regenerated if it does not have the right size or
+ * was not created from the same palette.
+ * Entries are written to a temporary file then renamed, so that a process never maps an entry
+ * being written by another one.
+ * @warning On Windows, rename can not replace an existing file, so an invalid entry is removed
+ *          before the new one is renamed. This fallback is not atomic, and fails while another
+ *          process has the invalid entry mapped. It has not been run on Windows yet.
+ * @test{Decoders,PL2Cache}
+ */
+class PL2Cache
+{
+public:
+    /// @param directory Where the entries are stored, it must exist
+    explicit PL2Cache(IOBase::Path directory) : cacheDirectory(std::move(directory)) {}
+
+    /// @return A 64-bit FNV-1a hash of the colors of the palette
+    static uint64_t hashPalette(const Palette& palette);
+
+    /// @return The path of the file holding the PL2 of this palette
+    IOBase::Path getEntryPath(const Palette& palette) const;
+
+    /**Maps the PL2 of a palette, and creates it first if it is not in the cache directory.
+     * @param palette  The base palette of the PL2
+     * @param executor Used to create the PL2 if needed, see PL2::CreateFromPalette
+     * @return The PL2, valid until @ref clear is called or the cache is destroyed.
+     *         nullptr if the entry could not be written or mapped, or in the (very unlikely) case
+     *         of two palettes with the same hash being used by the same cache.
+     */
+    const PL2* get(const Palette& palette, const TaskExecutor& executor = sequentialExecutor);
+
+    /// @return The number of entries currently mapped
+    size_t getEntriesNumber() const { return entries.size(); }
+
+    /// Unmaps all the entries, previously returned pointers become invalid
+    void clear() { entries.clear(); }
+
+private:
+    /// @return The PL2 of the file if it was created from this palette, nullptr otherwise
+    static const PL2* getValidPL2(const MemoryMappedFile& file, const Palette& palette);
+
+    IOBase::Path                                   cacheDirectory;
+    std::unordered_map<uint64_t, MemoryMappedFile> entries;
+};
+} // namespace WorldStone
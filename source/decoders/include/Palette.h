@@ -6,6 +6,9 @@
 
 #include <cstdint>
 #include <Stream.h>
+#include <TaskExecutor.h>
+#include <Vector.h>
+#include <algorithm>
 #include <array>
 
 namespace WorldStone
@@ -39,7 +42,7 @@ struct Palette
 
     bool decode(const char* filename);
     bool decode(IStream* file);
-    uint8_t GetClosestColorIndex(Color color);
+    uint8_t GetClosestColorIndex(Color color) const;
     bool operator==(const Palette& rhs) const { return colors == rhs.colors; }
 };
 
@@ -61,6 +64,83 @@ struct PalShiftTransform
     }
 };
 
+/**
+ * @brief Converts palette indices to 32 bits colors in a single pass
+ *
+ * The table holds the final color of each index, palette shift included, so that decoders can
+ * write colors directly instead of an intermediate 8bpp image.
+ * Index 0 is transparent: its _padding (alpha) is 0, while it is 0xFF for all other indices.
+ */
+struct ColorLookupTable
+{
+    std::array<Palette::Color, Palette::colorCount> colors;
+
+    /// @test{Decoders,ColorLookupTable}
+    explicit ColorLookupTable(const Palette& palette);
+    /// Same as ColorLookupTable(const Palette&) but with the colors transformed by @p transform
+    ColorLookupTable(const Palette& palette, const PalShiftTransform& transform);
+
+    /**Converts @p count indices to colors.
+     * Uses AVX2 gathers when available, 8 colors at a time.
+     */
+    void convert(const uint8_t* indices, Palette::Color* output, size_t count) const;
+};
+
+/**
+ * @brief Finds the closest color of a palette, with the same result as
+ * Palette::GetClosestColorIndex but without comparing the color to the whole palette.
+ *
+ * The RGB cube is split into a grid of cells. Each cell lists the colors that can be the closest
+ * to a point of the cell: those that are not further from the cell than the furthest point of the
+ * cell is from some color. Candidates are sorted by distance to the cell, so that a query stops as
+ * soon as the next candidates can not be closer than the best one found. Ties are resolved in
+ * favor of the lowest index like Palette::GetClosestColorIndex.
+ * The grid is built by the constructor, after which the object can be shared between threads.
+ * @test{Decoders,ClosestColorFinder}
+ */
+class ClosestColorFinder
+{
+public:
+    explicit ClosestColorFinder(const Palette& palette);
+
+    /// @return The index of the color of the palette closest to @p color
+    uint8_t GetClosestColorIndex(Palette::Color color) const
+    {
+        const size_t cell = (size_t(color.r >> cellShift) << (2 * cellBits)) |
+                            (size_t(color.g >> cellShift) << cellBits) |
+                            size_t(color.b >> cellShift);
+        // The squared distance in the upper bits and the index in the lower ones, so that the
+        // minimum is the closest color with the lowest index
+        uint32_t closestColor = UINT32_MAX;
+        for (uint32_t i = cellsCandidates[cell]; i < cellsCandidates[cell + 1]; i++)
+        {
+            const Candidate& candidate = candidates[i];
+            if (candidate.cellDistance > closestColor) break;
+            const int      diffRed   = candidate.r - color.r;
+            const int      diffGreen = candidate.g - color.g;
+            const int      diffBlue  = candidate.b - color.b;
+            const uint32_t distance =
+                uint32_t(diffRed * diffRed + diffGreen * diffGreen + diffBlue * diffBlue);
+            closestColor = std::min(closestColor, (distance << 8) | candidate.index);
+        }
+        return uint8_t(closestColor & 0xFF);
+    }
+
+private:
+    static constexpr unsigned cellBits  = 4; ///< log2 of the number of cells per axis
+    static constexpr unsigned cellShift = 8 - cellBits;
+
+    struct Candidate
+    {
+        uint8_t  r, g, b;
+        uint8_t  index;        ///< Index of the color in the palette
+        uint32_t cellDistance; ///< Squared distance to the nearest point of the cell, shifted by 8
+    };
+    /// Index of the first candidate of each cell, plus the total number of candidates
+    Vector<uint32_t>  cellsCandidates;
+    Vector<Candidate> candidates;
+};
+
 /**
  * @brief Precomputed palette variations in the form of palette shifts
  */
@@ -89,7 +169,13 @@ struct PL2
     Palette::Color24Bits textColors[13];
     PalShiftTransform    textColorShifts[13];
 
-    static std::unique_ptr<PL2> CreateFromPalette(const Palette& palette);
+    /**Computes all the palette shifts of a palette, like the game does for its .pl2 files.
+     * @param palette  The base palette
+     * @param executor Used to compute the tables that do not depend on each other concurrently
+     * @test{Decoders,PL2_Creation}
+     */
+    static std::unique_ptr<PL2>
+    CreateFromPalette(const Palette& palette, const TaskExecutor& executor = sequentialExecutor);
     static std::unique_ptr<PL2> ReadFromStream(IStream* stream);
 };
 
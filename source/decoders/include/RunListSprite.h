@@ -0,0 +1,65 @@
+/**@file RunListSprite.h
+ * Implements a sprite representation that only stores the opaque pixels
+ */
+#pragma once
+
+#include <stdint.h>
+#include <Vector.h>
+#include "ImageView.h"
+#include "Palette.h"
+
+namespace WorldStone
+{
+/**A sprite stored as a list of opaque runs for each scanline.
+ * This keeps the structure of the RLE formats such as DC6 instead of expanding them to dense 8bpp
+ * images. Transparent pixels (palette index 0) are not stored at all, so blitting only touches the
+ * opaque pixels, and hit tests only look at the runs of a scanline.
+ *
+ * Runs of a scanline are sorted by x and never overlap nor touch each other.
+ * Use @ref fromImage to convert a decoded frame (eg: DCC) or DC6::decompressFrameRuns to decode
+ * DC6 frames directly.
+ */
+struct RunListSprite
+{
+    /// A span of opaque pixels of a scanline
+    struct Run
+    {
+        uint16_t x;          ///< Number of pixels to skip from the start of the scanline
+        uint16_t length;     ///< Number of pixels to copy
+        uint32_t firstPixel; ///< Index of the first pixel of the run in @ref pixels
+    };
+
+    uint16_t         width  = 0;
+    uint16_t         height = 0;
+    Vector<Run>      runs;     ///< The runs of all scanlines, from top to bottom
+    Vector<uint32_t> firstRun; ///< Index of the first run of each scanline, plus the total number
+    Vector<uint8_t>  pixels;   ///< Palette indices of the opaque pixels
+
+    /// @return The number of runs of the given scanline
+    size_t nbRuns(size_t y) const { return firstRun[y + 1] - firstRun[y]; }
+
+    /// @return A pointer to the runs of the given scanline, see nbRuns()
+    const Run* scanlineRuns(size_t y) const { return runs.data() + firstRun[y]; }
+
+    /**Builds the sprite of an 8bpp image, index 0 being transparent.
+     * @test{Decoders,RunListSprite}
+     */
+    static RunListSprite fromImage(ImageView<const uint8_t> image);
+
+    /// @return true if the pixel (x,y) of the sprite is opaque, false if transparent or outside
+    bool isOpaque(int32_t x, int32_t y) const;
+
+    /**Draws the opaque pixels of the sprite, the sprite is clipped to the destination.
+     * @param dst Destination image
+     * @param dstX Column of dst where the left edge of the sprite is drawn, can be negative
+     * @param dstY Row of dst where the top edge of the sprite is drawn, can be negative
+     */
+    void blitTo(ImageView<uint8_t> dst, int32_t dstX, int32_t dstY) const;
+
+    /**Same as blitTo(ImageView<uint8_t>, int32_t, int32_t) but converts the pixels to colors.
+     * The _padding member of the colors is set to 0xFF so that it can be used as alpha.
+     */
+    void blitTo(ImageView<Palette::Color> dst, int32_t dstX, int32_t dstY,
+                const Palette& palette) const;
+};
+} // namespace WorldStone
@@ -1,10 +1,15 @@
 #pragma once
 
 #include <stdint.h>
+#include <Archive.h>
 #include <Stream.h>
+#include <TaskExecutor.h>
 #include <Vector.h>
+#include <array>
 #include <memory>
 #include <type_traits>
+#include "ImageView.h"
+#include "dcc.h"
 
 namespace WorldStone
 {
@@ -42,6 +47,9 @@ public:
         int16_t zeros;    ///< Always zero
     };
 
+    /// Weapon classes have at most 3 characters, eg: "HTH"
+    static constexpr size_t maxWeaponClassLength = 3;
+
     struct Layer
     {
         uint8_t component;        ///< See componentsNames
@@ -63,6 +71,26 @@ public:
         COFKEY_MAX,
     };
 
+    /// @note This list of components comes from the file data\\global\\excel\\Composit.txt
+    static constexpr uint8_t     componentsNumber                  = 16;
+    static constexpr const char* componentsNames[componentsNumber] = {
+        "HD", "TR", "LG", "RA", "LA", "RH", "LH", "SH",
+        "S1", "S2", "S3", "S4", "S5", "S6", "S7", "S8"};
+
+    /// Equipment code of each component (eg: "LIT"), nullptr if the component is not drawn
+    using Equipment = std::array<const char*, componentsNumber>;
+
+    /// The DCC of a component and its decoded directions, see @ref loadComponents
+    struct Component
+    {
+        IOBase::Path                         path; ///< Path of the DCC in the archive
+        DCC                                  dcc;
+        Vector<DCC::Direction>               directions; ///< The requested directions, in order
+        Vector<SimpleImageProvider<uint8_t>> frames;     ///< The frames of each direction
+    };
+    /// The loaded components, indexed like componentsNames. nullptr if not drawn by the COF.
+    using Components = std::array<std::unique_ptr<Component>, componentsNumber>;
+
     bool read(const StreamPtr& streamPtr);
 
     const Header&           getHeader() const { return header; }
@@ -77,11 +105,42 @@ public:
         const size_t frameIdx = (direction * header.frames + frame) * header.layers;
         return &layersOrder[frameIdx];
     }
-    /// @note This list of components comes from the file data\\global\\excel\\Composit.txt
-    static constexpr uint8_t     componentsNumber                  = 16;
-    static constexpr const char* componentsNames[componentsNumber] = {
-        "HD", "TR", "LG", "RA", "LA", "RH", "LH", "SH",
-        "S1", "S2", "S3", "S4", "S5", "S6", "S7", "S8"};
+
+    /**Builds the path of the DCC of a component, in the form
+     * tokensDirectory\\token\\component\\{token}{component}{equipment}{mode}{weaponClass}.dcc
+     * eg: data\\global\\chars\\AM\\HD\\AMHDLITNUHTH.dcc
+     * Only the first maxWeaponClassLength characters of weaponClass are used, so that the one of
+     * a Layer can be used even if it is not null terminated.
+     */
+    static IOBase::Path getComponentPath(const char* tokensDirectory, const char* token,
+                                         uint8_t component, const char* equipment,
+                                         const char* mode, const char* weaponClass);
+
+    /**Loads and decodes the DCC of every component drawn by the COF, possibly concurrently.
+     * @param archive         The archive containing the DCC files
+     * @param token           The token of the unit, eg: "AM" for the amazon
+     * @param mode            The animation mode, eg: "NU"
+     * @param weaponClass     The weapon class of the animation, only used for the layers that do
+     *                        not specify theirs
+     * @param equipment       The equipment of each component, the layers of the components
+     *                        without equipment are skipped. If several layers use the same
+     *                        component, only the first one is loaded.
+     * @param directions      The directions to decode for each component
+     * @param outComponents   Will hold the loaded components
+     * @param executor        Used to load the components, one task per component
+     * @param tokensDirectory The directory of the tokens, data\\global\\monsters for monsters
+     * @return true if all the components were found and all the directions were decoded
+     *
+     * Each task reads a whole file into memory, then decodes the directions from this copy. If
+     * the archive is not thread safe (see Archive::isThreadSafe), files are read one at a time
+     * while the decoding still runs in parallel.
+     * @test{Decoders,COF_LoadComponents}
+     */
+    bool loadComponents(Archive& archive, const char* token, const char* mode,
+                        const char* weaponClass, const Equipment& equipment,
+                        const Vector<uint32_t>& directions, Components& outComponents,
+                        const TaskExecutor& executor        = sequentialExecutor,
+                        const char*         tokensDirectory = "data\\global\\chars") const;
 
 private:
     Header           header;
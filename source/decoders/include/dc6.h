@@ -2,10 +2,13 @@
 
 #include <stdint.h>
 #include <Stream.h>
+#include <TaskExecutor.h>
 #include <memory>
 #include <type_traits>
 #include <vector>
+#include "ImageView.h"
 #include "Palette.h"
+#include "RunListSprite.h"
 
 namespace WorldStone
 {
@@ -68,20 +71,45 @@ public:
         uint32_t length;    ///< Length of the frame in chunks
     };
 
+    /// A frame to be encoded by @ref encode
+    struct EncoderFrame
+    {
+        ImageView<const uint8_t> image;  ///< The pixels from top to bottom, 0 being transparent
+        FrameHeader              header; ///< Only flip, offsetX, offsetY and allocSize are used
+    };
+
+    /// Where the 3 bytes that are not part of the frame data are stored
+    enum class Layout
+    {
+        Original, ///< After the frame data, as a copy of Header::skipColor
+        Remaster, ///< Before the frame data, as zeros, like the D2:Remaster files
+    };
+
 protected:
-    StreamPtr                stream = nullptr;
+    /// The content of the whole file, frames are decoded from memory
+    std::vector<uint8_t>     fileData;
     Header                   header;
     std::vector<uint32_t>    framePointers;
     std::vector<FrameHeader> frameHeaders;
 
+    /// Parses the header, the frame pointers and all the frame headers from fileData
     bool extractHeaders();
 
+    /// Gets the RLE data of a frame in fileData, skipping the leading zeros if any
+    bool getFrameData(size_t frameNumber, const uint8_t*& dataBegin, const uint8_t*& dataEnd) const;
+
+    /// Decodes the RLE data of a frame, calling writeRun(dst, src, count) for each run of colors
+    template<class Color, class RunWriter>
+    bool decodeFrameRLE(size_t frameNumber, ImageView<Color> image, RunWriter writeRun) const;
+
 public:
     /**Start decoding the stream and preparing data.
      * @return true on success
      *
      * Prepares the decoder to read the frames using @ref decompressFrame.
-     * Basically calls extractHeaders(), so that you can call getHeader() and getFrameHeaders().
+     * The whole stream is read at once, then extractHeaders() is called so that you can call
+     * getHeader() and getFrameHeaders(). The stream is not used anymore after this call.
+     * @test{Decoders,DC6_Decoding}
      */
     bool initDecoder(StreamPtr&& streamPtr);
 
@@ -98,9 +126,87 @@ public:
     std::vector<uint8_t> decompressFrame(size_t frameNumber) const;
     
     /**Same as @ref decompressFrame but will output the data in a given buffer
+     * @param frameNumber The frame number in the file
+     * @param data        Must be at least width*height bytes, transparent pixels are not written
+     * @return true on success, false if the frame data is invalid
      */
     bool decompressFrameIn(size_t frameNumber, uint8_t* data) const;
 
+    /**Decompress the given frame in an image view, which can be part of a bigger buffer.
+     * Scanlines are always written from top to bottom, whatever the value of FrameHeader::flip.
+     * @param frameNumber The frame number in the file
+     * @param image       Must have the dimensions of the frame, any stride is accepted.
+     *                    Transparent pixels are not written.
+     * @return true on success, false if the frame data is invalid or the image has the wrong size
+     * @test{Decoders,DC6_DecodingInView}
+     */
+    bool decompressFrameIn(size_t frameNumber, ImageView<uint8_t> image) const;
+
+    /**Decompress the given frame straight to 32 bits colors, without an intermediate 8bpp image.
+     * Pixels are converted while decoding, transparent ones are set to colors.colors[0].
+     * @param frameNumber The frame number in the file
+     * @param image       Must have the dimensions of the frame, any stride is accepted
+     * @param colors      The colors of the palette indices, possibly palette shifted
+     * @return true on success, false if the frame data is invalid or the image has the wrong size
+     * @test{Decoders,DC6_DecodingColors}
+     */
+    bool decompressFrameIn(size_t frameNumber, ImageView<Palette::Color> image,
+                           const ColorLookupTable& colors) const;
+
+    /**Decompress the given frame as a list of runs, without expanding the transparent pixels.
+     * The previous content of the sprite is replaced.
+     * @param frameNumber The frame number in the file
+     * @param sprite      The output sprite, scanlines are from top to bottom like other outputs
+     * @return true on success, false if the frame data is invalid
+     * @test{Decoders,DC6_DecodingRuns}
+     */
+    bool decompressFrameRuns(size_t frameNumber, RunListSprite& sprite) const;
+
+    /**Decompress all the frames of all the directions, possibly concurrently.
+     * Images are requested from the provider on the calling thread, one per frame in the file
+     * order. Frames are then decoded in parallel from the file buffer, which is never modified
+     * after initDecoder().
+     * Frames with a width or height of 0 are requested as 0-sized images and are not decoded.
+     * Providers such as SimpleImageProvider do not store those, so the n-th image is the one of
+     * the n-th frame that is not empty.
+     * @param imgProvider The provider of the images, does not need to be thread safe
+     * @param executor    Used to run the decoding of each frame, @ref sequentialExecutor by default
+     * @return true if all frames were decoded successfully
+     * @test{Decoders,DC6_DecompressAllFrames}
+     */
+    bool decompressAllFrames(IImageProvider<uint8_t>& imgProvider,
+                             const TaskExecutor&      executor = sequentialExecutor) const;
+
+    /**Shrinks the frames from decompressAllFrames to the bounding box of their opaque pixels.
+     * @param frameImages     The images filled by decompressAllFrames, and nothing else
+     * @param outFrameHeaders Will hold the frame headers updated for the trimmed images: size and
+     *                        offsets. Fully transparent frames get a size of 0.
+     * @return The number of bytes saved
+     * @test{Decoders,DC6_Trim}
+     */
+    size_t trimFrames(SimpleImageProvider<uint8_t>& frameImages,
+                      std::vector<FrameHeader>&     outFrameHeaders) const;
+
     void exportToPPM(const char* ppmFilenameBase, const Palette& palette) const;
+
+    /**Encodes frames into a DC6 file.
+     * @param header   The header of the file, frames must contain directions * framesPerDir frames
+     * @param frames   The frames, in the order of the file. Empty images give 0x0 frames.
+     * @param outFile  Will hold the content of the file
+     * @param layout   Where to write the 3 bytes that surround the frames data
+     * @param executor Used to run the encoding of each frame, @ref sequentialExecutor by default
+     * @return true on success, false if the number of frames does not match the header or if a
+     *         frame is too big
+     *
+     * Each scanline is encoded with the fewest bytes the format allows, which also means the
+     * fewest control bytes to decode: transparent pixels (0) are always skipped, runs are only
+     * split when longer than 127 pixels, and the transparent pixels at the end of a scanline are
+     * not encoded. This is what the game files use, so decoding then encoding them with the same
+     * headers gives back the same file.
+     * @test{Decoders,DC6_Encoder}
+     */
+    static bool encode(const Header& header, const std::vector<EncoderFrame>& frames,
+                       std::vector<uint8_t>& outFile, Layout layout = Layout::Original,
+                       const TaskExecutor& executor = sequentialExecutor);
 };
 } // namespace WorldStone
@@ -6,14 +6,49 @@
 #include <stdint.h>
 #include <FileStream.h>
 #include <Vector.h>
+#include <functional>
 #include <memory>
 #include <type_traits>
 #include "AABB.h"
 #include "ImageView.h"
 #include "Palette.h"
 
+/**@def WS_DCC_DECODE_STATS
+ * Set to 1 to collect DCC::DecodeStats while decoding, see the WS_DCC_DECODE_STATS CMake option.
+ * When 0 (the default), the instrumentation is compiled out of the decoder.
+ */
+#ifndef WS_DCC_DECODE_STATS
+#define WS_DCC_DECODE_STATS 0
+#endif
+
 namespace WorldStone
 {
+/**
+ * @brief Scratch memory reused by the DCC decoder between directions.
+ *
+ * Decoding a direction requires buffers whose sizes depend on the direction (encoded data, pixel
+ * buffer, cells information...). Passing the same workspace to @ref DCC::readDirection lets those
+ * buffers grow to the size of the biggest direction decoded so far and never shrink. Once warmed
+ * up, decoding does not allocate memory anymore, except for what the image provider does.
+ * @note A workspace must not be shared between threads, use one per worker thread instead.
+ * @test{Decoders,DCC_Workspace}
+ */
+class DCCDecodeWorkspace
+{
+public:
+    DCCDecodeWorkspace();
+    ~DCCDecodeWorkspace();
+    DCCDecodeWorkspace(DCCDecodeWorkspace&&) noexcept;
+    DCCDecodeWorkspace& operator=(DCCDecodeWorkspace&&) noexcept;
+
+    /// The actual storage, only known by the decoder implementation.
+    struct Buffers;
+
+private:
+    friend class DCC;
+    std::unique_ptr<Buffers> buffers;
+};
+
 // clang-format off
 /**
  * @brief Decoder for the DCC image format
@@ -154,6 +189,303 @@ public:
         }
     };
 
+    /** Checkpoints of a direction, used to decode a single frame with @ref readFrame.
+     *
+     * Frames of a direction depend on the previous ones through the pixel buffer, which means
+     * decoding a frame requires decoding all the previous frames. This records, for each frame,
+     * the positions in the direction bitstreams and the state of the pixel buffer cells the frame
+     * depends on, so that decoding any frame costs about the same as decoding a single one.
+     * @see indexDirection
+     */
+    struct DirectionIndex
+    {
+        /// State of a pixel buffer cell before a frame is decoded, stored for each cell of a frame
+        struct CellState
+        {
+            uint8_t previousValues[4]; ///< Values of the last pixel buffer entry for this cell
+            bool    hasPreviousEntry;  ///< False if no frame decoded this cell yet
+            uint8_t previousWidth;     ///< Width of the cell in the previous frame, 0xF if none
+            uint8_t previousHeight;    ///< Height of the cell in the previous frame, 0xF if none
+        };
+
+        /// Positions in the bitstreams and pixel buffer states at the start of a frame
+        struct FrameCheckpoint
+        {
+            size_t equalCellBitPos;
+            size_t pixelMaskBitPos;
+            size_t rawPixelUsageBitPos;
+            size_t rawPixelCodesBitPos;
+            size_t pixelCodesDisplacementBitPos;
+            /// Position of the pixel code indices (read in the displacement bitstream by stage 2)
+            size_t pixelCodeIndicesBitPos;
+            size_t firstCellState; ///< Index of the state of the first cell of the frame
+            size_t firstKeptCell;  ///< Offset of the first cell kept from before in keptCells
+        };
+
+        Direction       direction;
+        Vector<uint8_t> encodedDirection; ///< The raw data of the direction
+        size_t          streamsBitPos;    ///< Position of the bitstreams sizes, after the headers
+
+        Vector<FrameCheckpoint> frames;
+        Vector<CellState>       cellStates;
+        /** Cells that are the same as in the previous frame, in the frame cells order.
+         * Like a pixel buffer entry, a cell is stored as its number of colors (1 to 4), the colors,
+         * then the 0, 1 or 2 bits index of the color of each pixel.
+         * A cell written by cells of different sizes can use more colors, it is then stored as 0
+         * followed by its pixels.
+         */
+        Vector<uint8_t> keptCells;
+    };
+
+    /** Frames of a direction stored as grids of 4x4 blocks of pixels, deduplicated across frames.
+     *
+     * Most cells of a DCC frame are the same as in the previous frames (which is what the
+     * compressEqualCells encoding exploits). Storing each unique block of pixels only once uses a
+     * lot less memory than an image per frame, and lets renderers draw a frame as a list of
+     * blocks. Blocks are aligned on a grid starting at the top-left corner of the direction
+     * extents, pixels of a block that are outside of the frame are set to 0 (transparent).
+     *
+     * Directions where the blocks would use more memory than the frames (small or noisy
+     * animations), or that need more than maxBlocks blocks, are stored as plain frames in
+     * framesPixels instead. Use isTiled() to know which representation is used.
+     * @see DecodeOptions::tiles
+     */
+    struct TiledDirection
+    {
+        static constexpr size_t blockSize   = 4; ///< Width and height of a block, in pixels
+        static constexpr size_t blockPixels = blockSize * blockSize;
+        /// Maximum number of unique blocks of a tiled direction, so that indices fit in 16 bits
+        static constexpr size_t maxBlocks = size_t(UINT16_MAX) + 1;
+
+        struct TiledFrame
+        {
+            uint16_t offsetX;   ///< X Offset relative to the direction extents, in pixels
+            uint16_t offsetY;   ///< Y Offset relative to the direction extents, in pixels
+            uint16_t width;     ///< Width of the frame, in pixels
+            uint16_t height;    ///< Height of the frame, in pixels
+            uint16_t nbBlocksX; ///< Number of blocks per row, the first one is at offsetX/blockSize
+            uint16_t nbBlocksY; ///< Number of rows of blocks, the first one is at offsetY/blockSize
+            /// Position of the frame first block in blockIndices if the direction is tiled,
+            /// of its first pixel in framesPixels otherwise
+            uint32_t firstBlock;
+        };
+
+        /// Pixels of the unique blocks, blockPixels bytes per block. Block 0 is always transparent.
+        Vector<uint8_t> blocksPixels;
+        /// Index of the block used at each position of the frames, row by row
+        Vector<uint16_t> blockIndices;
+        /// Pixels of the frames, one after the other, only used if the direction is not tiled
+        Vector<uint8_t>    framesPixels;
+        Vector<TiledFrame> frames;
+
+        /// Returns the number of unique blocks
+        size_t nbBlocks() const { return blocksPixels.size() / blockPixels; }
+        /// Returns true if the frames are stored as blocks, false if they are in framesPixels
+        bool isTiled() const { return !blocksPixels.empty(); }
+
+        /** Copies the pixels of a frame into an image.
+         * @param frameIndex The index of the frame in the direction.
+         * @param dst        An image of the size of the frame.
+         */
+        void copyFrameTo(size_t frameIndex, ImageView<uint8_t> dst) const;
+    };
+
+    /** A frame stored as 4x4 blocks of 2-bit indices into 4 palette values, a bit like DXT.
+     *
+     * Stage 2 of the decoding assigns at most 4 colors to each cell of the pixel buffer, so any
+     * frame can be stored with 2 bits per pixel plus 4 bytes per block instead of 8 bits per pixel.
+     * Blocks are 8 bytes each, which maps directly to a RG32U texel for renderers to resolve the
+     * pixels in a shader. Blocks are aligned on the cells grid of the direction, the first pixel of
+     * the frame is at (originX,originY) in the first block.
+     * @see encodeIndexedBlocks
+     */
+    struct IndexedBlocksFrame
+    {
+        static constexpr size_t blockSize = 4; ///< Width and height of a block, in pixels
+
+        struct Block
+        {
+            uint8_t  values[4]; ///< The palette indices used by the block
+            uint32_t indices;   ///< 2 bits per pixel, row by row starting from the LSB
+        };
+
+        uint16_t      originX;   ///< X position of the frame first pixel in the first block
+        uint16_t      originY;   ///< Y position of the frame first pixel in the first block
+        uint16_t      width;     ///< Width of the frame, in pixels
+        uint16_t      height;    ///< Height of the frame, in pixels
+        uint16_t      nbBlocksX; ///< Number of blocks per row
+        uint16_t      nbBlocksY; ///< Number of rows of blocks
+        Vector<Block> blocks;    ///< The blocks, row by row
+
+        /// Returns the value of the pixel at position (x,y) of the frame
+        uint8_t operator()(size_t x, size_t y) const
+        {
+            const size_t blockX = originX + x;
+            const size_t blockY = originY + y;
+            const Block& block =
+                blocks[blockX / blockSize + (blockY / blockSize) * nbBlocksX];
+            const size_t shift = 2 * (blockX % blockSize + (blockY % blockSize) * blockSize);
+            return block.values[(block.indices >> shift) & 0x3];
+        }
+    };
+
+    /** Frames of a direction stored with as few bits per pixel as its colors allow.
+     *
+     * The header of a direction lists the pixel values it uses, and effects such as blood or
+     * shadows only use a handful of them. Frames of directions with at most 4 or 16 values
+     * (transparent included) are stored as 2 or 4-bit indices into a small palette, other
+     * directions use 8 bits per pixel. Use @ref unpackFrame to get back the pixel values.
+     * @see DecodeOptions::packed
+     */
+    struct PackedDirection
+    {
+        struct PackedFrame
+        {
+            uint16_t width;     ///< Width of the frame, in pixels
+            uint16_t height;    ///< Height of the frame, in pixels
+            size_t   stride;    ///< Size of a row in bytes, rows start on a byte boundary
+            size_t   firstByte; ///< Position of the frame first row in pixels
+        };
+
+        unsigned bitsPerPixel; ///< 2, 4 or 8
+        /// Value of each index, has (1 << bitsPerPixel) entries. Index 0 is always transparent.
+        Vector<uint8_t> palette;
+        /// Indices of the pixels of all the frames, row by row, starting from the lowest bits
+        Vector<uint8_t>     pixels;
+        Vector<PackedFrame> frames;
+
+        /** Copies the pixel values of a frame into an image.
+         * @param frameIndex The index of the frame in the direction.
+         * @param dst        An image of the size of the frame.
+         */
+        void unpackFrame(size_t frameIndex, ImageView<uint8_t> dst) const;
+    };
+
+    /** The regions of each frame that changed since the previous one, see @ref DecodeOptions.
+     *
+     * Rectangles are relative to the direction extents, and assume the frames are drawn into an
+     * image of the size of the direction, transparent (0) outside of the frame. Updating those
+     * rectangles of such an image with the pixels of a frame turns the previous frame into the
+     * new one, which lets renderers keep a single texture per direction and only upload what
+     * changed instead of a texture per frame. The first frame covers the whole direction.
+     * @note Only the decoding side exists for now, RendererApp still uploads a texture per frame.
+     */
+    struct DirtyRegions
+    {
+        struct Rect
+        {
+            uint16_t x;      ///< X Offset relative to the direction extents, in pixels
+            uint16_t y;      ///< Y Offset relative to the direction extents, in pixels
+            uint16_t width;  ///< Width of the rectangle, in pixels
+            uint16_t height; ///< Height of the rectangle, in pixels
+        };
+
+        /// The rectangles of all the frames, rectangles of a frame do not overlap
+        Vector<Rect> rects;
+        /// Index of the first rectangle of each frame, has one more element than there are frames
+        Vector<size_t> firstRect;
+
+        /// Returns the number of rectangles of a frame
+        size_t nbRects(size_t frameIndex) const
+        {
+            return firstRect[frameIndex + 1] - firstRect[frameIndex];
+        }
+    };
+
+    /// A frame to be encoded by @ref encode
+    struct EncoderFrame
+    {
+        ImageView<const uint8_t> image;   ///< The pixels of the frame, 0 being transparent
+        int32_t                  xOffset; ///< Same as FrameHeader::xOffset, left column
+        int32_t                  yOffset; ///< Same as FrameHeader::yOffset, bottom row
+    };
+
+    /** Statistics of the decoding of a direction, filled by @ref readDirection.
+     * Only collected if the decoder is compiled with WS_DCC_DECODE_STATS, see
+     * @ref decodeStatsEnabled.
+     */
+    struct DecodeStats
+    {
+        ///@name Time spent in each step, in microseconds
+        ///@{
+        double headersTime;          ///< Direction and frames headers, bitstreams setup
+        double framesAllocationTime; ///< Allocation of the frames images
+        double stage1Time;           ///< Decoding of the pixel buffer entries
+        double stage2Time;           ///< Decoding of the pixels, copies to the frames included
+        ///@}
+
+        ///@name Number of bits read from each bitstream
+        ///@{
+        size_t equalCellBits;
+        size_t pixelMaskBits;
+        size_t rawPixelUsageBits;
+        size_t rawPixelCodesBits;
+        size_t pixelCodesDisplacementBits; ///< Only the pixel codes, read by stage 1
+        size_t pixelCodeIndicesBits;       ///< Read by stage 2 after the pixel codes
+        ///@}
+
+        ///@name Number of frame cells of each kind
+        ///@{
+        size_t cells;          ///< All the cells of the frames
+        size_t equalCells;     ///< Same as the previous cell, nothing decoded
+        size_t rawCells;       ///< Pixel codes read from the raw stream
+        size_t solidFillCells; ///< A single color, no pixel index
+        size_t oneBitCells;    ///< 2 colors, 1-bit pixel indices
+        size_t twoBitCells;    ///< 3 or 4 colors, 2-bit pixel indices
+        ///@}
+    };
+
+    /// True if the decoder was compiled with WS_DCC_DECODE_STATS, otherwise DecodeStats are 0
+    static constexpr bool decodeStatsEnabled = WS_DCC_DECODE_STATS != 0;
+
+    /** Called by @ref readDirection as soon as a frame is decoded.
+     * The first parameter is the number of the frame in the direction, the second its image.
+     */
+    using FrameDecodedCallback = std::function<void(uint32_t, ImageView<const uint8_t>)>;
+
+    /** What @ref readDirection decodes a direction into, every member is optional.
+     *
+     * The frames can be stored in several representations at once, each output that is not null
+     * is filled. Without any output, the direction is only decoded, for example to measure it.
+     */
+    struct DecodeOptions
+    {
+        /// Allocates the 8bpp images of the frames, in the order of the file
+        IImageProvider<uint8_t>* images = nullptr;
+        /** Allocates the frames converted to 32 bits colors, in the order of the file.
+         * Each frame is converted from the pixel buffer as soon as it is decoded, so images is
+         * not needed for this.
+         */
+        IImageProvider<Palette::Color>* colorImages = nullptr;
+        /// The colors of the palette indices, possibly palette shifted. Required by colorImages.
+        const ColorLookupTable* colors = nullptr;
+        /// Will hold the frames as grids of deduplicated blocks, see TiledDirection
+        TiledDirection* tiles = nullptr;
+        /// Will hold the frames with fewer bits per pixel, see PackedDirection
+        PackedDirection* packed = nullptr;
+        /** Will hold the rectangles that changed in each frame, see DirtyRegions.
+         * The cells that the DCC format encodes as the same as in the previous frame are not
+         * part of them, neither are the pixels that were and stay transparent.
+         */
+        DirtyRegions* dirtyRegions = nullptr;
+        /** Called for each frame, in order, as soon as it is decoded.
+         * Frames can only be decoded once the first stage of the decoding is done for the whole
+         * direction, but the second stage is done frame by frame. This lets the first frame be
+         * displayed long before the last one is decoded, which matters for long animations.
+         * The image given is the one allocated by images, empty if images is null.
+         */
+        const FrameDecodedCallback* onFrameDecoded = nullptr;
+        /** Scratch memory that is reused across calls, see @ref DCCDecodeWorkspace.
+         * Reusing outDir also avoids reallocating the frame headers.
+         */
+        DCCDecodeWorkspace* workspace = nullptr;
+        /** Will hold the statistics of the decoding, all 0 if @ref decodeStatsEnabled is false.
+         * Meant to find which parts of the decoder matter for a set of files, the
+         * instrumentation has no cost unless WS_DCC_DECODE_STATS is enabled.
+         */
+        DecodeStats* stats = nullptr;
+    };
+
     /** An array that maps an encoded 4-bit size to the real size in bits.
      *  The values are { 0, 1, 2, 4, 6, 8, 10, 12, 14, 16, 20, 24, 26, 28, 30, 32 }
      */
@@ -175,6 +507,9 @@ protected:
 
     bool extractHeaderAndOffsets();
 
+    /// Reads the raw data of a direction from the stream
+    bool readDirectionBuffer(Vector<uint8_t>& buffer, uint32_t dirIndex);
+
 public:
     /**Start decoding the stream and preparing data.
      * @return true on success
@@ -199,6 +534,108 @@ public:
      */
     bool readDirection(Direction& outDir, uint32_t dirIndex, IImageProvider<uint8_t>& imgProvider);
 
+    /**Decodes a direction of the file into the representations chosen by options.
+     * @param outDir   Will hold the Direction information obtained during decoding.
+     * @param dirIndex The number of the direction in the file.
+     * @param options  The outputs to fill and the decoding settings, see DecodeOptions.
+     * @return true on success, false if options.colorImages is set without options.colors.
+     *
+     * The frames are decoded once and written to all the outputs set in options, in order.
+     * @test{Decoders,DCC_DecodeStats}
+     * @test{Decoders,DCC_Progressive}
+     * @test{Decoders,DCC_Tiled}
+     * @test{Decoders,DCC_Packed}
+     * @test{Decoders,DCC_Colors}
+     * @test{Decoders,DCC_DirtyRegions}
+     */
+    bool readDirection(Direction& outDir, uint32_t dirIndex, const DecodeOptions& options);
+
+    /**Shrinks the decoded frames of a direction to the bounding box of their non-zero pixels.
+     * @param dir         The direction that was decoded in frameImages, its frame extents are
+     *                    updated to the trimmed images. Direction::extents is left untouched.
+     * @param frameImages Must only hold the images of the frames of dir, see
+     *                    SimpleImageProvider::trimImages
+     * @return The number of bytes saved
+     * @test{Decoders,DCC_Trim}
+     */
+    static size_t trimFrames(Direction& dir, SimpleImageProvider<uint8_t>& frameImages);
+
+    /**Reads the headers of a direction, without decoding the frames.
+     * @param outDir   Will hold the direction header, the frame headers and the extents.
+     * @param dirIndex The number of the direction in the file.
+     * @return true on success
+     *
+     * Only the bytes of the headers are read from the stream, which is a lot faster than
+     * @ref readDirection when only the frames sizes and offsets are needed (layout, culling...).
+     * @test{Decoders,DCC_Headers}
+     */
+    bool readDirectionHeaders(Direction& outDir, uint32_t dirIndex);
+
+    /**Reads the headers of all the directions of the file, without decoding the frames.
+     * @param outDirs Will hold one Direction per direction of the file.
+     * @return true on success
+     * @see readDirectionHeaders
+     */
+    bool readAllDirectionHeaders(Vector<Direction>& outDirs);
+
+    /**Decodes a direction of the file and records checkpoints to decode its frames individually.
+     * @param outIndex    Will hold the direction information and checkpoints.
+     * @param dirIndex    The number of the direction in the file.
+     * @param imgProvider The image provider to be used when allocating frames data.
+     * @return true on success
+     *
+     * This decodes all the frames like @ref readDirection, and keeps a copy of the encoded data.
+     * It is meant to be done once, to then use @ref readFrame for scrubbing or sparse sampling.
+     * @test{Decoders,DCC_RandomAccess}
+     */
+    bool indexDirection(DirectionIndex& outIndex, uint32_t dirIndex,
+                        IImageProvider<uint8_t>& imgProvider);
+
+    /**Decodes a single frame of an indexed direction.
+     * @param dirIndex    The direction index built by @ref indexDirection.
+     * @param frameIndex  The number of the frame in the direction.
+     * @param imgProvider The image provider used to allocate the frame image.
+     * @return true on success
+     *
+     * The frame is decoded from the checkpoint, without decoding the previous frames.
+     */
+    static bool readFrame(const DirectionIndex& dirIndex, uint32_t frameIndex,
+                          IImageProvider<uint8_t>& imgProvider);
+
+    /// @overload Uses the workspace buffers as scratch memory, see @ref DCCDecodeWorkspace
+    static bool readFrame(const DirectionIndex& dirIndex, uint32_t frameIndex,
+                          IImageProvider<uint8_t>& imgProvider, DCCDecodeWorkspace& workspace);
+
+    /**Converts a decoded frame to blocks of 2-bit indices, see IndexedBlocksFrame.
+     * @param dir        The direction of the frame, its extents give the blocks alignment.
+     * @param frameIndex The number of the frame in the direction.
+     * @param frame      The decoded image of the frame.
+     * @param outFrame   Will hold the blocks of the frame.
+     * @return true on success, false if a block uses more than 4 different colors.
+     *
+     * This can not fail for frames decoded by @ref readDirection, since each cell of the pixel
+     * buffer uses at most 4 colors.
+     * @test{Decoders,DCC_IndexedBlocks}
+     */
+    static bool encodeIndexedBlocks(const Direction& dir, size_t frameIndex,
+                                    ImageView<const uint8_t> frame, IndexedBlocksFrame& outFrame);
+
+    /**Encodes frames sequences into a DCC file.
+     * @param directions The frames of each direction, all directions must have the same number
+     *                   of frames.
+     * @param outFile    Will hold the content of the file.
+     * @return true on success, false if a frame is empty or if a cell of the pixel buffer uses
+     *         more than 4 different colors.
+     *
+     * The pixel buffer is simulated the same way as the decoder does, and each cell is encoded
+     * with the cheapest choice: reusing the cell of the previous frame (equal cells), reusing the
+     * colors of the previous frame cell, or new pixel codes from the displacement or raw streams.
+     * Both the equal cells and raw pixels encodings are only enabled for a direction if they make
+     * it smaller.
+     * @test{Decoders,DCC_Encoder}
+     */
+    static bool encode(const Vector<Vector<EncoderFrame>>& directions, Vector<uint8_t>& outFile);
+
     /// Returns the header of the file read by extractHeaderAndOffsets
     const Header& getHeader() const { return header; }
 };
@@ -0,0 +1,150 @@
+#include "AnimData.h"
+#include <ctype.h>
+#include <string.h>
+#include <type_traits>
+
+namespace WorldStone
+{
+
+constexpr size_t   AnimData::nbBlocks;
+constexpr size_t   AnimData::maxFrames;
+constexpr size_t   AnimData::maxNameLength;
+constexpr uint32_t AnimData::notFound;
+
+namespace
+{
+/// Packs the upper case name in an integer, fails if the name is empty or too long
+bool packName(const char* cofName, uint64_t& packedName)
+{
+    packedName = 0;
+    size_t length = 0;
+    for (; cofName[length] != '\0'; length++)
+    {
+        if (length == AnimData::maxNameLength) return false;
+        const uint64_t upperChar = uint64_t(toupper(static_cast<unsigned char>(cofName[length])));
+        packedName |= upperChar << (8 * length);
+    }
+    return length != 0;
+}
+
+size_t getSlot(uint64_t packedName, size_t tableMask)
+{
+    return size_t((packedName * 0x9E3779B97F4A7C15u) >> 32) & tableMask;
+}
+} // anonymous namespace
+
+uint8_t AnimData::hashName(const char* cofName)
+{
+    uint8_t hash = 0;
+    for (size_t i = 0; cofName[i] != '\0' && cofName[i] != '.'; i++)
+        hash = uint8_t(hash + toupper(static_cast<unsigned char>(cofName[i])));
+    return hash;
+}
+
+bool AnimData::read(const StreamPtr& streamPtr)
+{
+    static_assert(std::is_trivially_copyable<Record>(),
+                  "AnimData::Record must be trivially copyable");
+    static_assert(sizeof(Record) == 160, "AnimData::Record struct needs to be packed");
+
+    animations.clear();
+    frameTriggers.clear();
+    names.clear();
+    lookupTable.clear();
+    if (!streamPtr || !streamPtr->good()) return false;
+
+    const long fileSize = streamPtr->size();
+    if (fileSize < 0) return false;
+    Vector<uint8_t> fileData(static_cast<size_t>(fileSize));
+    if (streamPtr->read(fileData.data(), fileData.size()) != fileData.size()) return false;
+
+    // The number of records is not known until all the blocks are read, find it first
+    size_t nbRecords = 0;
+    size_t offset    = 0;
+    for (size_t block = 0; block < nbBlocks; block++)
+    {
+        uint32_t blockRecords;
+        if (fileData.size() - offset < sizeof(blockRecords)) return false;
+        memcpy(&blockRecords, fileData.data() + offset, sizeof(blockRecords));
+        offset += sizeof(blockRecords);
+        if ((fileData.size() - offset) / sizeof(Record) < blockRecords) return false;
+        offset += blockRecords * sizeof(Record);
+        nbRecords += blockRecords;
+    }
+    if (offset != fileData.size()) return false;
+
+    animations.reserve(nbRecords);
+    frameTriggers.reserve(nbRecords * maxFrames);
+    names.reserve(nbRecords);
+    size_t tableSize = 16;
+    while (tableSize < 2 * nbRecords)
+        tableSize *= 2;
+    const size_t tableMask = tableSize - 1;
+    lookupTable.assign(tableSize, notFound);
+
+    offset = 0;
+    for (size_t block = 0; block < nbBlocks; block++)
+    {
+        uint32_t blockRecords;
+        memcpy(&blockRecords, fileData.data() + offset, sizeof(blockRecords));
+        offset += sizeof(blockRecords);
+        for (size_t recordIndex = 0; recordIndex < blockRecords; recordIndex++)
+        {
+            Record record;
+            memcpy(&record, fileData.data() + offset, sizeof(record));
+            offset += sizeof(record);
+
+            uint64_t packedName;
+            if (record.cofName[maxNameLength] != '\0' || !packName(record.cofName, packedName) ||
+                record.framesPerDirection > maxFrames)
+                return false;
+
+            const uint32_t animation = uint32_t(animations.size());
+            animations.push_back({record.framesPerDirection, record.animSpeed});
+            frameTriggers.insert(frameTriggers.end(), record.frameData,
+                                 record.frameData + maxFrames);
+            names.push_back(packedName);
+
+            // Keep the first record if a name is used more than once
+            size_t slot = getSlot(packedName, tableMask);
+            while (lookupTable[slot] != notFound && names[lookupTable[slot]] != packedName)
+                slot = (slot + 1) & tableMask;
+            if (lookupTable[slot] == notFound) lookupTable[slot] = animation;
+        }
+    }
+    return true;
+}
+
+uint32_t AnimData::findAnimation(const char* cofName) const
+{
+    uint64_t packedName;
+    if (lookupTable.empty() || !packName(cofName, packedName)) return notFound;
+    const size_t tableMask = lookupTable.size() - 1;
+    size_t       slot      = getSlot(packedName, tableMask);
+    while (lookupTable[slot] != notFound)
+    {
+        if (names[lookupTable[slot]] == packedName) return lookupTable[slot];
+        slot = (slot + 1) & tableMask;
+    }
+    return notFound;
+}
+
+void AnimData::getTimings(const TimingQuery* queries, size_t count, Timing* output) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (queries[i].animation >= animations.size() ||
+            animations[queries[i].animation].framesPerDirection == 0) {
+            output[i] = {0, 0};
+            continue;
+        }
+        const Animation& animation = animations[queries[i].animation];
+        // animSpeed is in 1/256th of frame per tick
+        const uint64_t elapsedFrames = (uint64_t(queries[i].ticks) * animation.animSpeed) >> 8;
+        const uint32_t frame         = uint32_t(elapsedFrames % animation.framesPerDirection);
+        const size_t   triggerIndex  = size_t(queries[i].animation) * maxFrames + frame;
+        output[i] = {uint8_t(frame), frameTriggers[triggerIndex]};
+    }
+}
+
+} // namespace WorldStone
@@ -0,0 +1,172 @@
+#include "COFCompositor.h"
+#include <algorithm>
+#include <cassert>
+
+namespace WorldStone
+{
+
+namespace
+{
+/// Keeps the images of all frames, including the empty ones, so that they match the frame indices
+class LayerFramesProvider : public IImageProvider<uint8_t>
+{
+    SimpleImageProvider<uint8_t> storage;
+
+public:
+    Vector<ImageView<uint8_t>> frames;
+
+    ImageView<uint8_t> getNewImage(size_t width, size_t height) override
+    {
+        frames.push_back(storage.getNewImage(width, height));
+        return frames.back();
+    }
+};
+
+/// A DCC direction decoded for the layers that use it
+struct DecodedLayer
+{
+    DCC*                dcc = nullptr;
+    DCC::Direction      direction;
+    LayerFramesProvider frames;
+};
+
+/// @return The blending table of the layer, indexed by the layer pixel, or nullptr if opaque
+const PalShiftTransform* getLayerBlendTable(const COF::Layer& layer, const PL2& palette)
+{
+    if (!layer.overrideTranslvl) return nullptr;
+    switch (layer.newTranslvl)
+    {
+    case 0:
+    case 1:
+    case 2: return palette.alphaBlend[layer.newTranslvl];
+    case 3: return palette.additiveBlend;
+    case 4: return palette.multiplicativeBlend;
+    default: return nullptr;
+    }
+}
+
+/// Draws the opaque pixels of src at (dstX, dstY) in dst, blending them if blendTable is not null
+void drawLayerFrame(ImageView<const uint8_t> src, ImageView<uint8_t> dst, int32_t dstX,
+                    int32_t dstY, const PalShiftTransform* blendTable)
+{
+    const int64_t firstRow = std::max<int64_t>(0, -int64_t(dstY));
+    const int64_t lastRow  = std::min<int64_t>(src.height, int64_t(dst.height) - dstY);
+    const int64_t firstCol = std::max<int64_t>(0, -int64_t(dstX));
+    const int64_t lastCol  = std::min<int64_t>(src.width, int64_t(dst.width) - dstX);
+    for (int64_t y = firstRow; y < lastRow; y++)
+    {
+        const uint8_t* const srcRow = &src(0, size_t(y));
+        uint8_t* const       dstRow = &dst(0, size_t(y + dstY)) + dstX;
+        if (blendTable) {
+            for (int64_t x = firstCol; x < lastCol; x++)
+            {
+                const uint8_t pixel = srcRow[x];
+                if (!pixel) continue;
+                dstRow[x] = dstRow[x] ? blendTable[pixel].indices[dstRow[x]] : pixel;
+            }
+        }
+        else
+        {
+            for (int64_t x = firstCol; x < lastCol; x++)
+            {
+                if (srcRow[x]) dstRow[x] = srcRow[x];
+            }
+        }
+    }
+}
+} // anonymous namespace
+
+size_t COFCompositor::CacheKeyHash::operator()(const CacheKey& key) const
+{
+    uint64_t hash = uint64_t(reinterpret_cast<uintptr_t>(key.cof)) ^ key.direction;
+    for (const DCC* dcc : key.dccs)
+    {
+        hash = (hash ^ uint64_t(reinterpret_cast<uintptr_t>(dcc))) * 0x9E3779B97F4A7C15u;
+    }
+    return size_t(hash ^ (hash >> 32));
+}
+
+const COFCompositor::CompositedDirection*
+COFCompositor::getDirection(const COF& cof, const ComponentsDCCs& dccs, uint32_t direction)
+{
+    const CacheKey key{&cof, dccs, direction};
+    auto           cached = cache.find(key);
+    if (cached != cache.end()) return cached->second.get();
+
+    std::unique_ptr<CompositedDirection> output = std::make_unique<CompositedDirection>();
+    if (!composite(cof, dccs, direction, *output)) return nullptr;
+    return cache.emplace(key, std::move(output)).first->second.get();
+}
+
+bool COFCompositor::composite(const COF& cof, const ComponentsDCCs& dccs, uint32_t direction,
+                              CompositedDirection& output)
+{
+    const COF::Header&        cofHeader = cof.getHeader();
+    const Vector<COF::Layer>& layers    = cof.getLayers();
+    if (direction >= cofHeader.directions || cofHeader.xMax < cofHeader.xMin ||
+        cofHeader.yMax < cofHeader.yMin)
+        return false;
+
+    // Decode the direction of each DCC once, and find the one of each component
+    Vector<std::unique_ptr<DecodedLayer>> decodedLayers;
+    std::array<const DecodedLayer*, COF::componentsNumber> componentLayers{};
+    std::array<const COF::Layer*, COF::componentsNumber>   componentInfos{};
+    for (const COF::Layer& layer : layers)
+    {
+        if (layer.component >= COF::componentsNumber) continue;
+        DCC* const dcc = dccs[layer.component];
+        if (!dcc) continue;
+
+        auto decoded = std::find_if(
+            decodedLayers.begin(), decodedLayers.end(),
+            [dcc](const std::unique_ptr<DecodedLayer>& other) { return other->dcc == dcc; });
+        if (decoded == decodedLayers.end()) {
+            const DCC::Header& dccHeader = dcc->getHeader();
+            if (dccHeader.directions != cofHeader.directions ||
+                dccHeader.framesPerDir != cofHeader.frames)
+                return false;
+            decodedLayers.push_back(std::make_unique<DecodedLayer>());
+            decoded         = decodedLayers.end() - 1;
+            (*decoded)->dcc = dcc;
+            DCC::DecodeOptions options;
+            options.images    = &(*decoded)->frames;
+            options.workspace = &workspace;
+            if (!dcc->readDirection((*decoded)->direction, direction, options)) return false;
+            assert((*decoded)->frames.frames.size() == cofHeader.frames);
+        }
+        componentLayers[layer.component] = decoded->get();
+        componentInfos[layer.component]  = &layer;
+    }
+
+    output.xOrigin  = cofHeader.xMin;
+    output.yOrigin  = cofHeader.yMin;
+    output.width    = size_t(cofHeader.xMax - cofHeader.xMin + 1);
+    output.height   = size_t(cofHeader.yMax - cofHeader.yMin + 1);
+    output.nbFrames = cofHeader.frames;
+    output.pixels.clear();
+    output.pixels.resize(output.width * output.height * output.nbFrames, 0);
+
+    for (size_t frame = 0; frame < output.nbFrames; frame++)
+    {
+        const ImageView<uint8_t> frameImage{output.pixels.data() +
+                                                frame * output.width * output.height,
+                                            output.width, output.height, output.width};
+        const uint8_t* const layersOrder = cof.getFrameLayerOrder(direction, frame);
+        for (size_t orderIndex = 0; orderIndex < layers.size(); orderIndex++)
+        {
+            const uint8_t component = layersOrder[orderIndex];
+            if (component >= COF::componentsNumber || !componentLayers[component]) continue;
+
+            const DecodedLayer&            decoded   = *componentLayers[component];
+            const ImageView<const uint8_t> layerImage = decoded.frames.frames[frame];
+            if (!layerImage.isValid()) continue;
+            const DCC::FrameHeader& frameHeader = decoded.direction.frameHeaders[frame];
+            drawLayerFrame(layerImage, frameImage, frameHeader.extents.xLower - output.xOrigin,
+                           frameHeader.extents.yLower - output.yOrigin,
+                           getLayerBlendTable(*componentInfos[component], palette));
+        }
+    }
+    return true;
+}
+
+} // namespace WorldStone
@@ -0,0 +1,79 @@
+#include "PL2Cache.h"
+#include <fmt/format.h>
+#include <stdio.h>
+#include <random>
+
+namespace WorldStone
+{
+
+namespace
+{
+/// Writes the PL2 in a temporary file, then renames it to replace any previous entry
+bool writeEntry(const IOBase::Path& entryPath, const PL2& pl2)
+{
+    const IOBase::Path tempPath = fmt::format("{}.{:08x}.tmp", entryPath, std::random_device{}());
+    FILE*              file     = fopen(tempPath.c_str(), "wb");
+    if (!file) return false;
+    const bool written = fwrite(&pl2, sizeof(PL2), 1, file) == 1;
+    if (fclose(file) != 0 || !written) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    // rename does not replace existing files on Windows
+    if (rename(tempPath.c_str(), entryPath.c_str()) != 0) {
+        remove(entryPath.c_str());
+        if (rename(tempPath.c_str(), entryPath.c_str()) != 0) {
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+} // anonymous namespace
+
+uint64_t PL2Cache::hashPalette(const Palette& palette)
+{
+    uint64_t hash = 0xcbf29ce484222325u;
+    for (const Palette::Color& color : palette.colors)
+    {
+        for (uint8_t component : {color.r, color.g, color.b})
+        {
+            hash ^= component;
+            hash *= 0x100000001b3u;
+        }
+    }
+    return hash;
+}
+
+IOBase::Path PL2Cache::getEntryPath(const Palette& palette) const
+{
+    return fmt::format("{}/{:016x}.pl2", cacheDirectory, hashPalette(palette));
+}
+
+const PL2* PL2Cache::getValidPL2(const MemoryMappedFile& file, const Palette& palette)
+{
+    if (file.size() != sizeof(PL2)) return nullptr;
+    // PL2 only holds bytes, so the file can be used as is
+    const PL2* pl2 = reinterpret_cast<const PL2*>(file.data());
+    return pl2->basePalette == palette ? pl2 : nullptr;
+}
+
+const PL2* PL2Cache::get(const Palette& palette, const TaskExecutor& executor)
+{
+    const uint64_t hash  = hashPalette(palette);
+    auto           entry = entries.find(hash);
+    if (entry != entries.end()) return getValidPL2(entry->second, palette);
+
+    const IOBase::Path entryPath = getEntryPath(palette);
+    MemoryMappedFile   file(entryPath);
+    if (!getValidPL2(file, palette)) {
+        file.close();
+        std::unique_ptr<PL2> pl2 = PL2::CreateFromPalette(palette, executor);
+        if (!writeEntry(entryPath, *pl2) || !file.open(entryPath)) return nullptr;
+    }
+    const PL2* pl2 = getValidPL2(file, palette);
+    if (pl2) entries.emplace(hash, std::move(file));
+    return pl2;
+}
+
+} // namespace WorldStone
@@ -9,9 +9,16 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <string.h>
 
+#if defined(WS_AVX2)
+#include <immintrin.h>
+#endif
+
 WS_PRAGMA_DIAGNOSTIC_IGNORED_CLANG("-Wfloat-equal")
 WS_PRAGMA_DIAGNOSTIC_IGNORED_GNU("-Wmissing-field-initializers")
 
@@ -40,7 +47,7 @@ bool Palette::decode(IStream* file)
     return false;
 }
 
-uint8_t Palette::GetClosestColorIndex(Palette::Color color)
+uint8_t Palette::GetClosestColorIndex(Palette::Color color) const
 {
     uint32_t closestColorDistance = std::numeric_limits<uint32_t>::max();
     size_t   closestColorIndex    = 0;
@@ -62,6 +69,113 @@ uint8_t Palette::GetClosestColorIndex(Palette::Color color)
     return uint8_t(closestColorIndex);
 }
 
+ColorLookupTable::ColorLookupTable(const Palette& palette)
+{
+    colors = palette.colors;
+    for (Palette::Color& color : colors)
+        color._padding = 0xFF;
+    colors[0]._padding = 0;
+}
+
+ColorLookupTable::ColorLookupTable(const Palette& palette, const PalShiftTransform& transform)
+{
+    for (size_t i = 0; i < Palette::colorCount; i++)
+    {
+        colors[i]          = transform.GetTranformedColor(palette, uint8_t(i));
+        colors[i]._padding = 0xFF;
+    }
+    colors[0]._padding = 0;
+}
+
+void ColorLookupTable::convert(const uint8_t* indices, Palette::Color* output, size_t count) const
+{
+    static_assert(sizeof(Palette::Color) == sizeof(uint32_t), "Colors are gathered as 32 bits");
+    size_t i = 0;
+#if defined(WS_AVX2)
+    const int* table = reinterpret_cast<const int*>(colors.data());
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i packedIndices =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i));
+        const __m256i colorsValues =
+            _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(packedIndices), 4);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), colorsValues);
+    }
+#endif
+    for (; i < count; i++)
+        output[i] = colors[indices[i]];
+}
+
+constexpr unsigned ClosestColorFinder::cellBits;
+constexpr unsigned ClosestColorFinder::cellShift;
+
+ClosestColorFinder::ClosestColorFinder(const Palette& palette)
+{
+    constexpr int    cellSize     = 1 << cellShift;
+    constexpr size_t cellsPerAxis = size_t(1) << cellBits;
+    constexpr size_t nbCells      = cellsPerAxis * cellsPerAxis * cellsPerAxis;
+
+    // Squared distances from each color component to the nearest and farthest values of the
+    // cells along each axis, so that the distances to a cell are only additions.
+    using AxisDistances = uint32_t[cellsPerAxis][Palette::colorCount];
+    std::unique_ptr<AxisDistances[]> nearest(new AxisDistances[3]);
+    std::unique_ptr<AxisDistances[]> farthest(new AxisDistances[3]);
+    for (size_t colorIndex = 0; colorIndex < Palette::colorCount; colorIndex++)
+    {
+        const Palette::Color color         = palette.colors[colorIndex];
+        const int            components[3] = {color.r, color.g, color.b};
+        for (size_t axis = 0; axis < 3; axis++)
+        {
+            for (size_t cellCoord = 0; cellCoord < cellsPerAxis; cellCoord++)
+            {
+                const int lower = int(cellCoord) * cellSize, upper = lower + cellSize - 1;
+                const int value = components[axis];
+                const int nearestDiff =
+                    value < lower ? lower - value : (value > upper ? value - upper : 0);
+                const int farthestDiff = std::max(std::abs(value - lower), std::abs(value - upper));
+                nearest[axis][cellCoord][colorIndex]  = uint32_t(nearestDiff * nearestDiff);
+                farthest[axis][cellCoord][colorIndex] = uint32_t(farthestDiff * farthestDiff);
+            }
+        }
+    }
+
+    cellsCandidates.reserve(nbCells + 1);
+    uint32_t cellDistances[Palette::colorCount];
+    for (size_t cell = 0; cell < nbCells; cell++)
+    {
+        const size_t r = cell / (cellsPerAxis * cellsPerAxis);
+        const size_t g = (cell / cellsPerAxis) % cellsPerAxis;
+        const size_t b = cell % cellsPerAxis;
+        // The closest color of any point of the cell is at most maxDistance away from it
+        uint32_t maxDistance = UINT32_MAX;
+        for (size_t colorIndex = 0; colorIndex < Palette::colorCount; colorIndex++)
+        {
+            maxDistance = std::min(maxDistance, farthest[0][r][colorIndex] +
+                                                    farthest[1][g][colorIndex] +
+                                                    farthest[2][b][colorIndex]);
+            cellDistances[colorIndex] =
+                nearest[0][r][colorIndex] + nearest[1][g][colorIndex] + nearest[2][b][colorIndex];
+        }
+        // Colors further than this can not be the closest of any point of the cell
+        const size_t firstCandidate = candidates.size();
+        cellsCandidates.push_back(uint32_t(firstCandidate));
+        for (size_t colorIndex = 0; colorIndex < Palette::colorCount; colorIndex++)
+        {
+            if (cellDistances[colorIndex] > maxDistance) continue;
+            const Palette::Color color = palette.colors[colorIndex];
+            candidates.push_back(
+                {color.r, color.g, color.b, uint8_t(colorIndex), cellDistances[colorIndex] << 8});
+        }
+        // Sorting by distance to the cell lets the queries stop once the remaining candidates
+        // are all further than the closest color found so far
+        std::stable_sort(candidates.begin() + ptrdiff_t(firstCandidate), candidates.end(),
+                         [](const Candidate& lhs, const Candidate& rhs) {
+                             return lhs.cellDistance < rhs.cellDistance;
+                         });
+    }
+    cellsCandidates.push_back(uint32_t(candidates.size()));
+}
+
 namespace
 {
 
@@ -165,7 +279,7 @@ int GetAlphaBlendRatioFromLevel(int alphaBlendLevel)
     }
 }
 
-void PL2CreateLightLevelVariations(PL2& pl2)
+void PL2CreateLightLevelVariations(PL2& pl2, const ClosestColorFinder& closestColor)
 {
 
     for (size_t variationIndex = 0; variationIndex < 32; variationIndex++)
@@ -179,15 +293,15 @@ void PL2CreateLightLevelVariations(PL2& pl2)
                 uint8_t(((variationIndex + 1) * baseColor.b) >> 5),
             };
             pl2.lightLevelVariations[variationIndex].indices[colorIndex] =
-                pl2.basePalette.GetClosestColorIndex(lightColor);
+                closestColor.GetClosestColorIndex(lightColor);
         }
     }
 }
 
-void PL2CreateInvColorVariations(PL2& pl2)
+void PL2CreateInvColorVariations(PL2& pl2, const ClosestColorFinder& closestColor)
 {
 
-    for (size_t variationIndex = 0; variationIndex < Palette::colorCount; variationIndex++)
+    for (size_t variationIndex = 0; variationIndex < 16; variationIndex++)
     {
         for (size_t colorIndex = 0; colorIndex < Palette::colorCount; ++colorIndex)
         {
@@ -198,12 +312,13 @@ void PL2CreateInvColorVariations(PL2& pl2)
                 uint8_t((((variationIndex + 1) * (255u - baseColor.b)) >> 4) + baseColor.b),
             };
             pl2.invColorVariations[variationIndex].indices[colorIndex] =
-                pl2.basePalette.GetClosestColorIndex(lightColor);
+                closestColor.GetClosestColorIndex(lightColor);
         }
     }
 }
 
-void PL2CreateSelectedUnitShift(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
+void PL2CreateSelectedUnitShift(PL2& pl2, const ClosestColorFinder& closestColor,
+                                const ColorHSL hslColors[Palette::colorCount])
 {
     for (size_t colorIndex = 0; colorIndex < Palette::colorCount; ++colorIndex)
     {
@@ -214,35 +329,33 @@ void PL2CreateSelectedUnitShift(PL2& pl2, ColorHSL hslColors[Palette::colorCount
         }
 
         pl2.selectedUnitShift.indices[colorIndex] =
-            pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+            closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
     }
 }
 
-void PL2CreateAlphaBlend(PL2& pl2)
+/// Creates the table of a single alpha blend level, so that the levels can be created concurrently
+void PL2CreateAlphaBlend(PL2& pl2, const ClosestColorFinder& closestColor, int alphaBlendLevel)
 {
-    for (int alphaBlendLevel = 0; alphaBlendLevel < 3; alphaBlendLevel++)
+    const int alphaBlendRatio = GetAlphaBlendRatioFromLevel(alphaBlendLevel);
+    for (size_t dstColorIndex = 0; dstColorIndex < Palette::colorCount; ++dstColorIndex)
     {
-        const int alphaBlendRatio = GetAlphaBlendRatioFromLevel(alphaBlendLevel);
-        for (size_t dstColorIndex = 0; dstColorIndex < Palette::colorCount; ++dstColorIndex)
+        const Palette::Color dstColor = pl2.basePalette.colors[dstColorIndex];
+        for (size_t srcColorIndex = 0; srcColorIndex < Palette::colorCount; ++srcColorIndex)
         {
-            const Palette::Color dstColor = pl2.basePalette.colors[dstColorIndex];
-            for (size_t srcColorIndex = 0; srcColorIndex < Palette::colorCount; ++srcColorIndex)
-            {
-                const Palette::Color srcColor      = pl2.basePalette.colors[srcColorIndex];
-                const int            invBlendRatio = 255 - alphaBlendRatio;
-                const Palette::Color blendOuput{
-                    uint8_t((invBlendRatio * srcColor.r + alphaBlendRatio * dstColor.r) / 0xFF),
-                    uint8_t((invBlendRatio * srcColor.g + alphaBlendRatio * dstColor.g) / 0xFF),
-                    uint8_t((invBlendRatio * srcColor.b + alphaBlendRatio * dstColor.b) / 0xFF),
-                };
-                pl2.alphaBlend[alphaBlendLevel][srcColorIndex].indices[dstColorIndex] =
-                    pl2.basePalette.GetClosestColorIndex(blendOuput);
-            }
+            const Palette::Color srcColor      = pl2.basePalette.colors[srcColorIndex];
+            const int            invBlendRatio = 255 - alphaBlendRatio;
+            const Palette::Color blendOuput{
+                uint8_t((invBlendRatio * srcColor.r + alphaBlendRatio * dstColor.r) / 0xFF),
+                uint8_t((invBlendRatio * srcColor.g + alphaBlendRatio * dstColor.g) / 0xFF),
+                uint8_t((invBlendRatio * srcColor.b + alphaBlendRatio * dstColor.b) / 0xFF),
+            };
+            pl2.alphaBlend[alphaBlendLevel][srcColorIndex].indices[dstColorIndex] =
+                closestColor.GetClosestColorIndex(blendOuput);
         }
     }
 }
 
-void PL2CreateAdditiveBlend(PL2& pl2)
+void PL2CreateAdditiveBlend(PL2& pl2, const ClosestColorFinder& closestColor)
 {
     for (size_t dstColorIndex = 0; dstColorIndex < Palette::colorCount; ++dstColorIndex)
     {
@@ -256,12 +369,12 @@ void PL2CreateAdditiveBlend(PL2& pl2)
                 uint8_t(std::min(srcColor.b + dstColor.b, 0xFF)),
             };
             pl2.additiveBlend[srcColorIndex].indices[dstColorIndex] =
-                pl2.basePalette.GetClosestColorIndex(blendOuput);
+                closestColor.GetClosestColorIndex(blendOuput);
         }
     }
 }
 
-void PL2CreateMultiplicativeBlend(PL2& pl2)
+void PL2CreateMultiplicativeBlend(PL2& pl2, const ClosestColorFinder& closestColor)
 {
     for (size_t dstColorIndex = 0; dstColorIndex < Palette::colorCount; ++dstColorIndex)
     {
@@ -275,12 +388,13 @@ void PL2CreateMultiplicativeBlend(PL2& pl2)
                 uint8_t((srcColor.b * dstColor.b) / 0xFF),
             };
             pl2.multiplicativeBlend[srcColorIndex].indices[dstColorIndex] =
-                pl2.basePalette.GetClosestColorIndex(blendOuput);
+                closestColor.GetClosestColorIndex(blendOuput);
         }
     }
 }
 
-void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
+void PL2CreateColorshifts(PL2& pl2, const ClosestColorFinder& closestColor,
+                          const ColorHSL hslColors[Palette::colorCount])
 {
     for (int hueShiftIndex = 0; hueShiftIndex < 24; ++hueShiftIndex)
     {
@@ -294,7 +408,7 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
                 tmpColorHSL.hue -= 360.0;
 
             pl2.hueVariations[hueShiftIndex].indices[colorIndex] =
-                pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+                closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
         }
     }
     for (int hueShiftIndex = 0; hueShiftIndex < 24; ++hueShiftIndex)
@@ -315,7 +429,7 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
             if (tmpColorHSL.lum < 0.0) tmpColorHSL.lum = 0.0;
 
             pl2.hueVariations[24 + hueShiftIndex].indices[colorIndex] =
-                pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+                closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
         }
     }
     for (int hueShiftIndex = 0; hueShiftIndex < 24; ++hueShiftIndex)
@@ -341,7 +455,7 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
             }
 
             pl2.hueVariations[48 + hueShiftIndex].indices[colorIndex] =
-                pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+                closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
         }
     }
 
@@ -351,7 +465,7 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
         tmpColorHSL.sat      = 0;
         tmpColorHSL.lum      = tmpColorHSL.lum / 2.0;
         pl2.hueVariations[72].indices[colorIndex] =
-            pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+            closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
     }
 
     for (size_t colorIndex = 0; colorIndex < Palette::colorCount; ++colorIndex)
@@ -368,7 +482,7 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
         tmpColorHSL.lum /= double(1.2f);
 #endif
         pl2.hueVariations[73].indices[colorIndex] =
-            pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+            closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
     }
     // See previous comment about reusing the previous colors
     for (int hueShiftIndex = 0; hueShiftIndex < 24; ++hueShiftIndex)
@@ -383,7 +497,7 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
                 if (tmpColorHSL.hue > 360.0) tmpColorHSL.hue -= 360.0;
 
                 pl2.hueVariations[74 + hueShiftIndex].indices[colorIndex] =
-                    pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+                    closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
             }
             else
             {
@@ -406,7 +520,7 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
             tmpColorHSL.hue      = (double)hueShiftIndex * 30.0;
             tmpColorHSL.sat      = 1.0;
             pl2.hueVariations[99 + hueShiftIndex].indices[colorIndex] =
-                pl2.basePalette.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
+                closestColor.GetClosestColorIndex(ConvertHSLtoRGB(tmpColorHSL));
         }
     }
 
@@ -426,15 +540,15 @@ void PL2CreateColorshifts(PL2& pl2, ColorHSL hslColors[Palette::colorCount])
 #endif
 
         pl2.redTones.indices[colorIndex] =
-            pl2.basePalette.GetClosestColorIndex({colorMagnitude, 0, 0});
+            closestColor.GetClosestColorIndex({colorMagnitude, 0, 0});
         pl2.greenTones.indices[colorIndex] =
-            pl2.basePalette.GetClosestColorIndex({0, colorMagnitude, 0});
+            closestColor.GetClosestColorIndex({0, colorMagnitude, 0});
         pl2.blueTones.indices[colorIndex] =
-            pl2.basePalette.GetClosestColorIndex({0, 0, colorMagnitude});
+            closestColor.GetClosestColorIndex({0, 0, colorMagnitude});
     }
 }
 
-void PL2CreateMaxComponentBlend(PL2& pl2)
+void PL2CreateMaxComponentBlend(PL2& pl2, const ClosestColorFinder& closestColor)
 {
     for (size_t dstColorIndex = 0; dstColorIndex < Palette::colorCount; ++dstColorIndex)
     {
@@ -450,12 +564,12 @@ void PL2CreateMaxComponentBlend(PL2& pl2)
                 uint8_t((invMaxComponentDst * srcColor.b + maxComponentDst * dstColor.b) / 0xFF),
             };
             pl2.maxComponentBlend[srcColorIndex].indices[dstColorIndex] =
-                pl2.basePalette.GetClosestColorIndex(blendOuput);
+                closestColor.GetClosestColorIndex(blendOuput);
         }
     }
 }
 
-void PL2CreateDarkenedUnitShift(PL2& pl2)
+void PL2CreateDarkenedUnitShift(PL2& pl2, const ClosestColorFinder& closestColor)
 {
     for (size_t colorIndex = 0; colorIndex < Palette::colorCount; ++colorIndex)
     {
@@ -464,7 +578,7 @@ void PL2CreateDarkenedUnitShift(PL2& pl2)
         tmpColor.g -= tmpColor.g / 3;
         tmpColor.b -= tmpColor.b / 3;
 
-        pl2.darkenedColorShift.indices[colorIndex] = pl2.basePalette.GetClosestColorIndex(tmpColor);
+        pl2.darkenedColorShift.indices[colorIndex] = closestColor.GetClosestColorIndex(tmpColor);
     }
 }
 
@@ -486,7 +600,7 @@ static const Palette::Color24Bits defaultTextColors[13] = {
 };
 // clang-format on
 
-void PL2CreateTextColorshifts(PL2& pl2)
+void PL2CreateTextColorshifts(PL2& pl2, const ClosestColorFinder& closestColor)
 {
     static_assert(sizeof(defaultTextColors) == 13 * 3, "There must be 13 default text colors.");
     memcpy(pl2.textColors, defaultTextColors, sizeof(defaultTextColors));
@@ -508,13 +622,13 @@ void PL2CreateTextColorshifts(PL2& pl2)
                 uint8_t((textColor.b * textColorIntensity) / 0xFF),
             };
             pl2.textColorShifts[textColorIndex].indices[colorIndex] =
-                pl2.basePalette.GetClosestColorIndex(newColor);
+                closestColor.GetClosestColorIndex(newColor);
         }
     }
 }
 } // anonymous namespace
 
-std::unique_ptr<PL2> PL2::CreateFromPalette(const Palette& palette)
+std::unique_ptr<PL2> PL2::CreateFromPalette(const Palette& palette, const TaskExecutor& executor)
 {
     // Note : make_unique means the palshifts will be initialized to 0
     auto pl2Ptr = std::make_unique<PL2>();
@@ -528,16 +642,24 @@ std::unique_ptr<PL2> PL2::CreateFromPalette(const Palette& palette)
         hslColors[i] = ConvertRGBtoHSL(palette.colors[i]);
     }
 
-    PL2CreateLightLevelVariations(pl2);
-    PL2CreateInvColorVariations(pl2);
-    PL2CreateSelectedUnitShift(pl2, hslColors);
-    PL2CreateAlphaBlend(pl2);
-    PL2CreateAdditiveBlend(pl2);
-    PL2CreateMultiplicativeBlend(pl2);
-    PL2CreateColorshifts(pl2, hslColors);
-    PL2CreateMaxComponentBlend(pl2);
-    PL2CreateDarkenedUnitShift(pl2);
-    PL2CreateTextColorshifts(pl2);
+    // Each function writes to its own tables, and only reads the base palette
+    const ClosestColorFinder        closestColor(palette);
+    const std::function<void(PL2&)> tables[] = {
+        [&](PL2& out) { PL2CreateLightLevelVariations(out, closestColor); },
+        [&](PL2& out) { PL2CreateInvColorVariations(out, closestColor); },
+        [&](PL2& out) { PL2CreateSelectedUnitShift(out, closestColor, hslColors); },
+        [&](PL2& out) { PL2CreateAlphaBlend(out, closestColor, 0); },
+        [&](PL2& out) { PL2CreateAlphaBlend(out, closestColor, 1); },
+        [&](PL2& out) { PL2CreateAlphaBlend(out, closestColor, 2); },
+        [&](PL2& out) { PL2CreateAdditiveBlend(out, closestColor); },
+        [&](PL2& out) { PL2CreateMultiplicativeBlend(out, closestColor); },
+        [&](PL2& out) { PL2CreateColorshifts(out, closestColor, hslColors); },
+        [&](PL2& out) { PL2CreateMaxComponentBlend(out, closestColor); },
+        [&](PL2& out) { PL2CreateDarkenedUnitShift(out, closestColor); },
+        [&](PL2& out) { PL2CreateTextColorshifts(out, closestColor); },
+    };
+    executor(sizeof(tables) / sizeof(tables[0]),
+             [&](size_t tableIndex) { tables[tableIndex](pl2); });
     return pl2Ptr;
 }
 
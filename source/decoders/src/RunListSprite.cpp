@@ -0,0 +1,103 @@
+#include "RunListSprite.h"
+#include <algorithm>
+#include <cassert>
+#include <string.h>
+
+namespace WorldStone
+{
+
+namespace
+{
+/// Calls writePixels(dstPtr, srcPixels, count) for each part of a run that is inside dst
+template<class Color, class PixelWriter>
+void blitRuns(const RunListSprite& sprite, ImageView<Color> dst, int32_t dstX, int32_t dstY,
+              PixelWriter writePixels)
+{
+    if (!dst.isValid() || sprite.runs.empty()) return;
+    const int64_t firstRow = std::max<int64_t>(0, -int64_t(dstY));
+    const int64_t lastRow  = std::min<int64_t>(sprite.height, int64_t(dst.height) - dstY);
+    const int64_t dstWidth = int64_t(dst.width);
+    for (int64_t y = firstRow; y < lastRow; y++)
+    {
+        Color* const                    dstRow = &dst(0, size_t(y + dstY));
+        const RunListSprite::Run* const runs   = sprite.scanlineRuns(size_t(y));
+        const size_t                    nbRuns = sprite.nbRuns(size_t(y));
+        for (size_t runIndex = 0; runIndex < nbRuns; runIndex++)
+        {
+            const RunListSprite::Run& run   = runs[runIndex];
+            const int64_t             start = int64_t(dstX) + run.x;
+            if (start >= dstWidth) break; // Runs are sorted, the next ones are also outside
+            const int64_t clippedStart = std::max<int64_t>(start, 0);
+            const int64_t clippedEnd   = std::min<int64_t>(start + run.length, dstWidth);
+            if (clippedStart >= clippedEnd) continue;
+            writePixels(dstRow + clippedStart,
+                        sprite.pixels.data() + run.firstPixel + (clippedStart - start),
+                        size_t(clippedEnd - clippedStart));
+        }
+    }
+}
+} // anonymous namespace
+
+RunListSprite RunListSprite::fromImage(ImageView<const uint8_t> image)
+{
+    assert(image.width <= UINT16_MAX && image.height <= UINT16_MAX);
+    RunListSprite sprite;
+    sprite.width  = uint16_t(image.width);
+    sprite.height = uint16_t(image.height);
+    sprite.firstRun.reserve(image.height + 1);
+    for (size_t y = 0; y < image.height; y++)
+    {
+        sprite.firstRun.push_back(uint32_t(sprite.runs.size()));
+        const uint8_t* const row = &image(0, y);
+        size_t               x   = 0;
+        while (x < image.width)
+        {
+            while (x < image.width && row[x] == 0)
+                x++;
+            const size_t runStart = x;
+            while (x < image.width && row[x] != 0)
+                x++;
+            if (x == runStart) break;
+            sprite.runs.push_back(
+                {uint16_t(runStart), uint16_t(x - runStart), uint32_t(sprite.pixels.size())});
+            sprite.pixels.insert(sprite.pixels.end(), row + runStart, row + x);
+        }
+    }
+    sprite.firstRun.push_back(uint32_t(sprite.runs.size()));
+    return sprite;
+}
+
+bool RunListSprite::isOpaque(int32_t x, int32_t y) const
+{
+    if (x < 0 || y < 0 || x >= width || y >= height) return false;
+    const Run* const rowBegin = scanlineRuns(size_t(y));
+    const Run* const rowEnd   = rowBegin + nbRuns(size_t(y));
+    // Find the first run starting after x, x can only be in the one before
+    const Run* const nextRun =
+        std::upper_bound(rowBegin, rowEnd, x, [](int32_t value, const Run& run) {
+            return value < run.x;
+        });
+    return nextRun != rowBegin && x < (nextRun - 1)->x + (nextRun - 1)->length;
+}
+
+void RunListSprite::blitTo(ImageView<uint8_t> dst, int32_t dstX, int32_t dstY) const
+{
+    blitRuns(*this, dst, dstX, dstY, [](uint8_t* dstPtr, const uint8_t* src, size_t count) {
+        memcpy(dstPtr, src, count);
+    });
+}
+
+void RunListSprite::blitTo(ImageView<Palette::Color> dst, int32_t dstX, int32_t dstY,
+                           const Palette& palette) const
+{
+    blitRuns(*this, dst, dstX, dstY,
+             [&palette](Palette::Color* dstPtr, const uint8_t* src, size_t count) {
+                 for (size_t i = 0; i < count; i++)
+                 {
+                     dstPtr[i]          = palette.colors[src[i]];
+                     dstPtr[i]._padding = 0xFF;
+                 }
+             });
+}
+
+} // namespace WorldStone
@@ -4,16 +4,20 @@
 
 #include "cof.h"
 #include <FileStream.h>
+#include <MemoryStream.h>
 #include <SystemUtils.h>
 #include <fmt/format.h>
 #include "utils.h"
+#include <algorithm>
 #include <cassert>
+#include <mutex>
 
 // TODO : Remove asserts and replace with proper error handling
 
 namespace WorldStone
 {
 
+constexpr size_t      COF::maxWeaponClassLength;
 constexpr uint8_t     COF::componentsNumber;
 constexpr const char* COF::componentsNames[COF::componentsNumber];
 
@@ -49,4 +53,78 @@ bool COF::read(const StreamPtr& streamPtr)
     return false;
 }
 
+IOBase::Path COF::getComponentPath(const char* tokensDirectory, const char* token,
+                                   uint8_t component, const char* equipment, const char* mode,
+                                   const char* weaponClass)
+{
+    assert(component < componentsNumber);
+    const char* componentName = componentsNames[component];
+    // Weapon classes of the layers are not always null terminated
+    const size_t weaponClassLength =
+        size_t(std::find(weaponClass, weaponClass + maxWeaponClassLength, '\0') - weaponClass);
+    return fmt::format("{}\\{}\\{}\\{}{}{}{}{}.dcc", tokensDirectory, token, componentName, token,
+                       componentName, equipment, mode,
+                       fmt::string_view(weaponClass, weaponClassLength));
+}
+
+bool COF::loadComponents(Archive& archive, const char* token, const char* mode,
+                         const char* weaponClass, const Equipment& equipment,
+                         const Vector<uint32_t>& directions, Components& outComponents,
+                         const TaskExecutor& executor, const char* tokensDirectory) const
+{
+    outComponents = Components{};
+    Vector<uint8_t> componentsToLoad;
+    for (const Layer& layer : layers)
+    {
+        if (layer.component >= componentsNumber || !equipment[layer.component]) continue;
+        // Only the first layer of a component is loaded, each component is loaded by one task
+        if (outComponents[layer.component]) continue;
+        const char* layerWeaponClass = layer.weaponClass[0] ? layer.weaponClass : weaponClass;
+        outComponents[layer.component]       = std::make_unique<Component>();
+        outComponents[layer.component]->path = getComponentPath(
+            tokensDirectory, token, layer.component, equipment[layer.component], mode,
+            layerWeaponClass);
+        componentsToLoad.push_back(layer.component);
+    }
+
+    std::mutex      archiveMutex;
+    const bool      lockArchive = !archive.isThreadSafe();
+    Vector<uint8_t> componentLoaded(componentsToLoad.size(), 0);
+    executor(componentsToLoad.size(), [&](size_t taskIndex) {
+        Component& component = *outComponents[componentsToLoad[taskIndex]];
+
+        // Only the archive accesses need to be serialized, the decoding uses a copy of the file
+        Vector<uint8_t> fileData;
+        {
+            std::unique_lock<std::mutex> lock(archiveMutex, std::defer_lock);
+            if (lockArchive) lock.lock();
+            StreamPtr stream = archive.open(component.path);
+            if (!stream || !stream->good()) return;
+            const long fileSize = stream->size();
+            if (fileSize <= 0) return;
+            fileData.resize(size_t(fileSize));
+            if (stream->read(fileData.data(), fileData.size()) != fileData.size()) return;
+        }
+        if (!component.dcc.initDecoder(std::make_unique<MemoryStream>(std::move(fileData))))
+            return;
+
+        component.directions.resize(directions.size());
+        component.frames.resize(directions.size());
+        DCCDecodeWorkspace workspace;
+        DCC::DecodeOptions options;
+        options.workspace = &workspace;
+        for (size_t dirIndex = 0; dirIndex < directions.size(); dirIndex++)
+        {
+            options.images = &component.frames[dirIndex];
+            if (directions[dirIndex] >= component.dcc.getHeader().directions ||
+                !component.dcc.readDirection(component.directions[dirIndex], directions[dirIndex],
+                                             options))
+                return;
+        }
+        componentLoaded[taskIndex] = 1;
+    });
+    return std::all_of(componentLoaded.begin(), componentLoaded.end(),
+                       [](uint8_t ok) { return ok; });
+}
+
 } // namespace WorldStone
@@ -8,48 +8,90 @@
 #include <fmt/format.h>
 #include "Palette.h"
 #include "utils.h"
+#include <algorithm>
 #include <cassert>
+#include <string.h>
 
 // TODO : Remove asserts and replace with proper error handling
 
 namespace WorldStone
 {
 
-bool DC6::initDecoder(StreamPtr&& streamPtr)
+namespace
+{
+/// Longest run of pixels a control byte can describe
+constexpr size_t maxRunLength = 0x7F;
+
+/// Appends the RLE data of a scanline, see DC6::encode
+void encodeScanline(const uint8_t* row, size_t width, std::vector<uint8_t>& out)
 {
-    assert(!stream);
-    stream = std::move(streamPtr);
-    if (stream && stream->good()) {
-        return extractHeaders();
+    size_t x = 0;
+    while (x < width)
+    {
+        const size_t runStart = x;
+        if (row[x] == 0) {
+            while (x < width && row[x] == 0)
+                x++;
+            if (x == width) break; // Trailing transparent pixels are implicit
+            for (size_t left = x - runStart; left; )
+            {
+                const size_t chunkSize = std::min(left, maxRunLength);
+                out.push_back(uint8_t(0x80 | chunkSize));
+                left -= chunkSize;
+            }
+        }
+        else
+        {
+            while (x < width && row[x] != 0)
+                x++;
+            for (size_t chunkStart = runStart; chunkStart < x; chunkStart += maxRunLength)
+            {
+                const size_t chunkSize = std::min(x - chunkStart, maxRunLength);
+                out.push_back(uint8_t(chunkSize));
+                out.insert(out.end(), row + chunkStart, row + chunkStart + chunkSize);
+            }
+        }
     }
-    return false;
+    out.push_back(0x80); // End of line
+}
+} // anonymous namespace
+
+bool DC6::initDecoder(StreamPtr&& streamPtr)
+{
+    assert(fileData.empty());
+    if (!streamPtr || !streamPtr->good()) return false;
+
+    // Read everything at once, frames are small and decoding from memory is a lot faster than
+    // going through the stream for each run of pixels
+    const long fileSize = streamPtr->size();
+    if (fileSize < 0 || !streamPtr->seek(0, IStream::beg)) return false;
+    fileData.resize(size_t(fileSize));
+    if (streamPtr->read(fileData.data(), fileData.size()) != fileData.size()) return false;
+    return extractHeaders();
 }
 
 bool DC6::extractHeaders()
 {
     static_assert(std::is_trivially_copyable<Header>(), "DC6::Header must be trivially copyable");
     static_assert(sizeof(Header) == 6 * sizeof(uint32_t), "DC6::Header struct needs to be packed");
-    stream->read(&header, sizeof(header));
-    if (stream->fail()) return false;
-
-    size_t framesNumber = size_t(header.directions) * size_t(header.framesPerDir);
-    frameHeaders.resize(framesNumber);
+    if (fileData.size() < sizeof(header)) return false;
+    memcpy(&header, fileData.data(), sizeof(header));
 
+    const size_t framesNumber = size_t(header.directions) * size_t(header.framesPerDir);
+    if ((fileData.size() - sizeof(header)) / sizeof(uint32_t) < framesNumber) return false;
     framePointers.resize(framesNumber);
-    stream->read(framePointers.data(), sizeof(uint32_t) * framesNumber);
-    if (stream->fail()) return false;
+    memcpy(framePointers.data(), fileData.data() + sizeof(header),
+           sizeof(uint32_t) * framesNumber);
 
+    static_assert(std::is_trivially_copyable<FrameHeader>(),
+                  "DC6::FrameHeader must be trivially copyable");
+    static_assert(sizeof(FrameHeader) == 8 * sizeof(uint32_t),
+                  "DC6::FrameHeader struct needs to be packed");
+    frameHeaders.resize(framesNumber);
     for (size_t i = 0; i < framesNumber; ++i)
     {
-        FrameHeader& frameHeader = frameHeaders[i];
-        stream->seek(framePointers[i], IStream::beg);
-
-        static_assert(std::is_trivially_copyable<FrameHeader>(),
-                      "DC6::FrameHeader must be trivially copyable");
-        static_assert(sizeof(FrameHeader) == 8 * sizeof(uint32_t),
-                      "DC6::FrameHeader struct needs to be packed");
-        stream->read(&frameHeader, sizeof(frameHeader));
-        if (stream->fail()) return false;
+        if (framePointers[i] > fileData.size() - sizeof(FrameHeader)) return false;
+        memcpy(&frameHeaders[i], fileData.data() + framePointers[i], sizeof(FrameHeader));
     }
     return true;
 }
@@ -66,43 +108,154 @@ std::vector<uint8_t> DC6::decompressFrame(size_t frameNumber) const
 
 bool DC6::decompressFrameIn(size_t frameNumber, uint8_t* data) const
 {
-    assert(stream != nullptr);
-    stream->seek(framePointers[frameNumber] + sizeof(FrameHeader), IStream::beg);
     const FrameHeader& fHeader = frameHeaders[frameNumber];
     assert(fHeader.width > 0 && fHeader.height > 0);
-    
+    const size_t width = size_t(fHeader.width);
+    return decompressFrameIn(frameNumber, {data, width, size_t(fHeader.height), width});
+}
+
+bool DC6::decompressAllFrames(IImageProvider<uint8_t>& imgProvider,
+                              const TaskExecutor&      executor) const
+{
+    assert(executor);
+    // The provider does not need to be thread safe, so get all the images first
+    std::vector<ImageView<uint8_t>> images(frameHeaders.size());
+    for (size_t frame = 0; frame < frameHeaders.size(); frame++)
+    {
+        const FrameHeader& fHeader = frameHeaders[frame];
+        if (fHeader.width < 0 || fHeader.height < 0) return false;
+        images[frame] = imgProvider.getNewImage(size_t(fHeader.width), size_t(fHeader.height));
+        if (fHeader.width && fHeader.height && !images[frame].isValid()) return false;
+    }
+
+    // Each task only writes its own image and result
+    std::vector<uint8_t> frameDecoded(frameHeaders.size(), 0);
+    executor(frameHeaders.size(), [&](size_t frame) {
+        ImageView<uint8_t>& image = images[frame];
+        if (!image.isValid()) {
+            frameDecoded[frame] = true;
+            return;
+        }
+        image.fillBytes(0, 0, image.width, image.height, 0);
+        frameDecoded[frame] = decompressFrameIn(frame, image);
+    });
+    return std::all_of(frameDecoded.begin(), frameDecoded.end(), [](uint8_t ok) { return ok; });
+}
+
+bool DC6::getFrameData(size_t frameNumber, const uint8_t*& dataBegin,
+                       const uint8_t*& dataEnd) const
+{
+    assert(!fileData.empty());
+    const FrameHeader&   fHeader = frameHeaders[frameNumber];
+    const uint8_t* const fileEnd = fileData.data() + fileData.size();
+    const uint8_t*       src = fileData.data() + framePointers[frameNumber] + sizeof(FrameHeader);
+
     // Eat any leading 0s. Blizzard somehow changed and fucked up the encoding or serialization in D2:Remaster
     // The 3 additional trailing bytes that used to be garbage at the end of the data are now replaced with leading 0s
     // Those are NOT counted by the FrameHeader::length member, so ignore them
-    int leadingZeros = 0;
-    int val = -1;
-    do {
-        val = stream->getc();
-        if(val == 0)
-            leadingZeros++;
-    } while (val == 0);
+    const uint8_t* const firstByte = src;
+    while (src < fileEnd && *src == 0)
+        src++;
     // These are the only values we encountered so far, so report if you find another.
-    assert(leadingZeros == 0 || leadingZeros == 3);
+    assert(src == firstByte || src == firstByte + 3);
+    if (size_t(fileEnd - src) < fHeader.length) return false;
+    dataBegin = src;
+    dataEnd   = src + fHeader.length;
+    return true;
+}
 
+template<class Color, class RunWriter>
+bool DC6::decodeFrameRLE(size_t frameNumber, ImageView<Color> image, RunWriter writeRun) const
+{
+    const FrameHeader& fHeader = frameHeaders[frameNumber];
+    if (!image.isValid() || image.width != size_t(fHeader.width) ||
+        image.height != size_t(fHeader.height))
+        return false;
 
-    // TODO: figure if we should invert data here or let the renderer do it
-    // assert(!fHeader.flip);
+    const uint8_t* src;
+    const uint8_t* srcEnd;
+    if (!getFrameData(frameNumber, src, srcEnd)) return false;
 
-    // We're reading it bottom to top, but save data with the y axis from top to
-    // bottom
-    int    x = 0, y = fHeader.height - 1;
-    size_t rawIndex;
-    for (rawIndex = 0; rawIndex < fHeader.length; val = stream->getc())
+    // Scanlines are stored from bottom to top unless the frame is flipped,
+    // but we always save data with the y axis from top to bottom
+    const bool   topToBottom = fHeader.flip != 0;
+    const size_t width       = image.width;
+    size_t       x           = 0;
+    size_t       rowsLeft    = image.height;
+    Color*       row         = &image(0, topToBottom ? 0 : rowsLeft - 1);
+    while (src < srcEnd)
     {
-        if (stream->eof() || val == -1) return false;
+        const uint8_t chunkSize = *src++;
+        if (chunkSize == 0x80) // end of line
+        {
+            if (rowsLeft == 0) return false;
+            x = 0;
+            rowsLeft--;
+            // Only move to the next row if there is one, to stay inside the buffer
+            if (rowsLeft) row = &image(0, topToBottom ? image.height - rowsLeft : rowsLeft - 1);
+        }
+        else if (chunkSize & 0x80) // chunkSize & 0x80 is the number of transparent pixels
+        {
+            x += chunkSize & 0x7F;
+        }
+        else // chunkSize is the number of colors to read
+        {
+            if (rowsLeft == 0 || x + chunkSize > width || size_t(srcEnd - src) < chunkSize)
+                return false;
+            writeRun(row + x, src, chunkSize);
+            src += chunkSize;
+            x += chunkSize;
+        }
+    }
+    return true;
+}
 
-        rawIndex++; // We ate a character from the stream
+bool DC6::decompressFrameIn(size_t frameNumber, ImageView<uint8_t> image) const
+{
+    return decodeFrameRLE(frameNumber, image, [](uint8_t* dst, const uint8_t* src, size_t count) {
+        memcpy(dst, src, count);
+    });
+}
 
-        uint8_t chunkSize = static_cast<uint8_t>(val);
+bool DC6::decompressFrameIn(size_t frameNumber, ImageView<Palette::Color> image,
+                            const ColorLookupTable& colors) const
+{
+    if (!image.isValid()) return false;
+    image.fill(0, 0, image.width, image.height, colors.colors[0]);
+    return decodeFrameRLE(frameNumber, image,
+                          [&colors](Palette::Color* dst, const uint8_t* src, size_t count) {
+                              colors.convert(src, dst, count);
+                          });
+}
+
+bool DC6::decompressFrameRuns(size_t frameNumber, RunListSprite& sprite) const
+{
+    const FrameHeader& fHeader = frameHeaders[frameNumber];
+    if (fHeader.width < 0 || fHeader.height < 0 || fHeader.width > UINT16_MAX ||
+        fHeader.height > UINT16_MAX)
+        return false;
+    const uint8_t* src;
+    const uint8_t* srcEnd;
+    if (!getFrameData(frameNumber, src, srcEnd)) return false;
+
+    const size_t width  = size_t(fHeader.width);
+    const size_t height = size_t(fHeader.height);
+    sprite.width        = uint16_t(width);
+    sprite.height       = uint16_t(height);
+    sprite.pixels.clear();
+    // Runs are gathered in the order of the file, then scanlines are reordered from top to bottom
+    std::vector<RunListSprite::Run> fileRuns;
+    std::vector<uint32_t>           fileRowFirstRun{0};
+    fileRowFirstRun.reserve(height + 1);
+    size_t x = 0;
+    while (src < srcEnd)
+    {
+        const uint8_t chunkSize = *src++;
         if (chunkSize == 0x80) // end of line
         {
+            if (fileRowFirstRun.size() > height) return false;
+            fileRowFirstRun.push_back(uint32_t(fileRuns.size()));
             x = 0;
-            y--;
         }
         else if (chunkSize & 0x80) // chunkSize & 0x80 is the number of transparent pixels
         {
@@ -110,17 +263,64 @@ bool DC6::decompressFrameIn(size_t frameNumber, uint8_t* data) const
         }
         else // chunkSize is the number of colors to read
         {
-            assert(chunkSize + x <= fHeader.width);
-            stream->read(data + x + fHeader.width * y, chunkSize);
-            rawIndex += chunkSize;
+            if (fileRowFirstRun.size() > height || x + chunkSize > width ||
+                size_t(srcEnd - src) < chunkSize)
+                return false;
+            // Long runs are split by the encoder, merge them back since pixels are contiguous
+            const bool extendsLastRun = fileRuns.size() > fileRowFirstRun.back() &&
+                                        fileRuns.back().x + fileRuns.back().length == x;
+            if (extendsLastRun)
+                fileRuns.back().length = uint16_t(fileRuns.back().length + chunkSize);
+            else
+                fileRuns.push_back({uint16_t(x), chunkSize, uint32_t(sprite.pixels.size())});
+            sprite.pixels.insert(sprite.pixels.end(), src, src + chunkSize);
+            src += chunkSize;
             x += chunkSize;
-            if (stream->eof()) return false;
         }
     }
-    assert(fHeader.length == rawIndex);
+    // Missing scanlines are fully transparent
+    fileRowFirstRun.resize(height + 1, uint32_t(fileRuns.size()));
+
+    const bool topToBottom = fHeader.flip != 0;
+    sprite.runs.clear();
+    sprite.runs.reserve(fileRuns.size());
+    sprite.firstRun.clear();
+    sprite.firstRun.reserve(height + 1);
+    for (size_t y = 0; y < height; y++)
+    {
+        const size_t fileRow = topToBottom ? y : height - 1 - y;
+        sprite.firstRun.push_back(uint32_t(sprite.runs.size()));
+        sprite.runs.insert(sprite.runs.end(), fileRuns.begin() + fileRowFirstRun[fileRow],
+                           fileRuns.begin() + fileRowFirstRun[fileRow + 1]);
+    }
+    sprite.firstRun.push_back(uint32_t(sprite.runs.size()));
     return true;
 }
 
+size_t DC6::trimFrames(SimpleImageProvider<uint8_t>& frameImages,
+                       std::vector<FrameHeader>&     outFrameHeaders) const
+{
+    const size_t bytesSaved = frameImages.trimImages();
+    outFrameHeaders         = frameHeaders;
+    size_t imageIndex       = 0;
+    for (FrameHeader& fHeader : outFrameHeaders)
+    {
+        // decompressAllFrames did not allocate images for empty frames
+        if (fHeader.width == 0 || fHeader.height == 0) continue;
+        assert(imageIndex < frameImages.getImagesNumber());
+        const ImageRect bounds = frameImages.getImageBounds(imageIndex++);
+        fHeader.offsetX += int32_t(bounds.x);
+        // offsetY is the top edge of flipped frames, and the bottom edge of the others
+        if (fHeader.flip)
+            fHeader.offsetY += int32_t(bounds.y);
+        else
+            fHeader.offsetY -= fHeader.height - int32_t(bounds.y + bounds.height);
+        fHeader.width  = int32_t(bounds.width);
+        fHeader.height = int32_t(bounds.height);
+    }
+    return bytesSaved;
+}
+
 void DC6::exportToPPM(const char* ppmFilenameBase, const Palette& palette) const
 {
     for (size_t dir = 0; dir < header.directions; ++dir)
@@ -135,4 +335,73 @@ void DC6::exportToPPM(const char* ppmFilenameBase, const Palette& palette) const
         }
     }
 }
+
+bool DC6::encode(const Header& header, const std::vector<EncoderFrame>& frames,
+                 std::vector<uint8_t>& outFile, Layout layout, const TaskExecutor& executor)
+{
+    assert(executor);
+    const size_t nbFrames = size_t(header.directions) * size_t(header.framesPerDir);
+    if (frames.size() != nbFrames) return false;
+    for (const EncoderFrame& frame : frames)
+    {
+        const ImageView<const uint8_t>& image = frame.image;
+        if (image.width == 0 && image.height == 0) continue; // Empty frame
+        if (!image.isValid() || image.width > INT32_MAX || image.height > INT32_MAX) return false;
+    }
+
+    // Frames are independent, encode them separately before assembling the file
+    std::vector<std::vector<uint8_t>> framesData(nbFrames);
+    executor(nbFrames, [&](size_t frameIndex) {
+        const EncoderFrame&   frame = frames[frameIndex];
+        std::vector<uint8_t>& data  = framesData[frameIndex];
+        if (frame.image.width == 0 || frame.image.height == 0) return;
+        // Worst case is one control byte for each pixel of a non transparent run, plus the EOL
+        const size_t width = frame.image.width;
+        data.reserve(frame.image.height * (width + width / maxRunLength + 2));
+        for (size_t rowIndex = 0; rowIndex < frame.image.height; rowIndex++)
+        {
+            // Scanlines are stored from bottom to top unless the frame is flipped
+            const size_t y = frame.header.flip ? rowIndex : frame.image.height - 1 - rowIndex;
+            encodeScanline(&frame.image(0, y), frame.image.width, data);
+        }
+    });
+
+    size_t fileSize = sizeof(Header) + nbFrames * sizeof(uint32_t);
+    for (const std::vector<uint8_t>& data : framesData)
+        fileSize += sizeof(FrameHeader) + 3 + data.size();
+    if (fileSize > UINT32_MAX) return false;
+
+    outFile.clear();
+    outFile.reserve(fileSize);
+    const uint8_t* const headerBytes = reinterpret_cast<const uint8_t*>(&header);
+    outFile.insert(outFile.end(), headerBytes, headerBytes + sizeof(Header));
+    const size_t pointersPos = outFile.size();
+    outFile.resize(pointersPos + nbFrames * sizeof(uint32_t));
+    for (size_t frameIndex = 0; frameIndex < nbFrames; frameIndex++)
+    {
+        const uint32_t framePointer = uint32_t(outFile.size());
+        memcpy(&outFile[pointersPos + frameIndex * sizeof(uint32_t)], &framePointer,
+               sizeof(framePointer));
+
+        const EncoderFrame&         frame = frames[frameIndex];
+        const std::vector<uint8_t>& data  = framesData[frameIndex];
+        FrameHeader                 fHeader;
+        fHeader.flip      = frame.header.flip;
+        fHeader.width     = int32_t(frame.image.width);
+        fHeader.height    = int32_t(frame.image.height);
+        fHeader.offsetX   = frame.header.offsetX;
+        fHeader.offsetY   = frame.header.offsetY;
+        fHeader.allocSize = frame.header.allocSize;
+        fHeader.nextBlock = int32_t(framePointer + sizeof(FrameHeader) + 3 + data.size());
+        fHeader.length    = uint32_t(data.size());
+        const uint8_t* const fHeaderBytes = reinterpret_cast<const uint8_t*>(&fHeader);
+        outFile.insert(outFile.end(), fHeaderBytes, fHeaderBytes + sizeof(FrameHeader));
+        if (layout == Layout::Remaster) outFile.insert(outFile.end(), 3, 0);
+        outFile.insert(outFile.end(), data.begin(), data.end());
+        if (layout == Layout::Original)
+            outFile.insert(outFile.end(), header.skipColor, header.skipColor + 3);
+    }
+    assert(outFile.size() == fileSize);
+    return true;
+}
 } // namespace WorldStone
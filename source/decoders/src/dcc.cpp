@@ -5,19 +5,34 @@
  */
 
 #include "dcc.h"
+#include <Platform.h>
 #include <BitStream.h>
 #include <SystemUtils.h>
+#include <algorithm>
 #include <array>
 #include <assert.h>
+#include <chrono>
+#include <unordered_map>
 #include <fmt/format.h>
 #include "ImageView.h"
 #include "Palette.h"
 #include "utils.h"
 
+#if defined(WS_SSSE3)
+#include <tmmintrin.h>
+#elif defined(WS_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace WorldStone
 {
 
 constexpr unsigned DCC::bitsWidthTable[16];
+constexpr size_t   DCC::TiledDirection::blockSize;
+constexpr size_t   DCC::TiledDirection::blockPixels;
+constexpr size_t   DCC::TiledDirection::maxBlocks;
+constexpr size_t   DCC::IndexedBlocksFrame::blockSize;
+constexpr bool     DCC::decodeStatsEnabled;
 // constexpr unsigned DCC::bitsWidthTable[16] = {0,  1,  2,  4,  6,  8,  10, 12,
 //                                              14, 16, 20, 24, 26, 28, 30, 32};
 
@@ -78,6 +93,19 @@ size_t DCC::getDirectionSize(uint32_t dirIndex)
     return directionsOffsets[dirIndex + 1] - directionsOffsets[dirIndex];
 }
 
+/// Size of the DCC::DirectionHeader in the file
+constexpr size_t dirHeaderSizeInBits = 32 + 2 + 7 * 4;
+
+/// Computes the size of each DCC::FrameHeader in the file, based on the direction header
+static size_t frameHeaderSizeInBits(const DCC::DirectionHeader& dirHeader)
+{
+    constexpr auto bitsWidthTable = DCC::bitsWidthTable;
+    return bitsWidthTable[dirHeader.variable0Bits] + bitsWidthTable[dirHeader.widthBits] +
+           bitsWidthTable[dirHeader.heightBits] + bitsWidthTable[dirHeader.xOffsetBits] +
+           bitsWidthTable[dirHeader.yOffsetBits] + bitsWidthTable[dirHeader.optionalBytesBits] +
+           bitsWidthTable[dirHeader.codedBytesBits] + 1; // frameBottomUp
+}
+
 static bool readDirHeader(DCC::DirectionHeader& dirHeader, BitStreamView& bitStream)
 {
     dirHeader.outsizeCoded          = bitStream.readUnsigned(32);
@@ -131,9 +159,13 @@ static bool readFrameHeaders(uint32_t nbFrames, DCC::Direction& outDir, BitStrea
             fHdr.extents.yUpper = fHdr.yOffset + 1;
         }
     }
+    return bitStream.good();
+}
 
-    // Handle optional data
-    for (DCC::FrameHeader& frameHeader : outDir.frameHeaders)
+/// Skips the optional data of the frames, which follows the frame headers
+static bool skipFramesOptionalData(const DCC::Direction& dir, BitStreamView& bitStream)
+{
+    for (const DCC::FrameHeader& frameHeader : dir.frameHeaders)
     {
         if (frameHeader.optionalBytes) {
             assert(false && "Please report the name of the DCC file to the devs!");
@@ -165,27 +197,35 @@ struct FrameData
 {
     using CellSize = uint8_t;
 
-    size_t   firstPixelBufferEntry;
+    size_t   firstPixelBufferEntry = 0;
     uint16_t nbCellsX;
     uint16_t nbCellsY;
     uint16_t offsetX; ///< X Offset relative to the whole direction bounding box
     uint16_t offsetY; ///< Y Offset relative to the whole direction bounding box
+    uint16_t width;
+    uint16_t height;
 
     Vector<bool>     cellSameAsPrevious;
     Vector<CellSize> cellWidths;
     Vector<CellSize> cellHeights;
 
     ImageView<uint8_t> imageView; ///< Output buffer image view
-    FrameData(const DCC::Direction& dir, const DCC::FrameHeader& frameHeader,
-              IImageProvider<uint8_t>& imgProvider)
-        : firstPixelBufferEntry(0)
+
+    /** Compute the cells of the frame and allocate its image. Reuses the memory of the vectors.
+     * If imgProvider is null, no image is allocated and the frame is only decoded in the pixel
+     * buffer.
+     */
+    void prepare(const DCC::Direction& dir, const DCC::FrameHeader& frameHeader,
+                 IImageProvider<uint8_t>* imgProvider)
     {
+        firstPixelBufferEntry = 0;
         offsetX = uint16_t(frameHeader.extents.xLower - dir.extents.xLower);
         offsetY = uint16_t(frameHeader.extents.yLower - dir.extents.yLower);
 
         // width (in # of pixels) in 1st column
         const uint16_t widthFirstColumn = 4 - (offsetX % 4);
         const uint16_t frameWidth       = uint16_t(frameHeader.extents.width());
+        width                           = frameWidth;
         if ((frameWidth - widthFirstColumn) <= 1)
             nbCellsX = 1; // if 2nd column is 0 or 1 pixel wide, only use 1 cell
         else
@@ -198,6 +238,7 @@ struct FrameData
 
         const uint16_t heightFirstRow = 4 - (offsetY % 4);
         const uint16_t frameHeight    = uint16_t(frameHeader.extents.height());
+        height                        = frameHeight;
         if ((frameHeight - heightFirstRow) <= 1)
             nbCellsY = 1; // if 2nd row is 0 or 1 pixel high, only use 1 cell
         else
@@ -207,11 +248,11 @@ struct FrameData
             if ((tmp % 4) == 0) nbCellsY--;
         }
 
-        cellSameAsPrevious.resize(size_t(nbCellsX) * size_t(nbCellsY));
+        cellSameAsPrevious.assign(size_t(nbCellsX) * size_t(nbCellsY), false);
 
         // Initialize to 4 by default
-        cellWidths.resize(nbCellsX, 4);
-        cellHeights.resize(nbCellsY, 4);
+        cellWidths.assign(nbCellsX, 4);
+        cellHeights.assign(nbCellsY, 4);
 
         if (nbCellsX == 1)
             cellWidths[0] = CellSize(frameWidth); // Might have merged 2nd column into 1st
@@ -238,7 +279,8 @@ struct FrameData
                 CellSize(frameHeight - (heightFirstRow + heightExcludingFirstAndLastRows));
         }
 
-        imageView = imgProvider.getNewImage(frameWidth, frameHeight);
+        imageView = imgProvider ? imgProvider->getNewImage(frameWidth, frameHeight)
+                                : ImageView<uint8_t>{};
     }
 };
 
@@ -246,7 +288,8 @@ struct DirectionData
 {
     const DCC::Direction& dirRef;
 
-    Vector<uint8_t> codeToPixelValue;
+    Vector<uint8_t>& codeToPixelValue;
+    size_t           nbPixelValues; ///< Number of pixel values used by the direction
 
     BitStreamView equalCellBitStream;
     BitStreamView pixelMaskBitStream;
@@ -258,11 +301,18 @@ struct DirectionData
     size_t nbPixelBufferCellsX;
     size_t nbPixelBufferCellsY;
 
-    Vector<FrameData> framesData;
+    /// Might hold more than nbFrames elements, as it is never shrinked to reuse the memory
+    Vector<FrameData>& framesData;
+
+    /// Only set if WS_DCC_DECODE_STATS is enabled and the caller requested statistics
+    DCC::DecodeStats* stats = nullptr;
 
     DirectionData(const DCC::Direction& dir, BitStreamView& bitStream, size_t nbFramesPerDir,
-                  IImageProvider<uint8_t>& imgProvider)
-        : dirRef(dir), nbFrames(nbFramesPerDir)
+                  Vector<uint8_t>& codeToPixelValueStorage, Vector<FrameData>& framesDataStorage)
+        : dirRef(dir),
+          codeToPixelValue(codeToPixelValueStorage),
+          nbFrames(nbFramesPerDir),
+          framesData(framesDataStorage)
     {
         uint32_t equalCellsBitStreamSize    = 0;
         uint32_t pixelMaskBitStreamSize     = 0;
@@ -285,12 +335,16 @@ struct DirectionData
         // code 0 gives 0
         // code 1 gives 31
         // code 2 gives 42
+        codeToPixelValue.clear();
         codeToPixelValue.reserve(256);
         for (size_t i = 0; i < 256; i++)
         {
             const bool pixelValueUsed = bitStream.readBool();
             if (pixelValueUsed) codeToPixelValue.push_back(uint8_t(i));
         }
+        nbPixelValues = codeToPixelValue.size();
+        // Pad the table so that any code can be looked up, even the ones not decoded in stage 1
+        codeToPixelValue.resize(256, 0);
 
         // Prepare the bitstreams
 
@@ -322,12 +376,16 @@ struct DirectionData
         // nbPixelBufferCellsX = dirWidth/4 rounded up
         nbPixelBufferCellsX = 1u + (dirWidth - 1u) / pbCellMaxPixelSize;
         nbPixelBufferCellsY = 1u + (dirHeight - 1u) / pbCellMaxPixelSize;
+    }
 
-        framesData.reserve(nbFrames);
+    /// Prepare the data of every frame of the direction, and allocate their images if requested
+    void allocateFrames(IImageProvider<uint8_t>* imgProvider)
+    {
+        if (framesData.size() < nbFrames) framesData.resize(nbFrames);
 
         for (size_t frameIndex = 0; frameIndex < nbFrames; ++frameIndex)
         {
-            framesData.emplace_back(dir, dir.frameHeaders[frameIndex], imgProvider);
+            framesData[frameIndex].prepare(dirRef, dirRef.frameHeaders[frameIndex], imgProvider);
         }
     }
 
@@ -343,44 +401,105 @@ struct DirectionData
 };
 
 using PixelCodesStack = std::array<uint8_t, PixelBufferEntry::nbValues>;
-/**
- * @return the number of pixels codes decoded from the stream
+
+/** Lookup tables used to finalize a pixel buffer entry from its pixel mask.
+ *
+ * For each pixel mask and number of pixel codes decoded, slotSource gives for each value of the
+ * new entry its index in the following array:
+ * | 0..3                   | 4..7                            |
+ * | ---------------------- | ------------------------------- |
+ * | Decoded stack values   | Values of the previous entry    |
+ * The stack is popped for each bit set in the mask, starting from the last value decoded. Once
+ * the stack is empty, the values not decoded (always 0) are used instead, hence we can just
+ * point to the matching stack slot.
  */
-int decodePixelCodesStack(DirectionData& data, uint8_t pixelMask, PixelCodesStack& pixelCodesStack)
+struct PixelMaskTable
 {
-    if (!pixelMask) return 0; // Reuse the previous cell values, but still decode the cell in stage2
-    const uint16_t nbPixelsInMask = Utils::popCount(uint16_t(pixelMask));
+    static constexpr size_t nbMasks = 1u << PixelBufferEntry::nbValues;
 
-    // Is the cell encoded in the raw stream ?
-    const bool decodeRaw = data.rawPixelUsageBitStream.bufferSizeInBits() > 0 &&
-                           data.rawPixelUsageBitStream.readBool();
+    uint8_t nbPixels[nbMasks];
+    uint8_t slotSource[nbMasks][PixelBufferEntry::nbValues + 1][PixelBufferEntry::nbValues];
+
+    constexpr PixelMaskTable() : nbPixels(), slotSource()
+    {
+        for (size_t mask = 0; mask < nbMasks; mask++)
+        {
+            for (size_t i = 0; i < PixelBufferEntry::nbValues; i++)
+                nbPixels[mask] += (mask >> i) & 1u;
+
+            for (size_t nbDecoded = 0; nbDecoded <= PixelBufferEntry::nbValues; nbDecoded++)
+            {
+                size_t rank = 0; // Number of bits set before the current one
+                for (size_t i = 0; i < PixelBufferEntry::nbValues; i++)
+                {
+                    uint8_t& source = slotSource[mask][nbDecoded][i];
+                    if (!(mask & (1u << i)))
+                        source = uint8_t(PixelBufferEntry::nbValues + i);
+                    else if (rank < nbDecoded)
+                        source = uint8_t(nbDecoded - 1 - rank++);
+                    else
+                        source = uint8_t(rank++);
+                }
+            }
+        }
+    }
+};
 
+constexpr PixelMaskTable pixelMaskTable{};
+
+/** Reads a pixel code from pixelCodesDisplacementBitStream, as an offset to lastPixelCode.
+ * The displacement is encoded as a sum of 4-bit values, a nibble of 0xF meaning that another one
+ * follows. The nibbles are looked up in a 64-bit window so that most codes are decoded without
+ * looping on each nibble.
+ */
+uint8_t readPixelCodeDisplacement(BitStreamView& bitStream, uint8_t lastPixelCode)
+{
+    constexpr uint64_t nibblesLowBits = 0x1111111111111111u;
+    // Only consider the nibbles we know are valid in the window
+    constexpr unsigned nbWindowNibbles = 14u;
+    constexpr uint64_t windowMask      = (uint64_t(1) << (4 * nbWindowNibbles)) - 1u;
+
+    const uint64_t window = bitStream.peek64();
+    // Low bit of each nibble is set if the nibble is not 0xF, ie. if it ends the displacement
+    const uint64_t lastNibbles =
+        ~(window & (window >> 1) & (window >> 2) & (window >> 3)) & nibblesLowBits & windowMask;
+    if (lastNibbles) {
+        const unsigned lastNibbleBitPos = unsigned(Utils::countTrailingZeros(lastNibbles));
+        const unsigned nbFullNibbles    = lastNibbleBitPos / 4;
+        bitStream.skip(lastNibbleBitPos + 4);
+        return uint8_t(lastPixelCode + 0xF * nbFullNibbles + ((window >> lastNibbleBitPos) & 0xF));
+    }
+
+    uint8_t pixelCode = lastPixelCode;
+    uint8_t pixelDisplacement;
+    do
+    {
+        pixelDisplacement = bitStream.readUnsigned8OrLess(4);
+        pixelCode += pixelDisplacement;
+    } while (pixelDisplacement == 0xF);
+    return pixelCode;
+}
+
+/** Reads pixel codes until the stack is full or the same code is read twice.
+ * @param readPixelCode Called with the last pixel code to read the next one.
+ * @return the number of pixels codes decoded from the stream
+ */
+template<class ReadPixelCodeFunc>
+int decodePixelCodes(size_t nbPixelsInMask, PixelCodesStack& pixelCodesStack,
+                     ReadPixelCodeFunc&& readPixelCode)
+{
     uint8_t lastPixelCode = 0;
     size_t  curPixelIdx   = 0;
 
     for (curPixelIdx = 0; curPixelIdx < nbPixelsInMask; curPixelIdx++)
     {
         uint8_t& curPixelCode = pixelCodesStack[curPixelIdx];
-        if (decodeRaw) {
-            // Read the value of the code directly from rawPixelCodesBitStream
-            curPixelCode = data.rawPixelCodesBitStream.readUnsigned8OrLess(8);
-        }
-        else
-        {
-            // Read the value of the code incrementally from pixelCodesDisplacementBitStream
-            curPixelCode = lastPixelCode;
-            uint8_t pixelDisplacement;
-            do
-            {
-                pixelDisplacement = data.pixelCodesDisplacementBitStream.readUnsigned8OrLess(4);
-                curPixelCode += pixelDisplacement;
-            } while (pixelDisplacement == 0xF);
-        }
+        curPixelCode          = readPixelCode(lastPixelCode);
         // Stop decoding if we encounter twice the same pixel code.
         // It also means that this pixel code is discarded.
         if (curPixelCode == lastPixelCode) {
-            // Note : We discard the pixel by putting a 0 but it doesn't matter anyway since we only
-            // use nbPixelsDecoded values later when popping the stack
+            // Note : We discard the pixel by putting a 0, which is also what the pixel mask table
+            // expects for values that were not decoded.
             curPixelCode = 0;
             break;
         }
@@ -392,6 +511,35 @@ int decodePixelCodesStack(DirectionData& data, uint8_t pixelMask, PixelCodesStac
     return int(curPixelIdx);
 }
 
+/**
+ * @tparam HasRawPixelEncoding Same as DCC::DirectionHeader::hasRawPixelEncoding
+ * @return the number of pixels codes decoded from the stream
+ */
+template<bool HasRawPixelEncoding>
+int decodePixelCodesStack(DirectionData& data, uint8_t pixelMask, PixelCodesStack& pixelCodesStack)
+{
+    if (!pixelMask) return 0; // Reuse the previous cell values, but still decode the cell in stage2
+    const size_t nbPixelsInMask = pixelMaskTable.nbPixels[pixelMask];
+
+    // Is the cell encoded in the raw stream ?
+    if (HasRawPixelEncoding && data.rawPixelUsageBitStream.readBool()) {
+        if (WS_DCC_DECODE_STATS && data.stats) data.stats->rawCells++;
+        // Read the value of the codes directly from rawPixelCodesBitStream
+        return decodePixelCodes(nbPixelsInMask, pixelCodesStack, [&](uint8_t) {
+            return data.rawPixelCodesBitStream.readUnsigned8OrLess(8);
+        });
+    }
+    // Read the value of the codes incrementally from pixelCodesDisplacementBitStream
+    return decodePixelCodes(nbPixelsInMask, pixelCodesStack, [&](uint8_t lastPixelCode) {
+        return readPixelCodeDisplacement(data.pixelCodesDisplacementBitStream, lastPixelCode);
+    });
+}
+
+/** Decodes the pixel buffer entries of a frame.
+ * The direction encoding options are template parameters so that the checks are not done for
+ * each cell, use getDecodeFrameStage1 to get the instance matching a direction.
+ */
+template<bool CompressEqualCells, bool HasRawPixelEncoding>
 void decodeFrameStage1(DirectionData& data, FrameData& frameData, Vector<size_t>& pixelBuffer,
                        Vector<PixelBufferEntry>& pbEntries)
 {
@@ -418,7 +566,7 @@ void decodeFrameStage1(DirectionData& data, FrameData& frameData, Vector<size_t>
             // Check if this cell is equal to the previous one
             if (lastPixelEntryIndexForCell < pbEntries.size()) {
                 // Check if we have to reuse the previous values
-                if (data.dirRef.header.compressEqualCells) {
+                if (CompressEqualCells) {
                     // If true, the cell is the same as the previous one or transparent.
                     // Which actually mean the same thing : skip the decoding of this cell
                     sameAsPreviousCell = data.equalCellBitStream.readBool();
@@ -430,16 +578,30 @@ void decodeFrameStage1(DirectionData& data, FrameData& frameData, Vector<size_t>
 
             // Store the fact that we skipped this cell for the 2nd phase
             frameData.cellSameAsPrevious[curFrameCellIndex] = sameAsPreviousCell;
+            if (WS_DCC_DECODE_STATS && data.stats) {
+                data.stats->cells++;
+                data.stats->equalCells += sameAsPreviousCell;
+            }
 
             if (!sameAsPreviousCell) {
                 // Pixel buffer entries are encoded as a stack in the stream which means the
                 // last value decoded is actually the 1st value with a bit in the mask.
                 PixelCodesStack pixelCodesStack = {};
-                int nbPixelsDecoded = decodePixelCodesStack(data, pixelMask, pixelCodesStack);
+                int             nbPixelsDecoded =
+                    decodePixelCodesStack<HasRawPixelEncoding>(data, pixelMask, pixelCodesStack);
 
-                PixelBufferEntry previousEntryForCell;
+                // Gather the candidate values, see PixelMaskTable
+                uint8_t sourceValues[2 * PixelBufferEntry::nbValues] = {};
+                for (size_t i = 0; i < PixelBufferEntry::nbValues; i++)
+                {
+                    // Store the actual values instead of the codes
+                    sourceValues[i] = data.codeToPixelValue[pixelCodesStack[i]];
+                }
                 if (lastPixelEntryIndexForCell < pbEntries.size()) {
-                    previousEntryForCell = pbEntries[lastPixelEntryIndexForCell];
+                    const PixelBufferEntry& previousEntryForCell =
+                        pbEntries[lastPixelEntryIndexForCell];
+                    memcpy(sourceValues + PixelBufferEntry::nbValues, previousEntryForCell.values,
+                           PixelBufferEntry::nbValues);
                 }
                 else
                 {
@@ -449,28 +611,11 @@ void decodeFrameStage1(DirectionData& data, FrameData& frameData, Vector<size_t>
 
                 // Finalize the decoding of the pixel buffer entry
                 PixelBufferEntry newEntry;
-
-                int curIndex = nbPixelsDecoded - 1;
+                const uint8_t(&slotSource)[PixelBufferEntry::nbValues] =
+                    pixelMaskTable.slotSource[pixelMask][nbPixelsDecoded];
                 for (size_t i = 0; i < PixelBufferEntry::nbValues; i++)
                 {
-                    // Pop a value if bit set in the mask
-                    if (pixelMask & (1u << i)) {
-                        uint8_t pixelCode;
-                        if (curIndex >= 0) {
-                            pixelCode = pixelCodesStack[size_t(curIndex--)];
-                        }
-                        else
-                        {
-                            pixelCode = 0;
-                        }
-                        // Store the actual values instead of the codes
-                        newEntry.values[i] = data.codeToPixelValue[pixelCode];
-                    }
-                    // If not set, use the previous value for this entry
-                    else
-                    {
-                        newEntry.values[i] = previousEntryForCell.values[i];
-                    }
+                    newEntry.values[i] = sourceValues[slotSource[i]];
                 }
                 // Update the pixel buffer cell information
                 lastPixelEntryIndexForCell = pbEntries.size();
@@ -481,13 +626,89 @@ void decodeFrameStage1(DirectionData& data, FrameData& frameData, Vector<size_t>
     }
 }
 
-void decodeDirectionStage1(DirectionData& data, Vector<PixelBufferEntry>& pbEntries)
+using DecodeFrameStage1Func = void (*)(DirectionData&, FrameData&, Vector<size_t>&,
+                                       Vector<PixelBufferEntry>&);
+
+/// Returns the instance of decodeFrameStage1 matching the direction encoding options
+DecodeFrameStage1Func getDecodeFrameStage1(const DCC::DirectionHeader& dirHeader)
+{
+    static constexpr DecodeFrameStage1Func decodeFrameStage1Funcs[2][2] = {
+        {&decodeFrameStage1<false, false>, &decodeFrameStage1<false, true>},
+        {&decodeFrameStage1<true, false>, &decodeFrameStage1<true, true>}};
+    return decodeFrameStage1Funcs[dirHeader.compressEqualCells][dirHeader.hasRawPixelEncoding];
+}
+
+/** Calls func(frameCellIndex, pbCellIndex, pbCellPosX, pbCellPosY, frameCell) for each cell of
+ * the frame, in the same order as the decoding stages.
+ * @param nbPixelBufferCellsX The width of the pixel buffer, in cells
+ */
+template<class Func>
+void forEachFrameCell(size_t nbPixelBufferCellsX, const FrameData& frameData, Func&& func)
+{
+    size_t pbCellPosY = frameData.offsetY;
+    for (size_t cellY = 0; cellY < frameData.nbCellsY; cellY++)
+    {
+        size_t pbCellPosX = frameData.offsetX;
+        for (size_t cellX = 0; cellX < frameData.nbCellsX; cellX++)
+        {
+            Cell frameCell;
+            frameCell.width  = frameData.cellWidths[cellX];
+            frameCell.height = frameData.cellHeights[cellY];
+
+            const size_t pbCellIndex = (pbCellPosX / pbCellMaxPixelSize) +
+                                       (pbCellPosY / pbCellMaxPixelSize) * nbPixelBufferCellsX;
+            func(cellX + cellY * frameData.nbCellsX, pbCellIndex, pbCellPosX, pbCellPosY,
+                 frameCell);
+            pbCellPosX += frameCell.width;
+        }
+        pbCellPosY += frameData.cellHeights[cellY];
+    }
+}
+
+/// @overload
+template<class Func>
+void forEachFrameCell(const DirectionData& data, const FrameData& frameData, Func&& func)
+{
+    forEachFrameCell(data.nbPixelBufferCellsX, frameData, std::forward<Func>(func));
+}
+
+/// Save the stage 1 state (streams positions and previous entries) before decoding a frame
+void recordStage1Checkpoint(const DirectionData& data, const FrameData& frameData,
+                            const Vector<size_t>&                 pixelBuffer,
+                            const Vector<PixelBufferEntry>&       pbEntries,
+                            DCC::DirectionIndex::FrameCheckpoint& checkpoint,
+                            DCC::DirectionIndex&                  index)
+{
+    checkpoint.equalCellBitPos              = data.equalCellBitStream.tell();
+    checkpoint.pixelMaskBitPos              = data.pixelMaskBitStream.tell();
+    checkpoint.rawPixelUsageBitPos          = data.rawPixelUsageBitStream.tell();
+    checkpoint.rawPixelCodesBitPos          = data.rawPixelCodesBitStream.tell();
+    checkpoint.pixelCodesDisplacementBitPos = data.pixelCodesDisplacementBitStream.tell();
+    checkpoint.firstCellState               = index.cellStates.size();
+
+    forEachFrameCell(data, frameData, [&](size_t, size_t pbCellIndex, size_t, size_t, Cell) {
+        DCC::DirectionIndex::CellState cellState = {};
+        const size_t lastPixelEntryIndexForCell  = pixelBuffer[pbCellIndex];
+        cellState.hasPreviousEntry = lastPixelEntryIndexForCell < pbEntries.size();
+        if (cellState.hasPreviousEntry) {
+            memcpy(cellState.previousValues, pbEntries[lastPixelEntryIndexForCell].values,
+                   PixelBufferEntry::nbValues);
+        }
+        index.cellStates.push_back(cellState);
+    });
+}
+
+void decodeDirectionStage1(DirectionData& data, Vector<PixelBufferEntry>& pbEntries,
+                           Vector<size_t>& pixelBuffer, DCC::DirectionIndex* index)
 {
     // For each cell store a PixelBufferEntry index that points to the last entry for this cell
     // This will be used to retrieve values from the previous frame
     constexpr size_t    invalidIndex       = std::numeric_limits<size_t>::max();
     const size_t        pixelBufferNbCells = data.nbPixelBufferCellsX * data.nbPixelBufferCellsY;
-    Vector<size_t>      pixelBuffer(pixelBufferNbCells, invalidIndex);
+    pixelBuffer.assign(pixelBufferNbCells, invalidIndex);
+
+    // Select the decoding loop once for the whole direction
+    const DecodeFrameStage1Func decodeFrame = getDecodeFrameStage1(data.dirRef.header);
 
     // 1st phase of decoding : fill the pixel buffer
     // We actually fill a buffer of entries as to avoid storing empty entries
@@ -495,169 +716,1753 @@ void decodeDirectionStage1(DirectionData& data, Vector<PixelBufferEntry>& pbEntr
     {
         FrameData& frameData            = data.framesData[frameIndex];
         frameData.firstPixelBufferEntry = pbEntries.size();
-        decodeFrameStage1(data, frameData, pixelBuffer, pbEntries);
+        if (index) {
+            recordStage1Checkpoint(data, frameData, pixelBuffer, pbEntries,
+                                   index->frames[frameIndex], *index);
+        }
+        decodeFrame(data, frameData, pixelBuffer, pbEntries);
     }
 }
 
-void decodeDirectionStage2(DirectionData& data, const Vector<PixelBufferEntry>& pbEntries)
+/** Lookup table used to expand a byte of NbBits-wide pixel code indices to one index per byte.
+ * Indices are stored from the least significant bits, as this is how they are read from the
+ * bitstream.
+ */
+template<unsigned NbBits>
+struct PixelIndicesExpansionTable
 {
-    // This is the reason why we need to stages, we don't have the offset of this bitstream
-    BitStreamView& pixelCodeIndices = data.pixelCodesDisplacementBitStream;
+    static constexpr size_t indicesPerByte = CHAR_BIT / NbBits;
 
-    const size_t pbWidth            = size_t(data.dirRef.extents.width());
-    const size_t pbHeight           = size_t(data.dirRef.extents.height());
-    const size_t pbStride           = pbWidth;
-    const size_t nbPixelBufferCells = data.nbPixelBufferCellsX * data.nbPixelBufferCellsY;
+    uint8_t indices[256][indicesPerByte];
 
-    Vector<Cell>       pixelBufferCells(nbPixelBufferCells, Cell{0xF, 0xF});
-    Vector<uint8_t>    pixelBufferColors(pbStride * pbHeight);
-    ImageView<uint8_t> pBuffer{pixelBufferColors.data(), pbWidth, pbHeight, pbStride};
+    constexpr PixelIndicesExpansionTable() : indices()
+    {
+        for (unsigned byteValue = 0; byteValue < 256; byteValue++)
+        {
+            for (unsigned i = 0; i < indicesPerByte; i++)
+            {
+                const unsigned indexMask = (1u << NbBits) - 1u;
+                indices[byteValue][i]    = uint8_t((byteValue >> (i * NbBits)) & indexMask);
+            }
+        }
+    }
+};
 
-    // 2nd phase of decoding : Finish using the pixel buffer entries
-    for (size_t frameIndex = 0; frameIndex < data.nbFrames; ++frameIndex)
+template<unsigned NbBits>
+constexpr size_t PixelIndicesExpansionTable<NbBits>::indicesPerByte;
+
+template<unsigned NbBits>
+constexpr PixelIndicesExpansionTable<NbBits> pixelIndicesExpansionTable{};
+
+/// Number of pixels in a cell of the maximum size, which is the most common case
+constexpr size_t pbCellMaxPixelCount = pbCellMaxPixelSize * pbCellMaxPixelSize;
+
+/**Read the pixel code indices of a full (4x4) cell and expand them to 1 byte per pixel.
+ * @tparam NbBits The number of bits used to encode each index, 1 or 2.
+ */
+template<unsigned NbBits>
+void readFullCellIndices(BitStreamView& pixelCodeIndices,
+                         uint8_t (&cellIndices)[pbCellMaxPixelCount])
+{
+    using Table                   = PixelIndicesExpansionTable<NbBits>;
+    constexpr size_t bytesPerCell = pbCellMaxPixelCount / Table::indicesPerByte;
+    const Table&     table        = pixelIndicesExpansionTable<NbBits>;
+
+    // Read all the indices at once (16 or 32 bits), instead of once per pixel
+    const uint32_t packedIndices = pixelCodeIndices.readUnsigned(NbBits * pbCellMaxPixelCount);
+    for (size_t byteIndex = 0; byteIndex < bytesPerCell; byteIndex++)
+    {
+        const uint8_t byteValue = uint8_t(packedIndices >> (byteIndex * CHAR_BIT));
+        memcpy(cellIndices + byteIndex * Table::indicesPerByte, table.indices[byteValue],
+               Table::indicesPerByte);
+    }
+}
+
+/**Write a full (4x4) cell of the pixel buffer from per-pixel indices into the entry values.
+ * This is the equivalent of a palette lookup, done with a single shuffle when SIMD is available.
+ */
+void writeFullCell(uint8_t* dst, size_t stride,
+                   const uint8_t (&pixelValues)[PixelBufferEntry::nbValues],
+                   const uint8_t (&cellIndices)[pbCellMaxPixelCount])
+{
+#if defined(WS_SSSE3) || defined(WS_NEON)
+    uint32_t packedValues;
+    memcpy(&packedValues, pixelValues, sizeof(packedValues));
+    uint8_t cellPixels[pbCellMaxPixelCount];
+#if defined(WS_SSSE3)
+    const __m128i values  = _mm_cvtsi32_si128(int(packedValues));
+    const __m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(cellIndices));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(cellPixels), _mm_shuffle_epi8(values, indices));
+#else
+    const uint8x16_t values = vreinterpretq_u8_u32(vdupq_n_u32(packedValues));
+    vst1q_u8(cellPixels, vqtbl1q_u8(values, vld1q_u8(cellIndices)));
+#endif
+    for (size_t y = 0; y < pbCellMaxPixelSize; y++)
+    {
+        memcpy(dst + y * stride, cellPixels + y * pbCellMaxPixelSize, pbCellMaxPixelSize);
+    }
+#else
+    for (size_t y = 0; y < pbCellMaxPixelSize; y++)
+    {
+        for (size_t x = 0; x < pbCellMaxPixelSize; x++)
+        {
+            dst[x + y * stride] = pixelValues[cellIndices[x + y * pbCellMaxPixelSize]];
+        }
+    }
+#endif
+}
+
+/// Fill a full (4x4) cell of the pixel buffer with a single value
+void fillFullCell(uint8_t* dst, size_t stride, uint8_t pixelValue)
+{
+    const uint32_t rowValue = pixelValue * 0x01010101u;
+    for (size_t y = 0; y < pbCellMaxPixelSize; y++)
     {
-        const FrameData& frameData    = data.framesData[frameIndex];
-        size_t           pbEntryIndex = frameData.firstPixelBufferEntry;
+        memcpy(dst + y * stride, &rowValue, sizeof(rowValue));
+    }
+}
+
+/// Counts the cells by the number of bits used for the pixel indices, for DCC::DecodeStats
+void countCellKind(DCC::DecodeStats&   stats,
+                   const uint8_t (&pixelValues)[PixelBufferEntry::nbValues])
+{
+    if (pixelValues[0] == pixelValues[1])
+        stats.solidFillCells++;
+    else if (pixelValues[1] == pixelValues[2])
+        stats.oneBitCells++;
+    else
+        stats.twoBitCells++;
+}
+
+void decodeFrameStage2(DirectionData& data, const FrameData& frameData,
+                       const Vector<PixelBufferEntry>& pbEntries, Vector<Cell>& pixelBufferCells,
+                       ImageView<uint8_t> pBuffer)
+{
+    // This is the reason why we need to stages, we don't have the offset of this bitstream
+    BitStreamView& pixelCodeIndices = data.pixelCodesDisplacementBitStream;
+
+    const size_t pbStride     = pBuffer.stride;
+    size_t       pbEntryIndex = frameData.firstPixelBufferEntry;
 
-        size_t pbCellPosY = frameData.offsetY;
-        for (size_t cellY = 0; cellY < frameData.nbCellsY; cellY++)
+    size_t pbCellPosY = frameData.offsetY;
+    for (size_t cellY = 0; cellY < frameData.nbCellsY; cellY++)
+    {
+        size_t pbCellPosX = frameData.offsetX;
+        for (size_t cellX = 0; cellX < frameData.nbCellsX; cellX++)
         {
-            size_t pbCellPosX = frameData.offsetX;
-            for (size_t cellX = 0; cellX < frameData.nbCellsX; cellX++)
+            const size_t frameCellIndex = cellX + cellY * frameData.nbCellsX;
+            Cell         frameCell;
+            frameCell.width  = frameData.cellWidths[cellX];
+            frameCell.height = frameData.cellHeights[cellY];
+
+            const size_t pbCellIndex =
+                (pbCellPosX / pbCellMaxPixelSize) +
+                (pbCellPosY / pbCellMaxPixelSize) * data.nbPixelBufferCellsX;
+            Cell& pbCell = pixelBufferCells[pbCellIndex];
+
+            if (frameData.cellSameAsPrevious[frameCellIndex]) {
+                if ((frameCell.width != pbCell.width) || (frameCell.height != pbCell.height)) {
+                    // Clear the cell to 0
+                    // If we used the previous frame pixels instead of reusing the same
+                    // buffer for all frames we would not need to clear this (it would be
+                    // initialized to 0 before writing any value to the frame pixels) But we
+                    // would then need to copy values if the size matched
+                    pBuffer.fillBytes(pbCellPosX, pbCellPosY, frameCell.width, frameCell.height, 0);
+                }
+                else
+                {
+                    // Same size, copy from previous cell in the buffer
+                    // Nothing to change !
+                }
+            }
+            else
             {
-                const size_t frameCellIndex = cellX + cellY * frameData.nbCellsX;
-                Cell         frameCell;
-                frameCell.width  = frameData.cellWidths[cellX];
-                frameCell.height = frameData.cellHeights[cellY];
-
-                const size_t pbCellIndex =
-                    (pbCellPosX / pbCellMaxPixelSize) +
-                    (pbCellPosY / pbCellMaxPixelSize) * data.nbPixelBufferCellsX;
-                Cell& pbCell = pixelBufferCells[pbCellIndex];
-
-                if (frameData.cellSameAsPrevious[frameCellIndex]) {
-                    if ((frameCell.width != pbCell.width) || (frameCell.height != pbCell.height)) {
-                        // Clear the cell to 0
-                        // If we used the previous frame pixels instead of reusing the same
-                        // buffer for all frames we would not need to clear this (it would be
-                        // initialized to 0 before writing any value to the frame pixels) But we
-                        // would then need to copy values if the size matched
-                        pBuffer.fillBytes(pbCellPosX, pbCellPosY, frameCell.width, frameCell.height,
-                                          0);
+                const auto& pixelValues = pbEntries[pbEntryIndex++].values;
+                if (WS_DCC_DECODE_STATS && data.stats) countCellKind(*data.stats, pixelValues);
+                const bool  isFullCell  = frameCell.width == pbCellMaxPixelSize
+                                        && frameCell.height == pbCellMaxPixelSize;
+
+                if (isFullCell) {
+                    // Most cells are 4x4, use specialized kernels for those
+                    uint8_t* const cellPtr = &pBuffer(pbCellPosX, pbCellPosY);
+                    if (pixelValues[0] == pixelValues[1]) {
+                        fillFullCell(cellPtr, pbStride, pixelValues[0]);
                     }
                     else
                     {
-                        // Same size, copy from previous cell in the buffer
-                        // Nothing to change !
+                        uint8_t cellIndices[pbCellMaxPixelCount];
+                        if (pixelValues[1] == pixelValues[2])
+                            readFullCellIndices<1>(pixelCodeIndices, cellIndices);
+                        else
+                            readFullCellIndices<2>(pixelCodeIndices, cellIndices);
+                        writeFullCell(cellPtr, pbStride, pixelValues, cellIndices);
                     }
                 }
+                else if (pixelValues[0] == pixelValues[1])
+                {
+                    // This means we only got one pixel code, so fill the cell with it
+                    pBuffer.fillBytes(pbCellPosX, pbCellPosY, frameCell.width, frameCell.height,
+                                      pixelValues[0]);
+                }
                 else
                 {
-                    const auto& pixelValues = pbEntries[pbEntryIndex++].values;
-
-                    if (pixelValues[0] == pixelValues[1]) {
-                        // This means we only got one pixel code, so fill the cell with it
-                        pBuffer.fillBytes(pbCellPosX, pbCellPosY, frameCell.width, frameCell.height,
-                                          pixelValues[0]);
+                    int nbBitsToRead = 0;
+                    if (pixelValues[1] == pixelValues[2]) {
+                        // Stopped decoding after the 2nd value, only pixelValues[0] and
+                        // pixelValues[1] are different, so only 1bit needs to be read to choose
+                        // from those values
+                        nbBitsToRead = 1;
                     }
-                    else
+                    else // We need 2 bits to index 3-4 values
                     {
-                        int nbBitsToRead = 0;
-                        if (pixelValues[1] == pixelValues[2]) {
-                            // Stopped decoding after the 2nd value, only pixelValues[0] and
-                            // pixelValues[1] are different, so only 1bit needs to be read to choose
-                            // from those values
-                            nbBitsToRead = 1;
-                        }
-                        else // We need 2 bits to index 3-4 values
-                        {
-                            nbBitsToRead = 2;
-                        }
+                        nbBitsToRead = 2;
+                    }
 
-                        // fill FRAME cell with pixels
-                        for (size_t y = 0; y < frameCell.height; y++)
+                    // fill FRAME cell with pixels
+                    for (size_t y = 0; y < frameCell.height; y++)
+                    {
+                        for (size_t x = 0; x < frameCell.width; x++)
                         {
-                            for (size_t x = 0; x < frameCell.width; x++)
-                            {
-                                const uint8_t pixelCodeIndex =
-                                    pixelCodeIndices.readUnsigned8OrLess(nbBitsToRead);
-                                // Note: This actually means that a cell (4x4 block) can use at most
-                                // 4 colors, a bit like DXT !
-                                const uint8_t pixelValue = pixelValues[pixelCodeIndex];
-
-                                pBuffer(pbCellPosX + x, pbCellPosY + y) = pixelValue;
-                            }
+                            const uint8_t pixelCodeIndex =
+                                pixelCodeIndices.readUnsigned8OrLess(nbBitsToRead);
+                            // Note: This actually means that a cell (4x4 block) can use at most
+                            // 4 colors, a bit like DXT !
+                            const uint8_t pixelValue = pixelValues[pixelCodeIndex];
+
+                            pBuffer(pbCellPosX + x, pbCellPosY + y) = pixelValue;
                         }
                     }
                 }
-
-                pbCell = frameCell;
-                pbCellPosX += frameCell.width;
             }
-            pbCellPosY += frameData.cellHeights[cellY];
+
+            pbCell = frameCell;
+            pbCellPosX += frameCell.width;
         }
-        // Done decoding this frame, now copy its content.
-        const ImageView<uint8_t> frameImageView = frameData.imageView;
-        const ImageView<uint8_t> pbFrameView    = pBuffer.subView(
+        pbCellPosY += frameData.cellHeights[cellY];
+    }
+    // Done decoding this frame, now copy its content if an image was allocated.
+    const ImageView<uint8_t> frameImageView = frameData.imageView;
+    if (frameImageView.buffer) {
+        const ImageView<uint8_t> pbFrameView = pBuffer.subView(
             frameData.offsetX, frameData.offsetY, frameImageView.width, frameImageView.height);
         assert(frameImageView.isValid() && pbFrameView.isValid());
 
         pbFrameView.copyTo(frameImageView);
+    }
+}
 
-/// Set to 1 to export the frames to the grayscale PPM format
-#define DEBUG_EXPORT_PPM 0
-#if DEBUG_EXPORT_PPM
-/// Set to export all the frames at the size of the pixel buffer (not cleared outside of the frame)
-#define EXPORT_FULL_SIZE false
-        auto filename = fmt::format("test{}.ppm", frameIndex);
-        Utils::exportToPGM(filename.c_str(), EXPORT_FULL_SIZE ? pBuffer : frameImageView);
-#endif
+/// Receives the frames as soon as stage 2 decoded them, to store them in another representation
+class FrameBuilder
+{
+public:
+    virtual ~FrameBuilder() = default;
+
+    /// Called for each frame, in order, the frame content is in the pixel buffer
+    virtual void addFrame(const FrameData& frameData, ImageView<const uint8_t> pBuffer) = 0;
+    /// Called once all the frames of the direction were added
+    virtual void endDirection() {}
+};
+
+/// One builder per kind of DCC::DecodeOptions output, null if that output is not requested
+using FrameBuilders = std::array<std::unique_ptr<FrameBuilder>, 4>;
+
+/// Copies the pixels of a tiled frame into an image, indices can be 16 or 32 bits
+template<class BlockIndex>
+void copyTiledFrame(const DCC::TiledDirection::TiledFrame& frame, const uint8_t* blocksPixels,
+                    const BlockIndex* blockIndices, ImageView<uint8_t> dst)
+{
+    constexpr size_t blockSize   = DCC::TiledDirection::blockSize;
+    constexpr size_t blockPixels = DCC::TiledDirection::blockPixels;
+    assert(dst.isValid() && dst.width == frame.width && dst.height == frame.height);
+
+    const size_t firstBlockX = frame.offsetX / blockSize;
+    const size_t firstBlockY = frame.offsetY / blockSize;
+    for (size_t y = 0; y < frame.height; y++)
+    {
+        const size_t      dirY       = frame.offsetY + y;
+        const size_t      blockY     = dirY / blockSize - firstBlockY;
+        const BlockIndex* rowIndices = &blockIndices[frame.firstBlock + blockY * frame.nbBlocksX];
+        const size_t      yInBlock   = dirY % blockSize;
+        for (size_t x = 0; x < frame.width; x++)
+        {
+            const size_t   dirX  = frame.offsetX + x;
+            const uint8_t* block = &blocksPixels[rowIndices[dirX / blockSize - firstBlockX] *
+                                                 blockPixels];
+            dst(x, y) = block[dirX % blockSize + yInBlock * blockSize];
+        }
     }
 }
-} // anonymous namespace
-bool DCC::readDirection(Direction& outDir, uint32_t dirIndex, IImageProvider<uint8_t>& imgProvider)
+
+/// Builds a DCC::TiledDirection by deduplicating the blocks of the frames as they are decoded
+class TiledDirectionBuilder : public FrameBuilder
 {
-    if (dirIndex >= header.directions) return false;
+    static constexpr size_t blockSize   = DCC::TiledDirection::blockSize;
+    static constexpr size_t blockPixels = DCC::TiledDirection::blockPixels;
+    static_assert(blockSize == pbCellMaxPixelSize, "Blocks should match the pixel buffer cells");
 
-    const size_t    directionEncodedSize = getDirectionSize(dirIndex);
-    Vector<uint8_t> buffer(directionEncodedSize);
-    stream->seek(directionsOffsets[dirIndex], IStream::beg);
-    stream->read(buffer.data(), directionEncodedSize);
-    assert(stream->good());
-    BitStreamView bitStream(buffer.data(), directionEncodedSize * CHAR_BIT);
+    using Block = std::array<uint8_t, blockPixels>;
+    struct BlockHash
+    {
+        size_t operator()(const Block& block) const
+        {
+            uint64_t halves[2];
+            memcpy(halves, block.data(), sizeof(halves));
+            const uint64_t hash =
+                (halves[0] * 0x9E3779B97F4A7C15u) ^ (halves[1] + (halves[0] >> 29));
+            return size_t(hash ^ (hash >> 32));
+        }
+    };
 
-    DirectionHeader& dirHeader = outDir.header;
-    if (!readDirHeader(dirHeader, bitStream)) return false;
+    DCC::TiledDirection&                           tiles;
+    std::unordered_map<Block, uint32_t, BlockHash> blocksIndices;
+    /// Indices of the blocks of the frames, only narrowed once we know the number of blocks
+    Vector<uint32_t> wideBlockIndices;
+    size_t           framesPixelsSize = 0;
 
-    if (!readFrameHeaders(header.framesPerDir, outDir, bitStream)) return false;
+    uint32_t getBlockIndex(const Block& block)
+    {
+        const auto insertion = blocksIndices.emplace(block, uint32_t(tiles.nbBlocks()));
+        if (insertion.second) {
+            tiles.blocksPixels.insert(tiles.blocksPixels.end(), block.begin(), block.end());
+        }
+        return insertion.first->second;
+    }
 
-    outDir.computeDirExtents();
+public:
+    TiledDirectionBuilder(DCC::TiledDirection& outTiles, size_t nbFrames) : tiles(outTiles)
+    {
+        tiles = DCC::TiledDirection{};
+        tiles.frames.reserve(nbFrames);
+        getBlockIndex(Block{}); // Block 0 is the transparent one
+    }
 
-    DirectionData data{outDir, bitStream, header.framesPerDir, imgProvider};
-    if (!data.isValid()) return false;
+    /// Splits the frame into blocks, the frame content must be in the pixel buffer
+    void addFrame(const FrameData& frameData, ImageView<const uint8_t> pBuffer) override
+    {
+        const size_t frameEndX   = size_t(frameData.offsetX + frameData.width);
+        const size_t frameEndY   = size_t(frameData.offsetY + frameData.height);
+        const size_t firstBlockX = frameData.offsetX / blockSize;
+        const size_t firstBlockY = frameData.offsetY / blockSize;
+
+        DCC::TiledDirection::TiledFrame frame;
+        frame.offsetX    = frameData.offsetX;
+        frame.offsetY    = frameData.offsetY;
+        frame.width      = frameData.width;
+        frame.height     = frameData.height;
+        frame.nbBlocksX  = uint16_t((frameEndX - 1) / blockSize + 1 - firstBlockX);
+        frame.nbBlocksY  = uint16_t((frameEndY - 1) / blockSize + 1 - firstBlockY);
+        frame.firstBlock = uint32_t(wideBlockIndices.size());
+
+        for (size_t blockY = firstBlockY; blockY < firstBlockY + frame.nbBlocksY; blockY++)
+        {
+            // Only keep the pixels of the frame, the pixel buffer may contain other frames
+            const size_t yBegin = std::max(blockY * blockSize, size_t(frameData.offsetY));
+            const size_t yEnd   = std::min((blockY + 1) * blockSize, frameEndY);
+            for (size_t blockX = firstBlockX; blockX < firstBlockX + frame.nbBlocksX; blockX++)
+            {
+                const size_t xBegin = std::max(blockX * blockSize, size_t(frameData.offsetX));
+                const size_t xEnd   = std::min((blockX + 1) * blockSize, frameEndX);
 
-    Vector<PixelBufferEntry> pbEntries;
+                Block block = {};
+                for (size_t y = yBegin; y < yEnd; y++)
+                {
+                    memcpy(&block[(xBegin % blockSize) + (y % blockSize) * blockSize],
+                           &pBuffer(xBegin, y), xEnd - xBegin);
+                }
+                wideBlockIndices.push_back(getBlockIndex(block));
+            }
+        }
+        tiles.frames.push_back(frame);
+        framesPixelsSize += size_t(frame.width) * frame.height;
+    }
+
+    /// Keeps the blocks only if they use less memory than the frames
+    void endDirection() override
     {
-        size_t estimatedNbEntries =
-            (header.framesPerDir * data.nbPixelBufferCellsX * data.nbPixelBufferCellsY) / 4;
-        pbEntries.reserve(estimatedNbEntries);
+        const size_t tiledSize =
+            tiles.blocksPixels.size() + wideBlockIndices.size() * sizeof(uint16_t);
+        if (tiles.nbBlocks() <= DCC::TiledDirection::maxBlocks && tiledSize < framesPixelsSize) {
+            tiles.blockIndices.reserve(wideBlockIndices.size());
+            for (uint32_t blockIndex : wideBlockIndices)
+            {
+                tiles.blockIndices.push_back(uint16_t(blockIndex));
+            }
+            return;
+        }
+        tiles.framesPixels.reserve(framesPixelsSize);
+        for (DCC::TiledDirection::TiledFrame& frame : tiles.frames)
+        {
+            const size_t firstPixel = tiles.framesPixels.size();
+            tiles.framesPixels.resize(firstPixel + size_t(frame.width) * frame.height);
+            copyTiledFrame(frame, tiles.blocksPixels.data(), wideBlockIndices.data(),
+                           {tiles.framesPixels.data() + firstPixel, frame.width, frame.height,
+                            frame.width});
+            frame.firstBlock = uint32_t(firstPixel);
+        }
+        tiles.blocksPixels = Vector<uint8_t>{};
     }
+};
 
-    decodeDirectionStage1(data, pbEntries);
+/// Builds DCC::DirtyRegions by comparing the cells of each frame with the previous frame ones
+class DirtyRegionsBuilder : public FrameBuilder
+{
+    using Rect = DCC::DirtyRegions::Rect;
+
+    /// Last frame that decoded a pixel buffer cell, and where
+    struct CellState
+    {
+        size_t lastFrame;
+        Rect   rect;
+    };
+
+    DCC::DirtyRegions& regions;
+    Vector<CellState>  pbCellsStates;
+    Vector<Rect>       previousFrameCells;
+    Vector<Rect>       frameCells;
+    size_t             nbPixelBufferCellsX;
+    size_t             frameIndex = 0;
+
+    static bool sameRect(const Rect& lhs, const Rect& rhs)
+    {
+        return lhs.x == rhs.x && lhs.y == rhs.y && lhs.width == rhs.width
+               && lhs.height == rhs.height;
+    }
 
-    decodeDirectionStage2(data, pbEntries);
+    /// Adds a rectangle to the current frame, merged with the previous one if they are adjacent
+    void addRect(const Rect& rect)
+    {
+        if (regions.rects.size() > regions.firstRect.back()) {
+            Rect& lastRect = regions.rects.back();
+            if (lastRect.y == rect.y && lastRect.height == rect.height
+                && lastRect.x + lastRect.width == rect.x) {
+                lastRect.width = uint16_t(lastRect.width + rect.width);
+                return;
+            }
+        }
+        regions.rects.push_back(rect);
+    }
 
-    // Make sure we fully read the streams
-    assert(data.equalCellBitStream.tell() == data.equalCellBitStream.sizeInBits());
-    assert(data.pixelMaskBitStream.tell() == data.pixelMaskBitStream.sizeInBits());
-    assert(data.rawPixelUsageBitStream.tell() == data.rawPixelUsageBitStream.sizeInBits());
-    assert(data.rawPixelCodesBitStream.tell() == data.rawPixelCodesBitStream.sizeInBits());
-    // This exact stream size is not known, so check if we at least are in the last byte
-    assert(data.pixelCodesDisplacementBitStream.bitPositionInBuffer() + 7_z >=
-           data.pixelCodesDisplacementBitStream.bufferSizeInBits());
+public:
+    DirtyRegionsBuilder(DCC::DirtyRegions& outRegions, const DirectionData& data)
+        : regions(outRegions), nbPixelBufferCellsX(data.nbPixelBufferCellsX)
+    {
+        const size_t nbPixelBufferCells = data.nbPixelBufferCellsX * data.nbPixelBufferCellsY;
+        constexpr size_t noFrame = std::numeric_limits<size_t>::max();
+        pbCellsStates.assign(nbPixelBufferCells, CellState{noFrame, Rect{}});
+        regions.rects.clear();
+        regions.firstRect.assign(1, 0);
+        regions.firstRect.reserve(data.nbFrames + 1);
+
+        const Rect directionRect{0, 0, uint16_t(data.dirRef.extents.width()),
+                                 uint16_t(data.dirRef.extents.height())};
+        regions.rects.push_back(directionRect); // Nothing to compare the first frame with
+    }
 
-    return bitStream.good();
-}
+    /// Compares the cells of the frame with the ones of the previous frame
+    void addFrame(const FrameData& frameData, ImageView<const uint8_t>) override
+    {
+        frameCells.clear();
+        forEachFrameCell(nbPixelBufferCellsX, frameData, [&](size_t frameCellIndex,
+                                                             size_t pbCellIndex, size_t pbCellPosX,
+                                                             size_t pbCellPosY, Cell frameCell) {
+            const Rect rect{uint16_t(pbCellPosX), uint16_t(pbCellPosY), uint16_t(frameCell.width),
+                            uint16_t(frameCell.height)};
+            CellState& cellState = pbCellsStates[pbCellIndex];
+            // Equal cells keep the pixels of the last frame that decoded the cell, which are only
+            // already there if this was the previous frame, at the same place.
+            const bool unchanged = frameIndex != 0 && frameData.cellSameAsPrevious[frameCellIndex]
+                                   && cellState.lastFrame + 1 == frameIndex
+                                   && sameRect(cellState.rect, rect);
+            if (frameIndex != 0 && !unchanged) addRect(rect);
+            cellState = {frameIndex, rect};
+            frameCells.push_back(rect);
+        });
+
+        // The pixels of the previous frame outside of this one must become transparent
+        const size_t frameEndX = size_t(frameData.offsetX + frameData.width);
+        const size_t frameEndY = size_t(frameData.offsetY + frameData.height);
+        for (const Rect& rect : previousFrameCells)
+        {
+            const bool insideFrame = rect.x >= frameData.offsetX && rect.y >= frameData.offsetY
+                                     && size_t(rect.x + rect.width) <= frameEndX
+                                     && size_t(rect.y + rect.height) <= frameEndY;
+            if (!insideFrame) addRect(rect);
+        }
+        std::swap(previousFrameCells, frameCells);
+        regions.firstRect.push_back(regions.rects.size());
+        frameIndex++;
+    }
+};
 
-} // namespace WorldStone
+/// Builds a DCC::PackedDirection, packing the pixels of each frame as indices into a palette
+class PackedDirectionBuilder : public FrameBuilder
+{
+    DCC::PackedDirection& packed;
+    size_t                pixelsPerByte;
+    uint8_t               valueToIndex[256];
 
+public:
+    PackedDirectionBuilder(DCC::PackedDirection& outPacked, const DirectionData& data)
+        : packed(outPacked)
+    {
+        // Pixels of cleared cells are 0 even if the direction does not list it in its values
+        const bool   usesTransparent = data.nbPixelValues > 0 && data.codeToPixelValue[0] == 0;
+        const size_t nbValues        = data.nbPixelValues + (usesTransparent ? 0 : 1);
+
+        packed.bitsPerPixel = nbValues <= 4 ? 2u : nbValues <= 16 ? 4u : 8u;
+        packed.palette.assign(size_t(1) << packed.bitsPerPixel, 0);
+        packed.pixels.clear();
+        packed.frames.clear();
+        packed.frames.reserve(data.nbFrames);
+        pixelsPerByte = CHAR_BIT / packed.bitsPerPixel;
+
+        memset(valueToIndex, 0, sizeof(valueToIndex));
+        if (packed.bitsPerPixel == CHAR_BIT) {
+            for (size_t value = 0; value < 256; value++)
+            {
+                packed.palette[value] = uint8_t(value);
+                valueToIndex[value]   = uint8_t(value);
+            }
+        }
+        else
+        {
+            // Values are sorted, so 0 is the first one if used
+            size_t index = usesTransparent ? 0 : 1;
+            for (size_t code = 0; code < data.nbPixelValues; code++, index++)
+            {
+                const uint8_t value   = data.codeToPixelValue[code];
+                packed.palette[index] = value;
+                valueToIndex[value]   = uint8_t(index);
+            }
+        }
+    }
+
+    /// Packs the pixels of the frame, the frame content must be in the pixel buffer
+    void addFrame(const FrameData& frameData, ImageView<const uint8_t> pBuffer) override
+    {
+        DCC::PackedDirection::PackedFrame frame;
+        frame.width     = frameData.width;
+        frame.height    = frameData.height;
+        frame.stride    = (frame.width + pixelsPerByte - 1) / pixelsPerByte;
+        frame.firstByte = packed.pixels.size();
+        packed.pixels.resize(frame.firstByte + frame.stride * frame.height, 0);
+
+        const unsigned bitsPerPixel = packed.bitsPerPixel;
+        for (size_t y = 0; y < frame.height; y++)
+        {
+            const uint8_t* row       = &pBuffer(frameData.offsetX, frameData.offsetY + y);
+            uint8_t*       packedRow = &packed.pixels[frame.firstByte + y * frame.stride];
+            for (size_t x = 0; x < frame.width; x++)
+            {
+                const unsigned shift = unsigned(x % pixelsPerByte) * bitsPerPixel;
+                packedRow[x / pixelsPerByte] |= uint8_t(valueToIndex[row[x]] << shift);
+            }
+        }
+        packed.frames.push_back(frame);
+    }
+};
+
+/// Converts the frames to colors as they are decoded, without an intermediate 8bpp image
+class ColorFramesBuilder : public FrameBuilder
+{
+    const ColorLookupTable&           colors;
+    Vector<ImageView<Palette::Color>> images;
+    size_t                            nbFramesAdded = 0;
+
+public:
+    /// Allocates the images of all frames first, so that they are in the order of the file
+    ColorFramesBuilder(IImageProvider<Palette::Color>& imgProvider,
+                       const ColorLookupTable& colorTable, const DirectionData& data)
+        : colors(colorTable)
+    {
+        images.reserve(data.nbFrames);
+        for (size_t frameIndex = 0; frameIndex < data.nbFrames; frameIndex++)
+        {
+            const FrameData& frameData = data.framesData[frameIndex];
+            images.push_back(imgProvider.getNewImage(frameData.width, frameData.height));
+        }
+    }
+
+    bool isValid() const
+    {
+        return std::all_of(images.begin(), images.end(),
+                           [](const ImageView<Palette::Color>& image) { return image.isValid(); });
+    }
+
+    void addFrame(const FrameData& frameData, ImageView<const uint8_t> pBuffer) override
+    {
+        const ImageView<Palette::Color> image = images[nbFramesAdded++];
+        for (size_t y = 0; y < image.height; y++)
+        {
+            colors.convert(&pBuffer(frameData.offsetX, frameData.offsetY + y), &image(0, y),
+                           image.width);
+        }
+    }
+};
+
+/**Unpacks a frame of NbBits-wide indices and looks up their values in the palette.
+ * Indices are expanded with the same tables as the pixel code indices, then 16 pixels are looked
+ * up at once with a shuffle when SIMD is available, like in writeFullCell.
+ * @tparam NbBits 2 or 4, so that the palette fits in a 16 bytes register
+ */
+template<unsigned NbBits>
+void unpackFrameIndices(const DCC::PackedDirection&              packed,
+                        const DCC::PackedDirection::PackedFrame& frame, ImageView<uint8_t> dst)
+{
+    using Table                    = PixelIndicesExpansionTable<NbBits>;
+    constexpr size_t pixelsPerByte = Table::indicesPerByte;
+    constexpr unsigned indexMask   = (1u << NbBits) - 1u;
+
+    uint8_t palette[16] = {};
+    assert(packed.palette.size() <= sizeof(palette));
+    memcpy(palette, packed.palette.data(), packed.palette.size());
+#if defined(WS_SSSE3)
+    const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(palette));
+#elif defined(WS_NEON)
+    const uint8x16_t values = vld1q_u8(palette);
+#endif
+
+    for (size_t y = 0; y < frame.height; y++)
+    {
+        const uint8_t* packedRow = packed.pixels.data() + frame.firstByte + y * frame.stride;
+        uint8_t*       dstRow    = &dst(0, y);
+        size_t         x         = 0;
+#if defined(WS_SSSE3) || defined(WS_NEON)
+        constexpr size_t pixelsPerStep = 16;
+        const Table&     table         = pixelIndicesExpansionTable<NbBits>;
+        for (; x + pixelsPerStep <= frame.width; x += pixelsPerStep)
+        {
+            uint8_t indices[pixelsPerStep];
+            for (size_t i = 0; i < pixelsPerStep / pixelsPerByte; i++)
+            {
+                memcpy(indices + i * pixelsPerByte, table.indices[packedRow[x / pixelsPerByte + i]],
+                       pixelsPerByte);
+            }
+#if defined(WS_SSSE3)
+            const __m128i indicesVec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dstRow + x),
+                             _mm_shuffle_epi8(values, indicesVec));
+#else
+            vst1q_u8(dstRow + x, vqtbl1q_u8(values, vld1q_u8(indices)));
+#endif
+        }
+#endif
+        for (; x < frame.width; x++)
+        {
+            const unsigned shift = unsigned(x % pixelsPerByte) * NbBits;
+            dstRow[x]            = palette[(packedRow[x / pixelsPerByte] >> shift) & indexMask];
+        }
+    }
+}
+
+/// Number of bits of the color indices of a kept cell, see DCC::DirectionIndex::keptCells
+unsigned keptCellIndexBits(size_t nbColors) { return nbColors <= 1 ? 0u : nbColors == 2 ? 1u : 2u; }
+
+/// Appends the pixels of a cell to DCC::DirectionIndex::keptCells
+void appendKeptCell(Vector<uint8_t>& keptCells, ImageView<const uint8_t> cellPixels)
+{
+    uint8_t colors[PixelBufferEntry::nbValues];
+    size_t  nbColors = 0;
+    for (size_t y = 0; y < cellPixels.height; y++)
+    {
+        for (size_t x = 0; x < cellPixels.width; x++)
+        {
+            const uint8_t pixel = cellPixels(x, y);
+            if (std::find(colors, colors + nbColors, pixel) != colors + nbColors) continue;
+            if (nbColors == PixelBufferEntry::nbValues) {
+                keptCells.push_back(0);
+                for (size_t row = 0; row < cellPixels.height; row++)
+                    keptCells.insert(keptCells.end(), &cellPixels(0, row),
+                                     &cellPixels(0, row) + cellPixels.width);
+                return;
+            }
+            colors[nbColors++] = pixel;
+        }
+    }
+    keptCells.push_back(uint8_t(nbColors));
+    keptCells.insert(keptCells.end(), colors, colors + nbColors);
+
+    const unsigned indexBits  = keptCellIndexBits(nbColors);
+    uint64_t       indices    = 0;
+    unsigned       indicesPos = 0;
+    for (size_t y = 0; y < cellPixels.height && indexBits; y++)
+    {
+        for (size_t x = 0; x < cellPixels.width; x++)
+        {
+            const uint64_t colorIndex = uint64_t(std::find(colors, colors + nbColors,
+                                                           cellPixels(x, y)) - colors);
+            indices |= colorIndex << indicesPos;
+            indicesPos += indexBits;
+        }
+    }
+    for (unsigned bytePos = 0; bytePos < indicesPos; bytePos += CHAR_BIT)
+        keptCells.push_back(uint8_t(indices >> bytePos));
+}
+
+/// Writes a cell stored by appendKeptCell, returns the position of the next cell
+const uint8_t* restoreKeptCell(const uint8_t* keptCell, ImageView<uint8_t> cellPixels)
+{
+    const size_t nbColors = *keptCell++;
+    if (nbColors == 0) {
+        for (size_t y = 0; y < cellPixels.height; y++)
+        {
+            memcpy(&cellPixels(0, y), keptCell, cellPixels.width);
+            keptCell += cellPixels.width;
+        }
+        return keptCell;
+    }
+    const uint8_t* colors    = keptCell;
+    const unsigned indexBits = keptCellIndexBits(nbColors);
+    keptCell += nbColors;
+
+    const unsigned nbIndicesBits = unsigned(cellPixels.width * cellPixels.height) * indexBits;
+    uint64_t       indices       = 0;
+    for (unsigned bytePos = 0; bytePos < nbIndicesBits; bytePos += CHAR_BIT)
+        indices |= uint64_t(*keptCell++) << bytePos;
+    const uint64_t indexMask = (1u << indexBits) - 1u;
+    for (size_t y = 0; y < cellPixels.height; y++)
+    {
+        for (size_t x = 0; x < cellPixels.width; x++)
+        {
+            cellPixels(x, y) = colors[indices & indexMask];
+            indices >>= indexBits;
+        }
+    }
+    return keptCell;
+}
+
+/** Save the stage 2 state before decoding a frame.
+ * Only the pixels of the cells that will be kept as is are needed, since all the others are
+ * overwritten by the frame.
+ */
+void recordStage2Checkpoint(const DirectionData& data, const FrameData& frameData,
+                            const Vector<Cell>& pixelBufferCells, ImageView<const uint8_t> pBuffer,
+                            DCC::DirectionIndex::FrameCheckpoint& checkpoint,
+                            DCC::DirectionIndex&                  index)
+{
+    checkpoint.pixelCodeIndicesBitPos = data.pixelCodesDisplacementBitStream.tell();
+    checkpoint.firstKeptCell          = index.keptCells.size();
+
+    forEachFrameCell(data, frameData, [&](size_t frameCellIndex, size_t pbCellIndex,
+                                          size_t pbCellPosX, size_t pbCellPosY, Cell frameCell) {
+        DCC::DirectionIndex::CellState& cellState =
+            index.cellStates[checkpoint.firstCellState + frameCellIndex];
+        const Cell& pbCell        = pixelBufferCells[pbCellIndex];
+        cellState.previousWidth  = uint8_t(pbCell.width);
+        cellState.previousHeight = uint8_t(pbCell.height);
+
+        if (frameData.cellSameAsPrevious[frameCellIndex] && frameCell.width == pbCell.width &&
+            frameCell.height == pbCell.height) {
+            appendKeptCell(index.keptCells, pBuffer.subView(pbCellPosX, pbCellPosY,
+                                                            frameCell.width, frameCell.height));
+        }
+    });
+}
+
+void decodeDirectionStage2(DirectionData& data, const Vector<PixelBufferEntry>& pbEntries,
+                           Vector<Cell>& pixelBufferCells, Vector<uint8_t>& pixelBufferColors,
+                           DCC::DirectionIndex* index, const FrameBuilders& frameBuilders,
+                           const DCC::FrameDecodedCallback* onFrameDecoded)
+{
+    const size_t pbWidth            = size_t(data.dirRef.extents.width());
+    const size_t pbHeight           = size_t(data.dirRef.extents.height());
+    const size_t pbStride           = pbWidth;
+    const size_t nbPixelBufferCells = data.nbPixelBufferCellsX * data.nbPixelBufferCellsY;
+
+    pixelBufferCells.assign(nbPixelBufferCells, Cell{0xF, 0xF});
+    pixelBufferColors.assign(pbStride * pbHeight, 0);
+    ImageView<uint8_t> pBuffer{pixelBufferColors.data(), pbWidth, pbHeight, pbStride};
+
+    // 2nd phase of decoding : Finish using the pixel buffer entries
+    for (size_t frameIndex = 0; frameIndex < data.nbFrames; ++frameIndex)
+    {
+        const FrameData& frameData = data.framesData[frameIndex];
+        if (index) {
+            recordStage2Checkpoint(data, frameData, pixelBufferCells, pBuffer,
+                                   index->frames[frameIndex], *index);
+        }
+        decodeFrameStage2(data, frameData, pbEntries, pixelBufferCells, pBuffer);
+        for (const std::unique_ptr<FrameBuilder>& frameBuilder : frameBuilders)
+        {
+            if (frameBuilder) frameBuilder->addFrame(frameData, pBuffer);
+        }
+        if (onFrameDecoded) (*onFrameDecoded)(uint32_t(frameIndex), frameData.imageView);
+
+/// Set to 1 to export the frames to the grayscale PPM format
+#define DEBUG_EXPORT_PPM 0
+#if DEBUG_EXPORT_PPM
+/// Set to export all the frames at the size of the pixel buffer (not cleared outside of the frame)
+#define EXPORT_FULL_SIZE false
+        auto filename = fmt::format("test{}.ppm", frameIndex);
+        Utils::exportToPGM(filename.c_str(), EXPORT_FULL_SIZE ? pBuffer : frameData.imageView);
+#endif
+    }
+    for (const std::unique_ptr<FrameBuilder>& frameBuilder : frameBuilders)
+    {
+        if (frameBuilder) frameBuilder->endDirection();
+    }
+}
+
+} // anonymous namespace
+
+struct DCCDecodeWorkspace::Buffers
+{
+    Vector<uint8_t>          encodedDirection;
+    Vector<uint8_t>          codeToPixelValue;
+    Vector<FrameData>        framesData;
+    Vector<PixelBufferEntry> pbEntries;
+    Vector<size_t>           pixelBuffer; ///< Index of the last pixel buffer entry of each cell
+    Vector<Cell>             pixelBufferCells;
+    Vector<uint8_t>          pixelBufferColors;
+};
+
+DCCDecodeWorkspace::DCCDecodeWorkspace() : buffers(std::make_unique<Buffers>()) {}
+DCCDecodeWorkspace::~DCCDecodeWorkspace() = default;
+DCCDecodeWorkspace::DCCDecodeWorkspace(DCCDecodeWorkspace&&) noexcept = default;
+DCCDecodeWorkspace& DCCDecodeWorkspace::operator=(DCCDecodeWorkspace&&) noexcept = default;
+
+/// Decodes a single frame from the state saved in its checkpoint
+static void decodeFrameFromCheckpoint(DirectionData& data, FrameData& frameData,
+                                      const DCC::DirectionIndex&                  index,
+                                      const DCC::DirectionIndex::FrameCheckpoint& checkpoint,
+                                      DCCDecodeWorkspace::Buffers&                buffers)
+{
+    data.equalCellBitStream.setPosition(checkpoint.equalCellBitPos);
+    data.pixelMaskBitStream.setPosition(checkpoint.pixelMaskBitPos);
+    data.rawPixelUsageBitStream.setPosition(checkpoint.rawPixelUsageBitPos);
+    data.rawPixelCodesBitStream.setPosition(checkpoint.rawPixelCodesBitPos);
+    data.pixelCodesDisplacementBitStream.setPosition(checkpoint.pixelCodesDisplacementBitPos);
+
+    const DCC::DirectionIndex::CellState* cellStates = &index.cellStates[checkpoint.firstCellState];
+
+    // Only the previous entries of the frame cells are needed to run stage 1
+    constexpr size_t invalidIndex       = std::numeric_limits<size_t>::max();
+    const size_t     pixelBufferNbCells = data.nbPixelBufferCellsX * data.nbPixelBufferCellsY;
+    Vector<size_t>&  pixelBuffer        = buffers.pixelBuffer;
+    Vector<PixelBufferEntry>& pbEntries = buffers.pbEntries;
+    pixelBuffer.assign(pixelBufferNbCells, invalidIndex);
+    pbEntries.clear();
+    forEachFrameCell(data, frameData, [&](size_t frameCellIndex, size_t pbCellIndex, size_t,
+                                          size_t, Cell) {
+        const DCC::DirectionIndex::CellState& cellState = cellStates[frameCellIndex];
+        if (cellState.hasPreviousEntry) {
+            PixelBufferEntry previousEntry;
+            memcpy(previousEntry.values, cellState.previousValues, PixelBufferEntry::nbValues);
+            pixelBuffer[pbCellIndex] = pbEntries.size();
+            pbEntries.push_back(previousEntry);
+        }
+    });
+    frameData.firstPixelBufferEntry = pbEntries.size();
+    getDecodeFrameStage1(data.dirRef.header)(data, frameData, pixelBuffer, pbEntries);
+
+    // Then restore the cells sizes and the pixels kept from the previous frames for stage 2
+    data.pixelCodesDisplacementBitStream.setPosition(checkpoint.pixelCodeIndicesBitPos);
+
+    const size_t pbWidth  = size_t(data.dirRef.extents.width());
+    const size_t pbHeight = size_t(data.dirRef.extents.height());
+    buffers.pixelBufferCells.assign(pixelBufferNbCells, Cell{0xF, 0xF});
+    buffers.pixelBufferColors.assign(pbWidth * pbHeight, 0);
+    ImageView<uint8_t> pBuffer{buffers.pixelBufferColors.data(), pbWidth, pbHeight, pbWidth};
+
+    const uint8_t* keptCell = index.keptCells.data() + checkpoint.firstKeptCell;
+    forEachFrameCell(data, frameData, [&](size_t frameCellIndex, size_t pbCellIndex,
+                                          size_t pbCellPosX, size_t pbCellPosY, Cell frameCell) {
+        const DCC::DirectionIndex::CellState& cellState = cellStates[frameCellIndex];
+        Cell& pbCell  = buffers.pixelBufferCells[pbCellIndex];
+        pbCell.width  = cellState.previousWidth;
+        pbCell.height = cellState.previousHeight;
+        if (frameData.cellSameAsPrevious[frameCellIndex] && frameCell.width == pbCell.width &&
+            frameCell.height == pbCell.height) {
+            keptCell = restoreKeptCell(
+                keptCell, pBuffer.subView(pbCellPosX, pbCellPosY, frameCell.width, frameCell.height));
+        }
+    });
+    decodeFrameStage2(data, frameData, pbEntries, buffers.pixelBufferCells, pBuffer);
+}
+
+bool DCC::readDirectionBuffer(Vector<uint8_t>& buffer, uint32_t dirIndex)
+{
+    const size_t directionEncodedSize = getDirectionSize(dirIndex);
+    buffer.resize(directionEncodedSize);
+    stream->seek(directionsOffsets[dirIndex], IStream::beg);
+    stream->read(buffer.data(), directionEncodedSize);
+    return stream->good();
+}
+
+/// Measures the duration of the decoding steps for DCC::DecodeStats, compiled out if disabled
+class DecodeStatsTimer
+{
+    using Clock = std::chrono::steady_clock;
+
+    DCC::DecodeStats* stats;
+    Clock::time_point stepStart;
+
+public:
+    explicit DecodeStatsTimer(DCC::DecodeStats* decodeStats) : stats(decodeStats)
+    {
+        if (WS_DCC_DECODE_STATS && stats) stepStart = Clock::now();
+    }
+
+    /// Adds the time elapsed since the previous step to the given member of the stats
+    void endStep(double DCC::DecodeStats::*stepTime)
+    {
+        if (!WS_DCC_DECODE_STATS || !stats) return;
+        const Clock::time_point now = Clock::now();
+        stats->*stepTime += std::chrono::duration<double, std::micro>(now - stepStart).count();
+        stepStart = now;
+    }
+};
+
+/** Decodes all the frames of a direction.
+ * @param index   If not null, will hold the frames checkpoints.
+ * @param options The outputs to fill, options.workspace is ignored in favor of buffers.
+ */
+static bool decodeDirection(DCC::Direction& outDir, BitStreamView& bitStream, uint32_t nbFrames,
+                            DCCDecodeWorkspace::Buffers& buffers, DCC::DirectionIndex* index,
+                            const DCC::DecodeOptions& options)
+{
+    IImageProvider<uint8_t>* imgProvider = options.images;
+    DCC::DecodeStats*        stats       = WS_DCC_DECODE_STATS ? options.stats : nullptr;
+    DecodeStatsTimer         timer(stats);
+
+    DCC::DirectionHeader& dirHeader = outDir.header;
+    if (!readDirHeader(dirHeader, bitStream)) return false;
+
+    if (!readFrameHeaders(nbFrames, outDir, bitStream)) return false;
+    if (!skipFramesOptionalData(outDir, bitStream)) return false;
+
+    outDir.computeDirExtents();
+
+    if (index) {
+        index->streamsBitPos = bitStream.tell();
+        index->frames.resize(nbFrames);
+    }
+
+    DirectionData data{outDir, bitStream, nbFrames, buffers.codeToPixelValue, buffers.framesData};
+    data.stats = stats;
+    timer.endStep(&DCC::DecodeStats::headersTime);
+
+    data.allocateFrames(imgProvider);
+    if (imgProvider && !data.isValid()) return false;
+    timer.endStep(&DCC::DecodeStats::framesAllocationTime);
+
+    Vector<PixelBufferEntry>& pbEntries = buffers.pbEntries;
+    pbEntries.clear();
+    {
+        size_t estimatedNbEntries =
+            (nbFrames * data.nbPixelBufferCellsX * data.nbPixelBufferCellsY) / 4;
+        pbEntries.reserve(estimatedNbEntries);
+    }
+
+    decodeDirectionStage1(data, pbEntries, buffers.pixelBuffer, index);
+    timer.endStep(&DCC::DecodeStats::stage1Time);
+    if (stats) {
+        stats->equalCellBits              = data.equalCellBitStream.tell();
+        stats->pixelMaskBits              = data.pixelMaskBitStream.tell();
+        stats->rawPixelUsageBits          = data.rawPixelUsageBitStream.tell();
+        stats->rawPixelCodesBits          = data.rawPixelCodesBitStream.tell();
+        stats->pixelCodesDisplacementBits = data.pixelCodesDisplacementBitStream.tell();
+    }
+
+    FrameBuilders frameBuilders;
+    if (options.tiles)
+        frameBuilders[0] = std::make_unique<TiledDirectionBuilder>(*options.tiles, nbFrames);
+    if (options.dirtyRegions)
+        frameBuilders[1] = std::make_unique<DirtyRegionsBuilder>(*options.dirtyRegions, data);
+    if (options.packed)
+        frameBuilders[2] = std::make_unique<PackedDirectionBuilder>(*options.packed, data);
+    if (options.colorImages) {
+        auto colorBuilder =
+            std::make_unique<ColorFramesBuilder>(*options.colorImages, *options.colors, data);
+        if (!colorBuilder->isValid()) return false;
+        frameBuilders[3] = std::move(colorBuilder);
+    }
+    decodeDirectionStage2(data, pbEntries, buffers.pixelBufferCells, buffers.pixelBufferColors,
+                          index, frameBuilders, options.onFrameDecoded);
+    timer.endStep(&DCC::DecodeStats::stage2Time);
+    if (stats) {
+        stats->pixelCodeIndicesBits =
+            data.pixelCodesDisplacementBitStream.tell() - stats->pixelCodesDisplacementBits;
+    }
+
+    // Make sure we fully read the streams
+    assert(data.equalCellBitStream.tell() == data.equalCellBitStream.sizeInBits());
+    assert(data.pixelMaskBitStream.tell() == data.pixelMaskBitStream.sizeInBits());
+    assert(data.rawPixelUsageBitStream.tell() == data.rawPixelUsageBitStream.sizeInBits());
+    assert(data.rawPixelCodesBitStream.tell() == data.rawPixelCodesBitStream.sizeInBits());
+    // This exact stream size is not known, so check if we at least are in the last byte
+    assert(data.pixelCodesDisplacementBitStream.bitPositionInBuffer() + 7_z >=
+           data.pixelCodesDisplacementBitStream.bufferSizeInBits());
+
+    return bitStream.good();
+}
+
+bool DCC::readDirection(Direction& outDir, uint32_t dirIndex, IImageProvider<uint8_t>& imgProvider)
+{
+    DecodeOptions options;
+    options.images = &imgProvider;
+    return readDirection(outDir, dirIndex, options);
+}
+
+bool DCC::readDirection(Direction& outDir, uint32_t dirIndex, const DecodeOptions& options)
+{
+    if (options.stats) *options.stats = {};
+    if (dirIndex >= header.directions) return false;
+    if (options.colorImages && !options.colors) return false;
+
+    // Only allocate a workspace if none was given, so that reusing one does not allocate at all
+    std::unique_ptr<DCCDecodeWorkspace> localWorkspace;
+    if (!options.workspace) localWorkspace = std::make_unique<DCCDecodeWorkspace>();
+    DCCDecodeWorkspace::Buffers& buffers =
+        *(options.workspace ? options.workspace : localWorkspace.get())->buffers;
+    if (!readDirectionBuffer(buffers.encodedDirection, dirIndex)) return false;
+    BitStreamView bitStream(buffers.encodedDirection.data(),
+                            buffers.encodedDirection.size() * CHAR_BIT);
+
+    return decodeDirection(outDir, bitStream, header.framesPerDir, buffers, nullptr, options);
+}
+
+size_t DCC::trimFrames(Direction& dir, SimpleImageProvider<uint8_t>& frameImages)
+{
+    assert(frameImages.getImagesNumber() == dir.frameHeaders.size());
+    const size_t bytesSaved = frameImages.trimImages();
+    for (size_t frameIndex = 0; frameIndex < dir.frameHeaders.size(); frameIndex++)
+    {
+        Extents&        extents = dir.frameHeaders[frameIndex].extents;
+        const ImageRect bounds  = frameImages.getImageBounds(frameIndex);
+        extents.xLower += int32_t(bounds.x);
+        extents.yLower += int32_t(bounds.y);
+        extents.xUpper = extents.xLower + int32_t(bounds.width);
+        extents.yUpper = extents.yLower + int32_t(bounds.height);
+    }
+    return bytesSaved;
+}
+
+void DCC::TiledDirection::copyFrameTo(size_t frameIndex, ImageView<uint8_t> dst) const
+{
+    const TiledFrame& frame = frames[frameIndex];
+    if (isTiled()) {
+        copyTiledFrame(frame, blocksPixels.data(), blockIndices.data(), dst);
+        return;
+    }
+    assert(dst.isValid() && dst.width == frame.width && dst.height == frame.height);
+    const uint8_t* framePixels = framesPixels.data() + frame.firstBlock;
+    for (size_t y = 0; y < frame.height; y++)
+    {
+        memcpy(&dst(0, y), framePixels + y * frame.width, frame.width);
+    }
+}
+
+void DCC::PackedDirection::unpackFrame(size_t frameIndex, ImageView<uint8_t> dst) const
+{
+    const PackedFrame& frame = frames[frameIndex];
+    assert(dst.isValid() && dst.width == frame.width && dst.height == frame.height);
+
+    switch (bitsPerPixel)
+    {
+    case 2: unpackFrameIndices<2>(*this, frame, dst); break;
+    case 4: unpackFrameIndices<4>(*this, frame, dst); break;
+    default:
+        assert(bitsPerPixel == CHAR_BIT);
+        // The palette is the identity, indices are the pixel values
+        for (size_t y = 0; y < frame.height; y++)
+        {
+            memcpy(&dst(0, y), pixels.data() + frame.firstByte + y * frame.stride, frame.width);
+        }
+        break;
+    }
+}
+
+bool DCC::encodeIndexedBlocks(const Direction& dir, size_t frameIndex,
+                              ImageView<const uint8_t> frame, IndexedBlocksFrame& outFrame)
+{
+    constexpr size_t blockSize    = IndexedBlocksFrame::blockSize;
+    const Extents&   frameExtents = dir.frameHeaders[frameIndex].extents;
+    assert(frame.isValid() && frame.width == size_t(frameExtents.width()) &&
+           frame.height == size_t(frameExtents.height()));
+
+    outFrame.originX = uint16_t(size_t(frameExtents.xLower - dir.extents.xLower) % blockSize);
+    outFrame.originY = uint16_t(size_t(frameExtents.yLower - dir.extents.yLower) % blockSize);
+    outFrame.width   = uint16_t(frame.width);
+    outFrame.height  = uint16_t(frame.height);
+
+    const size_t frameEndX = outFrame.originX + frame.width;
+    const size_t frameEndY = outFrame.originY + frame.height;
+    outFrame.nbBlocksX     = uint16_t((frameEndX + blockSize - 1) / blockSize);
+    outFrame.nbBlocksY     = uint16_t((frameEndY + blockSize - 1) / blockSize);
+    outFrame.blocks.clear();
+    outFrame.blocks.reserve(size_t(outFrame.nbBlocksX) * outFrame.nbBlocksY);
+
+    for (size_t blockY = 0; blockY < outFrame.nbBlocksY; blockY++)
+    {
+        // Pixels of the block that are outside of the frame are left to index 0
+        const size_t yBegin = std::max(blockY * blockSize, size_t(outFrame.originY));
+        const size_t yEnd   = std::min((blockY + 1) * blockSize, frameEndY);
+        for (size_t blockX = 0; blockX < outFrame.nbBlocksX; blockX++)
+        {
+            const size_t xBegin = std::max(blockX * blockSize, size_t(outFrame.originX));
+            const size_t xEnd   = std::min((blockX + 1) * blockSize, frameEndX);
+
+            IndexedBlocksFrame::Block block    = {};
+            size_t                    nbValues = 0;
+            for (size_t y = yBegin; y < yEnd; y++)
+            {
+                for (size_t x = xBegin; x < xEnd; x++)
+                {
+                    const uint8_t pixel = frame(x - outFrame.originX, y - outFrame.originY);
+                    size_t        index = 0;
+                    while (index < nbValues && block.values[index] != pixel)
+                        index++;
+                    if (index == nbValues) {
+                        if (nbValues == 4) return false;
+                        block.values[nbValues++] = pixel;
+                    }
+                    block.indices |= uint32_t(index)
+                                     << (2 * (x % blockSize + (y % blockSize) * blockSize));
+                }
+            }
+            outFrame.blocks.push_back(block);
+        }
+    }
+    return true;
+}
+
+bool DCC::readDirectionHeaders(Direction& outDir, uint32_t dirIndex)
+{
+    if (dirIndex >= header.directions) return false;
+
+    // Only read the bytes of the headers, the size of the frame headers depends on the direction
+    // header so read it first.
+    const size_t    directionSize = getDirectionSize(dirIndex);
+    const size_t    dirHeaderSize = std::min((dirHeaderSizeInBits + 7) / CHAR_BIT, directionSize);
+    Vector<uint8_t> buffer(dirHeaderSize);
+    stream->seek(directionsOffsets[dirIndex], IStream::beg);
+    stream->read(buffer.data(), dirHeaderSize);
+    if (!stream->good()) return false;
+    {
+        BitStreamView dirHeaderBitStream(buffer.data(), dirHeaderSize * CHAR_BIT);
+        if (!readDirHeader(outDir.header, dirHeaderBitStream)) return false;
+    }
+
+    const size_t headersSizeInBits =
+        dirHeaderSizeInBits + header.framesPerDir * frameHeaderSizeInBits(outDir.header);
+    const size_t headersSize = (headersSizeInBits + 7) / CHAR_BIT;
+    if (headersSize > directionSize) return false;
+    buffer.resize(headersSize);
+    stream->read(buffer.data() + dirHeaderSize, headersSize - dirHeaderSize);
+    if (!stream->good()) return false;
+
+    BitStreamView bitStream(buffer.data(), headersSize * CHAR_BIT);
+    bitStream.skip(dirHeaderSizeInBits);
+    if (!readFrameHeaders(header.framesPerDir, outDir, bitStream)) return false;
+
+    outDir.computeDirExtents();
+    return true;
+}
+
+bool DCC::readAllDirectionHeaders(Vector<Direction>& outDirs)
+{
+    outDirs.resize(header.directions);
+    for (uint32_t dirIndex = 0; dirIndex < header.directions; dirIndex++)
+    {
+        if (!readDirectionHeaders(outDirs[dirIndex], dirIndex)) return false;
+    }
+    return true;
+}
+
+bool DCC::indexDirection(DirectionIndex& outIndex, uint32_t dirIndex,
+                         IImageProvider<uint8_t>& imgProvider)
+{
+    if (dirIndex >= header.directions) return false;
+
+    outIndex = DirectionIndex{};
+    if (!readDirectionBuffer(outIndex.encodedDirection, dirIndex)) return false;
+    BitStreamView bitStream(outIndex.encodedDirection.data(),
+                            outIndex.encodedDirection.size() * CHAR_BIT);
+
+    DCCDecodeWorkspace workspace;
+    DecodeOptions      options;
+    options.images = &imgProvider;
+    return decodeDirection(outIndex.direction, bitStream, header.framesPerDir, *workspace.buffers,
+                           &outIndex, options);
+}
+
+bool DCC::readFrame(const DirectionIndex& dirIndex, uint32_t frameIndex,
+                    IImageProvider<uint8_t>& imgProvider)
+{
+    DCCDecodeWorkspace workspace;
+    return readFrame(dirIndex, frameIndex, imgProvider, workspace);
+}
+
+bool DCC::readFrame(const DirectionIndex& dirIndex, uint32_t frameIndex,
+                    IImageProvider<uint8_t>& imgProvider, DCCDecodeWorkspace& workspace)
+{
+    if (frameIndex >= dirIndex.frames.size()) return false;
+
+    const Direction& dir = dirIndex.direction;
+    BitStreamView    bitStream(dirIndex.encodedDirection.data(),
+                            dirIndex.encodedDirection.size() * CHAR_BIT);
+    bitStream.setPosition(dirIndex.streamsBitPos);
+
+    // Only prepare the requested frame
+    DCCDecodeWorkspace::Buffers& buffers = *workspace.buffers;
+    DirectionData data{dir, bitStream, dirIndex.frames.size(), buffers.codeToPixelValue,
+                       buffers.framesData};
+    if (data.framesData.empty()) data.framesData.resize(1);
+    FrameData& frameData = data.framesData[0];
+    frameData.prepare(dir, dir.frameHeaders[frameIndex], &imgProvider);
+    if (!frameData.imageView.isValid()) return false;
+
+    decodeFrameFromCheckpoint(data, frameData, dirIndex, dirIndex.frames[frameIndex], buffers);
+    return bitStream.good();
+}
+
+namespace
+{ // Encoder internals
+
+constexpr uint8_t  dccSignature = 0x74;
+constexpr uint8_t  dccVersion   = 6;
+constexpr uint32_t dccTag       = 1;
+/// Size of the file header, followed by the directions offsets
+constexpr size_t dccHeaderSize = 15;
+/// The encoded DC6 size of a frame does not include its header (32 bytes) and terminator (3)
+constexpr uint32_t dc6FrameOverhead = 32 + 3;
+/// Bitstreams sizes are stored on 20 bits
+constexpr size_t maxBitStreamSize = (1u << 20) - 1u;
+
+/// Returns the index in DCC::bitsWidthTable of the smallest size that can store value
+uint32_t unsignedBitsWidthCode(uint32_t value)
+{
+    uint32_t code = 0;
+    while (code < 15 && (value >> DCC::bitsWidthTable[code]) != 0)
+        code++;
+    return code;
+}
+
+/// Returns the index in DCC::bitsWidthTable of the smallest size that can store a signed value
+uint32_t signedBitsWidthCode(int32_t value)
+{
+    if (value == 0) return 0;
+    // A N-bits signed value can store any value whose magnitude fits on N-1 bits
+    const uint32_t magnitude = value < 0 ? ~uint32_t(value) : uint32_t(value);
+    uint32_t       code      = 1;
+    while (code < 15 && (magnitude >> (DCC::bitsWidthTable[code] - 1)) != 0)
+        code++;
+    return code;
+}
+
+/** Computes the size of a frame encoded with the DC6 RLE scheme, see FrameHeader::codedBytes.
+ * Each row is a list of chunks of at most 127 transparent or opaque pixels, ended by one byte.
+ * Transparent chunks are a single byte and the trailing transparent pixels are not encoded.
+ */
+uint32_t dc6EncodedSize(ImageView<const uint8_t> image)
+{
+    constexpr size_t maxChunkSize = 0x7F;
+
+    uint32_t encodedSize = 0;
+    for (size_t y = 0; y < image.height; y++)
+    {
+        size_t x = 0;
+        while (x < image.width)
+        {
+            const bool isTransparent = image(x, y) == 0;
+            size_t     runEnd        = x + 1;
+            while (runEnd < image.width && (image(runEnd, y) == 0) == isTransparent)
+                runEnd++;
+            const size_t runSize  = runEnd - x;
+            const size_t nbChunks = (runSize + maxChunkSize - 1) / maxChunkSize;
+            if (!isTransparent)
+                encodedSize += uint32_t(nbChunks + runSize);
+            else if (runEnd < image.width)
+                encodedSize += uint32_t(nbChunks);
+            x = runEnd;
+        }
+        encodedSize++; // End of line
+    }
+    return encodedSize;
+}
+
+/// The pixel codes of a cell entry, in the order they are read by decodePixelCodesStack
+struct CellPixelCodes
+{
+    uint8_t codes[PixelBufferEntry::nbValues]; ///< Sorted codes, then the terminator if any
+    uint8_t nbCodes;
+
+    /// Number of bits used in the pixelCodesDisplacementBitStream
+    size_t displacementSize() const
+    {
+        size_t  size          = 0;
+        uint8_t lastPixelCode = 0;
+        for (size_t i = 0; i < nbCodes; i++)
+        {
+            size += 4 * ((codes[i] - lastPixelCode) / 0xF + 1);
+            lastPixelCode = codes[i];
+        }
+        return size;
+    }
+
+    /// Number of bits used in the rawPixelCodesBitStream
+    size_t rawSize() const { return size_t(nbCodes) * 8; }
+
+    void writeDisplacements(BitStreamWriter& bitStream) const
+    {
+        uint8_t lastPixelCode = 0;
+        for (size_t i = 0; i < nbCodes; i++)
+        {
+            unsigned displacement = unsigned(codes[i] - lastPixelCode);
+            for (; displacement >= 0xF; displacement -= 0xF)
+                bitStream.writeUnsigned(0xF, 4);
+            bitStream.writeUnsigned(displacement, 4);
+            lastPixelCode = codes[i];
+        }
+    }
+
+    void writeRaw(BitStreamWriter& bitStream) const
+    {
+        for (size_t i = 0; i < nbCodes; i++)
+            bitStream.writeUnsigned(codes[i], 8);
+    }
+};
+
+/// The bitstreams generated by encodeDirectionCells
+struct DirectionCellsStreams
+{
+    BitStreamWriter        equalCells;
+    BitStreamWriter        pixelMasks;
+    BitStreamWriter        pixelCodeIndices; ///< Written after the pixel codes in the same stream
+    Vector<CellPixelCodes> cellsPixelCodes;  ///< The codes of each cell with a non-empty mask
+};
+
+/// Returns the number of bits per pixel read by stage 2 for a cell decoded from this entry
+unsigned pixelIndexSize(const PixelBufferEntry& entry)
+{
+    if (entry.values[0] == entry.values[1]) return 0;
+    if (entry.values[1] == entry.values[2]) return 1;
+    return 2;
+}
+
+/// Returns the index of value in the values usable by stage 2, or -1 if it is not in the entry
+int findPixelIndex(const PixelBufferEntry& entry, uint8_t value)
+{
+    const size_t nbUsableValues = size_t(1) << pixelIndexSize(entry);
+    for (size_t i = 0; i < nbUsableValues; i++)
+    {
+        if (entry.values[i] == value) return int(i);
+    }
+    return -1;
+}
+
+bool sameCellPixels(ImageView<const uint8_t> lhs, ImageView<const uint8_t> rhs)
+{
+    for (size_t y = 0; y < lhs.height; y++)
+    {
+        if (memcmp(&lhs(0, y), &rhs(0, y), lhs.width) != 0) return false;
+    }
+    return true;
+}
+
+/// Mapping between the pixel values used by a direction and their codes
+struct PixelCodesTable
+{
+    bool    valueUsed[256];
+    uint8_t valueToCode[256];
+    uint8_t codeToValue[256];
+
+    explicit PixelCodesTable(const Vector<DCC::EncoderFrame>& frames)
+        : valueUsed(), valueToCode(), codeToValue()
+    {
+        for (const DCC::EncoderFrame& frame : frames)
+        {
+            for (size_t y = 0; y < frame.image.height; y++)
+            {
+                for (size_t x = 0; x < frame.image.width; x++)
+                    valueUsed[frame.image(x, y)] = true;
+            }
+        }
+        uint8_t nextCode = 0;
+        for (size_t value = 0; value < 256; value++)
+        {
+            if (!valueUsed[value]) continue;
+            valueToCode[value]      = nextCode;
+            codeToValue[nextCode++] = uint8_t(value);
+        }
+    }
+};
+
+/// How a cell that is not the same as the previous one is encoded in stage 1
+struct CellEncoding
+{
+    uint8_t          pixelMask;
+    PixelBufferEntry entry; ///< The entry decoded by stage 1
+    CellPixelCodes   codes; ///< The pixel codes to encode, only used if pixelMask is not 0
+    size_t           size;  ///< Size in bits of the cell, pixel indices included
+};
+
+/** Finds the pixel mask and pixel codes that encode the cell values with the smallest size.
+ * @param previousEntry The last entry of the pixel buffer cell, or nullptr if none.
+ *
+ * Pixels of the entry whose bit is set in the mask are replaced by the decoded codes, the first
+ * bit set getting the last (highest) code decoded. Once the decoding stops, the remaining pixels
+ * get the value of code 0, which hence never needs to be encoded.
+ */
+CellEncoding findCellEncoding(const uint8_t* cellValues, size_t nbCellValues, size_t nbPixels,
+                              const PixelBufferEntry* previousEntry, const PixelCodesTable& table)
+{
+    // Codes that can be decoded, sorted as the codes are always increasing
+    uint8_t cellCodes[PixelBufferEntry::nbValues];
+    size_t  nbCellCodes = 0;
+    for (size_t i = 0; i < nbCellValues; i++)
+    {
+        const uint8_t code = table.valueToCode[cellValues[i]];
+        if (!code) continue;
+        size_t insertPos = nbCellCodes++;
+        for (; insertPos > 0 && cellCodes[insertPos - 1] > code; insertPos--)
+            cellCodes[insertPos] = cellCodes[insertPos - 1];
+        cellCodes[insertPos] = code;
+    }
+
+    CellEncoding best;
+    best.size = std::numeric_limits<size_t>::max();
+    // Without a previous entry, the mask is not encoded and is always 0xF
+    const size_t maskSize  = previousEntry ? 4 : 0;
+    const size_t firstMask = previousEntry ? 0 : PixelMaskTable::nbMasks - 1;
+    for (size_t pixelMask = firstMask; pixelMask < PixelMaskTable::nbMasks; pixelMask++)
+    {
+        const size_t nbPixelsInMask = pixelMaskTable.nbPixels[pixelMask];
+        // Try every subset of the codes of the cell
+        for (size_t codesSubset = 0; codesSubset < (size_t(1) << nbCellCodes); codesSubset++)
+        {
+            CellEncoding candidate;
+            candidate.pixelMask     = uint8_t(pixelMask);
+            candidate.codes.nbCodes = 0;
+            for (size_t i = 0; i < nbCellCodes; i++)
+            {
+                if (codesSubset & (size_t(1) << i))
+                    candidate.codes.codes[candidate.codes.nbCodes++] = cellCodes[i];
+            }
+            const size_t nbCodes = candidate.codes.nbCodes;
+            if (nbCodes > nbPixelsInMask) continue;
+
+            // Same as the PixelMaskTable, with the values instead of the stack slots
+            size_t rank = 0;
+            for (size_t i = 0; i < PixelBufferEntry::nbValues; i++)
+            {
+                uint8_t& value = candidate.entry.values[i];
+                if (!(pixelMask & (size_t(1) << i)))
+                    value = previousEntry->values[i];
+                else if (rank < nbCodes)
+                    value = table.codeToValue[candidate.codes.codes[nbCodes - 1 - rank++]];
+                else
+                    value = table.codeToValue[0];
+            }
+            const bool canEncodeCell =
+                std::all_of(cellValues, cellValues + nbCellValues, [&](uint8_t value) {
+                    return findPixelIndex(candidate.entry, value) >= 0;
+                });
+            if (!canEncodeCell) continue;
+
+            // Repeating the last code stops the decoding before the stack is full
+            if (nbCodes < nbPixelsInMask) {
+                candidate.codes.codes[candidate.codes.nbCodes++] =
+                    nbCodes ? candidate.codes.codes[nbCodes - 1] : 0;
+            }
+            candidate.size = maskSize + pixelIndexSize(candidate.entry) * nbPixels;
+            if (pixelMask) candidate.size += candidate.codes.displacementSize();
+            if (candidate.size < best.size) best = candidate;
+        }
+    }
+    return best;
+}
+
+/** Simulates the decoding of the direction to generate the cells bitstreams.
+ * Cells are encoded as the same as the previous cell when possible (only if useEqualCells is
+ * true), otherwise with the smallest encoding given by findCellEncoding.
+ * @return false if a cell uses more than 4 colors
+ */
+bool encodeDirectionCells(const DCC::Direction& dir, const Vector<DCC::EncoderFrame>& frames,
+                          const PixelCodesTable& table, bool useEqualCells,
+                          DirectionCellsStreams& streams)
+{
+    const size_t pbWidth            = size_t(dir.extents.width());
+    const size_t pbHeight           = size_t(dir.extents.height());
+    const size_t nbPbCellsX         = 1u + (pbWidth - 1u) / pbCellMaxPixelSize;
+    const size_t nbPbCellsY         = 1u + (pbHeight - 1u) / pbCellMaxPixelSize;
+    const size_t nbPixelBufferCells = nbPbCellsX * nbPbCellsY;
+
+    Vector<PixelBufferEntry> lastEntries(nbPixelBufferCells);
+    Vector<bool>             hasEntry(nbPixelBufferCells, false);
+    Vector<Cell>             pixelBufferCells(nbPixelBufferCells, Cell{0xF, 0xF});
+    Vector<uint8_t>          pixelBufferColors(pbWidth * pbHeight, 0);
+    ImageView<uint8_t>       pBuffer{pixelBufferColors.data(), pbWidth, pbHeight, pbWidth};
+
+    bool      success = true;
+    FrameData frameData;
+    for (size_t frameIndex = 0; frameIndex < frames.size() && success; ++frameIndex)
+    {
+        frameData.prepare(dir, dir.frameHeaders[frameIndex], nullptr);
+        const ImageView<const uint8_t>& image = frames[frameIndex].image;
+
+        forEachFrameCell(nbPbCellsX, frameData, [&](size_t, size_t pbCellIndex, size_t pbCellPosX,
+                                                    size_t pbCellPosY, Cell frameCell) {
+            const ImageView<const uint8_t> cellPixels =
+                image.subView(pbCellPosX - frameData.offsetX, pbCellPosY - frameData.offsetY,
+                              frameCell.width, frameCell.height);
+            const ImageView<uint8_t> pbCellPixels =
+                pBuffer.subView(pbCellPosX, pbCellPosY, frameCell.width, frameCell.height);
+
+            uint8_t cellValues[PixelBufferEntry::nbValues];
+            size_t  nbCellValues = 0;
+            for (size_t y = 0; y < cellPixels.height; y++)
+            {
+                for (size_t x = 0; x < cellPixels.width; x++)
+                {
+                    const uint8_t value = cellPixels(x, y);
+                    if (std::find(cellValues, cellValues + nbCellValues, value) !=
+                        cellValues + nbCellValues)
+                        continue;
+                    if (nbCellValues == PixelBufferEntry::nbValues) {
+                        success = false;
+                        return;
+                    }
+                    cellValues[nbCellValues++] = value;
+                }
+            }
+
+            const bool hasPreviousEntry   = hasEntry[pbCellIndex];
+            Cell&      pbCell             = pixelBufferCells[pbCellIndex];
+            bool       sameAsPreviousCell = false;
+            if (hasPreviousEntry && useEqualCells) {
+                // The decoder clears the cell if its size changed
+                if (frameCell.width != pbCell.width || frameCell.height != pbCell.height)
+                    sameAsPreviousCell = nbCellValues == 1 && cellValues[0] == 0;
+                else
+                    sameAsPreviousCell = sameCellPixels(pbCellPixels, cellPixels);
+                streams.equalCells.writeBool(sameAsPreviousCell);
+            }
+
+            if (!sameAsPreviousCell) {
+                const size_t nbPixels = cellPixels.width * cellPixels.height;
+
+                const CellEncoding encoding =
+                    findCellEncoding(cellValues, nbCellValues, nbPixels,
+                                     hasPreviousEntry ? &lastEntries[pbCellIndex] : nullptr, table);
+                if (hasPreviousEntry) streams.pixelMasks.writeUnsigned(encoding.pixelMask, 4);
+                // An empty mask reuses the previous entry, and no pixel code is read
+                if (encoding.pixelMask) streams.cellsPixelCodes.push_back(encoding.codes);
+                lastEntries[pbCellIndex] = encoding.entry;
+                hasEntry[pbCellIndex]    = true;
+
+                const PixelBufferEntry& entry     = lastEntries[pbCellIndex];
+                const unsigned          indexSize = pixelIndexSize(entry);
+                for (size_t y = 0; y < cellPixels.height && indexSize; y++)
+                {
+                    for (size_t x = 0; x < cellPixels.width; x++)
+                    {
+                        const int pixelIndex = findPixelIndex(entry, cellPixels(x, y));
+                        assert(pixelIndex >= 0);
+                        streams.pixelCodeIndices.writeUnsigned(uint32_t(pixelIndex), indexSize);
+                    }
+                }
+            }
+            // Update the pixel buffer the same way the decoder does
+            for (size_t y = 0; y < cellPixels.height; y++)
+                memcpy(&pbCellPixels(0, y), &cellPixels(0, y), cellPixels.width);
+            pbCell = frameCell;
+        });
+    }
+    return success;
+}
+
+/// Encodes a direction, with or without the equal cells optimization
+bool encodeDirection(const DCC::Direction& dir, const Vector<DCC::EncoderFrame>& frames,
+                     const PixelCodesTable& table, bool useEqualCells, BitStreamWriter& out)
+{
+    DirectionCellsStreams streams;
+    if (!encodeDirectionCells(dir, frames, table, useEqualCells, streams)) return false;
+
+    // Only use the raw encoding for the cells where it is smaller, and if it makes up for the
+    // rawPixelUsageBitStream size
+    size_t rawEncodingGain = 0;
+    for (const CellPixelCodes& cellCodes : streams.cellsPixelCodes)
+    {
+        if (cellCodes.rawSize() < cellCodes.displacementSize())
+            rawEncodingGain += cellCodes.displacementSize() - cellCodes.rawSize();
+    }
+    const bool hasRawPixelEncoding = rawEncodingGain > streams.cellsPixelCodes.size();
+
+    BitStreamWriter rawPixelUsage;
+    BitStreamWriter rawPixelCodes;
+    BitStreamWriter pixelCodesDisplacement;
+    for (const CellPixelCodes& cellCodes : streams.cellsPixelCodes)
+    {
+        const bool useRaw =
+            hasRawPixelEncoding && cellCodes.rawSize() < cellCodes.displacementSize();
+        if (hasRawPixelEncoding) rawPixelUsage.writeBool(useRaw);
+        if (useRaw)
+            cellCodes.writeRaw(rawPixelCodes);
+        else
+            cellCodes.writeDisplacements(pixelCodesDisplacement);
+    }
+    // Stage 2 reads the pixel indices once all the pixel codes were read
+    pixelCodesDisplacement.append(streams.pixelCodeIndices);
+
+    const bool compressEqualCells = streams.equalCells.sizeInBits() > 0;
+    if (streams.equalCells.sizeInBits() > maxBitStreamSize ||
+        streams.pixelMasks.sizeInBits() > maxBitStreamSize ||
+        rawPixelUsage.sizeInBits() > maxBitStreamSize ||
+        rawPixelCodes.sizeInBits() > maxBitStreamSize)
+        return false;
+
+    const DCC::DirectionHeader& dirHeader = dir.header;
+    out.writeUnsigned(dirHeader.outsizeCoded, 32);
+    out.writeBool(hasRawPixelEncoding);
+    out.writeBool(compressEqualCells);
+    out.writeUnsigned(dirHeader.variable0Bits, 4);
+    out.writeUnsigned(dirHeader.widthBits, 4);
+    out.writeUnsigned(dirHeader.heightBits, 4);
+    out.writeUnsigned(dirHeader.xOffsetBits, 4);
+    out.writeUnsigned(dirHeader.yOffsetBits, 4);
+    out.writeUnsigned(dirHeader.optionalBytesBits, 4);
+    out.writeUnsigned(dirHeader.codedBytesBits, 4);
+
+    constexpr auto bitsWidthTable = DCC::bitsWidthTable;
+    for (const DCC::FrameHeader& fHdr : dir.frameHeaders)
+    {
+        out.writeUnsigned(fHdr.variable0, bitsWidthTable[dirHeader.variable0Bits]);
+        out.writeUnsigned(fHdr.width, bitsWidthTable[dirHeader.widthBits]);
+        out.writeUnsigned(fHdr.height, bitsWidthTable[dirHeader.heightBits]);
+        out.writeSigned(fHdr.xOffset, bitsWidthTable[dirHeader.xOffsetBits]);
+        out.writeSigned(fHdr.yOffset, bitsWidthTable[dirHeader.yOffsetBits]);
+        out.writeUnsigned(fHdr.optionalBytes, bitsWidthTable[dirHeader.optionalBytesBits]);
+        out.writeUnsigned(fHdr.codedBytes, bitsWidthTable[dirHeader.codedBytesBits]);
+        out.writeBool(fHdr.frameBottomUp);
+    }
+
+    if (compressEqualCells) out.writeUnsigned(uint32_t(streams.equalCells.sizeInBits()), 20);
+    out.writeUnsigned(uint32_t(streams.pixelMasks.sizeInBits()), 20);
+    if (hasRawPixelEncoding) {
+        out.writeUnsigned(uint32_t(rawPixelUsage.sizeInBits()), 20);
+        out.writeUnsigned(uint32_t(rawPixelCodes.sizeInBits()), 20);
+    }
+    for (size_t value = 0; value < 256; value++)
+        out.writeBool(table.valueUsed[value]);
+
+    out.append(streams.equalCells);
+    out.append(streams.pixelMasks);
+    out.append(rawPixelUsage);
+    out.append(rawPixelCodes);
+    out.append(pixelCodesDisplacement);
+    out.alignToByte();
+    return true;
+}
+
+/// Builds the headers of a direction from its frames, and encodes it with the best options
+bool encodeDirection(const Vector<DCC::EncoderFrame>& frames, BitStreamWriter& out,
+                     uint32_t& outsizeCoded)
+{
+    DCC::Direction dir;
+    uint32_t       widthBits      = 0;
+    uint32_t       heightBits     = 0;
+    uint32_t       xOffsetBits    = 0;
+    uint32_t       yOffsetBits    = 0;
+    uint32_t       codedBytesBits = 0;
+    outsizeCoded                  = 0;
+
+    dir.frameHeaders.resize(frames.size());
+    for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+    {
+        const DCC::EncoderFrame& frame = frames[frameIndex];
+        if (!frame.image.isValid()) return false;
+
+        DCC::FrameHeader& fHdr = dir.frameHeaders[frameIndex];
+        fHdr.variable0         = 0;
+        fHdr.width             = uint32_t(frame.image.width);
+        fHdr.height            = uint32_t(frame.image.height);
+        fHdr.xOffset           = frame.xOffset;
+        fHdr.yOffset           = frame.yOffset;
+        fHdr.optionalBytes     = 0;
+        fHdr.codedBytes        = dc6EncodedSize(frame.image);
+        fHdr.frameBottomUp     = false;
+        // Same as readFrameHeaders, for top-down frames
+        fHdr.extents.xLower = fHdr.xOffset;
+        fHdr.extents.xUpper = fHdr.xOffset + int32_t(fHdr.width);
+        fHdr.extents.yLower = fHdr.yOffset - int32_t(fHdr.height) + 1;
+        fHdr.extents.yUpper = fHdr.yOffset + 1;
+
+        outsizeCoded += fHdr.codedBytes + dc6FrameOverhead;
+        widthBits      = std::max(widthBits, unsignedBitsWidthCode(fHdr.width));
+        heightBits     = std::max(heightBits, unsignedBitsWidthCode(fHdr.height));
+        xOffsetBits    = std::max(xOffsetBits, signedBitsWidthCode(fHdr.xOffset));
+        yOffsetBits    = std::max(yOffsetBits, signedBitsWidthCode(fHdr.yOffset));
+        codedBytesBits = std::max(codedBytesBits, unsignedBitsWidthCode(fHdr.codedBytes));
+    }
+    dir.header                = {};
+    dir.header.outsizeCoded   = outsizeCoded;
+    dir.header.widthBits      = widthBits;
+    dir.header.heightBits     = heightBits;
+    dir.header.xOffsetBits    = xOffsetBits;
+    dir.header.yOffsetBits    = yOffsetBits;
+    dir.header.codedBytesBits = codedBytesBits;
+    dir.computeDirExtents();
+
+    const PixelCodesTable table(frames);
+    BitStreamWriter       withEqualCells;
+    if (!encodeDirection(dir, frames, table, true, withEqualCells)) return false;
+    BitStreamWriter withoutEqualCells;
+    if (!encodeDirection(dir, frames, table, false, withoutEqualCells)) return false;
+
+    out.append(withEqualCells.sizeInBytes() <= withoutEqualCells.sizeInBytes() ? withEqualCells
+                                                                               : withoutEqualCells);
+    return true;
+}
+
+template<class T>
+void appendRaw(Vector<uint8_t>& out, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value)); // TODO : ENDIAN
+}
+
+} // anonymous namespace
+
+bool DCC::encode(const Vector<Vector<EncoderFrame>>& directions, Vector<uint8_t>& outFile)
+{
+    if (directions.empty() || directions.size() > std::numeric_limits<uint8_t>::max()) return false;
+    const size_t framesPerDir = directions[0].size();
+    if (!framesPerDir) return false;
+
+    Vector<BitStreamWriter> encodedDirections(directions.size());
+    uint32_t                finalDc6Size = 24;
+    for (size_t dirIndex = 0; dirIndex < directions.size(); dirIndex++)
+    {
+        if (directions[dirIndex].size() != framesPerDir) return false;
+        uint32_t outsizeCoded = 0;
+        if (!encodeDirection(directions[dirIndex], encodedDirections[dirIndex], outsizeCoded))
+            return false;
+        finalDc6Size += outsizeCoded + uint32_t(framesPerDir) * 4;
+    }
+
+    outFile.clear();
+    appendRaw(outFile, dccSignature);
+    appendRaw(outFile, dccVersion);
+    appendRaw(outFile, uint8_t(directions.size()));
+    appendRaw(outFile, uint32_t(framesPerDir));
+    appendRaw(outFile, dccTag);
+    appendRaw(outFile, finalDc6Size);
+    assert(outFile.size() == dccHeaderSize);
+
+    uint32_t directionOffset = uint32_t(dccHeaderSize + directions.size() * sizeof(uint32_t));
+    for (const BitStreamWriter& encodedDirection : encodedDirections)
+    {
+        appendRaw(outFile, directionOffset);
+        directionOffset += uint32_t(encodedDirection.sizeInBytes());
+    }
+    for (const BitStreamWriter& encodedDirection : encodedDirections)
+    {
+        const Vector<uint8_t>& bytes = encodedDirection.getBuffer();
+        outFile.insert(outFile.end(), bytes.begin(), bytes.end());
+    }
+    return true;
+}
+
+} // namespace WorldStone
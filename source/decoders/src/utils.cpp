@@ -6,6 +6,7 @@
 #include <fmt/format.h>
 #include "Palette.h"
 #include <cassert>
+#include <vector>
 
 namespace WorldStone
 {
@@ -44,12 +45,19 @@ void exportToPPM(const char* output, const uint8_t* data, int width, int height,
     FILE* file = fopen(output, "wb");
     if (file) {
         fmt::print(file, "P6 {} {} 255\n", width, height);
-        for (size_t i = 0; i < static_cast<size_t>(width * height); ++i)
+        // Convert a whole scanline at once instead of writing each component separately
+        std::vector<uint8_t> rowColors(static_cast<size_t>(width) * 3);
+        for (size_t y = 0; y < static_cast<size_t>(height); ++y)
         {
-            const auto& colors = palette.colors;
-            fputc(colors[data[i]].r, file);
-            fputc(colors[data[i]].g, file);
-            fputc(colors[data[i]].b, file);
+            const uint8_t* row = data + y * static_cast<size_t>(width);
+            for (size_t x = 0; x < static_cast<size_t>(width); ++x)
+            {
+                const Palette::Color color = palette.colors[row[x]];
+                rowColors[x * 3 + 0]       = color.r;
+                rowColors[x * 3 + 1]       = color.g;
+                rowColors[x * 3 + 2]       = color.b;
+            }
+            fwrite(rowColors.data(), 1, rowColors.size(), file);
         }
         fclose(file);
     }
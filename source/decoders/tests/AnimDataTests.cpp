@@ -0,0 +1,149 @@
+/**
+ * @file AnimDataTests.cpp
+ * @brief Tests of the AnimData.d2 decoder, on a generated file.
+ */
+#include <AnimData.h>
+#include <MemoryStream.h>
+#include <doctest.h>
+#include <algorithm>
+#include <string.h>
+#include <string>
+
+using WorldStone::AnimData;
+using WorldStone::MemoryStream;
+using WorldStone::Vector;
+
+namespace
+{
+AnimData::Record makeRecord(const char* cofName, uint32_t framesPerDirection, uint32_t animSpeed)
+{
+    AnimData::Record record{};
+    memcpy(record.cofName, cofName, std::min(strlen(cofName), AnimData::maxNameLength));
+    record.framesPerDirection = framesPerDirection;
+    record.animSpeed          = animSpeed;
+    for (size_t frame = 0; frame < framesPerDirection; frame++)
+        record.frameData[frame] = uint8_t((frame + framesPerDirection) % 5);
+    return record;
+}
+
+/// Writes the records in the blocks of their hash, like the game file
+Vector<uint8_t> makeAnimDataFile(const Vector<AnimData::Record>& records)
+{
+    Vector<uint8_t> file;
+    for (size_t block = 0; block < AnimData::nbBlocks; block++)
+    {
+        Vector<const AnimData::Record*> blockRecords;
+        for (const AnimData::Record& record : records)
+            if (AnimData::hashName(record.cofName) == block) blockRecords.push_back(&record);
+
+        const uint32_t nbRecords  = uint32_t(blockRecords.size());
+        const uint8_t* countBytes = reinterpret_cast<const uint8_t*>(&nbRecords);
+        file.insert(file.end(), countBytes, countBytes + sizeof(nbRecords));
+        for (const AnimData::Record* record : blockRecords)
+        {
+            const uint8_t* recordBytes = reinterpret_cast<const uint8_t*>(record);
+            file.insert(file.end(), recordBytes, recordBytes + sizeof(*record));
+        }
+    }
+    return file;
+}
+} // namespace
+
+/**@testimpl{WorldStone::AnimData,AnimData}
+ * Reads a generated file, then looks up the animations and computes their timings.
+ */
+TEST_CASE("AnimData")
+{
+    CHECK(AnimData::hashName("AMA1HTH") == 228);
+    CHECK(AnimData::hashName("ama1hth.cof") == 228);
+
+    Vector<AnimData::Record> records;
+    for (const char* token : {"AM", "SO", "NE", "PA", "BA", "DZ", "AI", "ZZ"})
+    {
+        for (const char* mode : {"A1", "A2", "NU", "WL", "RN", "GH", "DT"})
+        {
+            for (const char* weaponClass : {"HTH", "1HS", "BOW"})
+            {
+                const std::string name = std::string(token) + mode + weaponClass;
+                records.push_back(makeRecord(name.c_str(), uint32_t(8 + records.size() % 17),
+                                             uint32_t(128 + records.size() % 200)));
+            }
+        }
+    }
+    // Same name with different timings, the first one of the file is used
+    records.push_back(makeRecord("AMA1HTH", 3, 256));
+
+    AnimData animData;
+    REQUIRE(animData.read(std::make_unique<MemoryStream>(makeAnimDataFile(records))));
+    CHECK(animData.getAnimationsNumber() == records.size());
+
+    Vector<uint32_t> indices;
+    bool             allFound = true, timingsMatch = true;
+    for (const AnimData::Record& record : records)
+    {
+        const uint32_t index = animData.findAnimation(record.cofName);
+        allFound &= index != AnimData::notFound;
+        if (index == AnimData::notFound) continue;
+        indices.push_back(index);
+        if (strcmp(record.cofName, "AMA1HTH") != 0) {
+            const AnimData::Animation& animation = animData.getAnimation(index);
+            timingsMatch &= animation.framesPerDirection == record.framesPerDirection &&
+                            animation.animSpeed == record.animSpeed &&
+                            memcmp(animData.getFrameTriggers(index), record.frameData,
+                                   AnimData::maxFrames) == 0;
+        }
+    }
+    CHECK(allFound);
+    CHECK(timingsMatch);
+    const uint32_t amA1 = animData.findAnimation("ama1hth");
+    REQUIRE(amA1 != AnimData::notFound);
+    CHECK(animData.getAnimation(amA1).framesPerDirection == records[0].framesPerDirection);
+    CHECK(animData.findAnimation("AMA1HT") == AnimData::notFound);
+    CHECK(animData.findAnimation("AMA1HTHX") == AnimData::notFound);
+    CHECK(animData.findAnimation("") == AnimData::notFound);
+
+    SUBCASE("Batch timings")
+    {
+        Vector<AnimData::TimingQuery> queries;
+        for (uint32_t ticks = 0; ticks < 300; ticks += 7)
+            for (uint32_t index : indices)
+                queries.push_back({index, ticks});
+        Vector<AnimData::Timing> timings(queries.size());
+        animData.getTimings(queries.data(), queries.size(), timings.data());
+
+        bool framesMatch = true;
+        for (size_t i = 0; i < queries.size(); i++)
+        {
+            const AnimData::Animation& animation = animData.getAnimation(queries[i].animation);
+            const uint32_t             frame =
+                (queries[i].ticks * animation.animSpeed / 256) % animation.framesPerDirection;
+            framesMatch &= timings[i].frame == frame &&
+                           timings[i].trigger ==
+                               animData.getFrameTriggers(queries[i].animation)[frame];
+        }
+        CHECK(framesMatch);
+
+        const AnimData::TimingQuery missingQueries[] = {
+            {AnimData::notFound, 42}, {uint32_t(animData.getAnimationsNumber()), 42}};
+        AnimData::Timing missingTimings[2] = {{1, 1}, {1, 1}};
+        animData.getTimings(missingQueries, 2, missingTimings);
+        for (const AnimData::Timing& timing : missingTimings)
+        {
+            CHECK(timing.frame == 0);
+            CHECK(timing.trigger == 0);
+        }
+    }
+
+    SUBCASE("Invalid files")
+    {
+        Vector<uint8_t> file = makeAnimDataFile(records);
+        file.pop_back();
+        CHECK_FALSE(animData.read(std::make_unique<MemoryStream>(file)));
+        CHECK(animData.getAnimationsNumber() == 0);
+        CHECK(animData.findAnimation("AMA1HTH") == AnimData::notFound);
+
+        records.push_back(makeRecord("TOOMANY", 0, 256));
+        records.back().framesPerDirection = AnimData::maxFrames + 1;
+        CHECK_FALSE(animData.read(std::make_unique<MemoryStream>(makeAnimDataFile(records))));
+    }
+}
@@ -0,0 +1,148 @@
+/**
+ * @file COFCompositorTests.cpp
+ * @brief Tests of the compositing of COF layers.
+ */
+#include <COFCompositor.h>
+#include <FileStream.h>
+#include <MemoryStream.h>
+#include <doctest.h>
+#include <string.h>
+#include "COFTestUtils.h"
+
+using WorldStone::COF;
+using WorldStone::COFCompositor;
+using WorldStone::DCC;
+using WorldStone::FileStream;
+using WorldStone::ImageView;
+using WorldStone::MemoryStream;
+using WorldStone::PL2;
+using WorldStone::SimpleImageProvider;
+using WorldStone::Tests::makeCOF;
+using WorldStone::Vector;
+
+namespace
+{
+const uint8_t componentHD = 0;
+const uint8_t componentTR = 1;
+const uint8_t componentS1 = 8;
+} // namespace
+
+/**@testimpl{WorldStone::COFCompositor,COFCompositor}
+ * Composites the same DCC as an opaque torso and an additive S1 layer, with a missing head.
+ */
+TEST_CASE("COF compositing")
+{
+    std::unique_ptr<PL2> pl2;
+    {
+        FileStream pl2File("pal.pl2");
+        REQUIRE(pl2File.good());
+        pl2 = PL2::ReadFromStream(&pl2File);
+        REQUIRE(pl2);
+    }
+
+    DCC dcc;
+    REQUIRE(dcc.initDecoder(std::make_unique<FileStream>("HZTRLITA1HTH.dcc")));
+    const DCC::Header& dccHeader = dcc.getHeader();
+
+    COF::Header header{};
+    header.layers     = 3;
+    header.frames     = uint8_t(dccHeader.framesPerDir);
+    header.directions = dccHeader.directions;
+    header.version    = 20;
+    // Smaller than the frames so that they get clipped
+    header.xMin     = -20;
+    header.xMax     = 25;
+    header.yMin     = -70;
+    header.yMax     = -10;
+    header.animRate = 256;
+    const Vector<COF::Layer> layers{{componentHD, 1, 1, 0, 0, {'H', 'T', 'H', '\0'}},
+                                    {componentTR, 1, 1, 0, 0, {'H', 'T', 'H', '\0'}},
+                                    {componentS1, 0, 0, 1, 3, {'H', 'T', 'H', '\0'}}};
+    COF cof;
+    REQUIRE(cof.read(std::make_unique<MemoryStream>(
+        makeCOF(header, layers, {componentTR, componentS1, componentHD},
+                {componentS1, componentHD, componentTR}))));
+
+    COFCompositor                 compositor(*pl2);
+    COFCompositor::ComponentsDCCs dccs{};
+    dccs[componentTR] = &dcc;
+    dccs[componentS1] = &dcc;
+
+    const uint32_t direction = 3;
+    const COFCompositor::CompositedDirection* composited =
+        compositor.getDirection(cof, dccs, direction);
+    REQUIRE(composited != nullptr);
+    CHECK(composited->nbFrames == header.frames);
+    CHECK(composited->width == 46);
+    CHECK(composited->height == 61);
+
+    DCC::Direction               dir;
+    SimpleImageProvider<uint8_t> imgProvider;
+    REQUIRE(dcc.readDirection(dir, direction, imgProvider));
+    REQUIRE(imgProvider.getImagesNumber() == header.frames);
+
+    bool   pixelsEqual = true;
+    size_t nbBlended   = 0;
+    for (size_t frame = 0; frame < composited->nbFrames; frame++)
+    {
+        const ImageView<const uint8_t> output = composited->getFrame(frame);
+        const ImageView<const uint8_t> layer =
+            static_cast<const SimpleImageProvider<uint8_t>&>(imgProvider).getImage(frame);
+        const auto& extents = dir.frameHeaders[frame].extents;
+        for (size_t y = 0; y < output.height; y++)
+        {
+            for (size_t x = 0; x < output.width; x++)
+            {
+                const int32_t layerX = int32_t(x) + header.xMin - extents.xLower;
+                const int32_t layerY = int32_t(y) + header.yMin - extents.yLower;
+                const bool    inside = layerX >= 0 && layerY >= 0 &&
+                                    layerX < int32_t(layer.width) &&
+                                    layerY < int32_t(layer.height);
+                const uint8_t pixel = inside ? layer(size_t(layerX), size_t(layerY)) : 0;
+                // The S1 layer is drawn before the torso on odd frames, so it is hidden
+                uint8_t expected = pixel;
+                if (pixel && frame % 2 == 0) {
+                    expected = pl2->additiveBlend[pixel].indices[pixel];
+                    nbBlended++;
+                }
+                pixelsEqual &= output(x, y) == expected;
+            }
+        }
+    }
+    CHECK(pixelsEqual);
+    CHECK(nbBlended > 0);
+
+    SUBCASE("Cache")
+    {
+        CHECK(compositor.getCacheSize() == 1);
+        CHECK(compositor.getDirection(cof, dccs, direction) == composited);
+        CHECK(compositor.getCacheSize() == 1);
+
+        const COFCompositor::CompositedDirection* otherDirection =
+            compositor.getDirection(cof, dccs, direction + 1);
+        REQUIRE(otherDirection != nullptr);
+        CHECK(otherDirection != composited);
+        CHECK(compositor.getCacheSize() == 2);
+
+        // A different equipment set is composited again
+        COFCompositor::ComponentsDCCs torsoOnly{};
+        torsoOnly[componentTR] = &dcc;
+        const COFCompositor::CompositedDirection* torso =
+            compositor.getDirection(cof, torsoOnly, direction);
+        REQUIRE(torso != nullptr);
+        CHECK(compositor.getCacheSize() == 3);
+        CHECK(torso->pixels != composited->pixels);
+
+        compositor.clearCache();
+        CHECK(compositor.getCacheSize() == 0);
+    }
+
+    SUBCASE("Mismatching DCC")
+    {
+        DCC otherDCC;
+        REQUIRE(otherDCC.initDecoder(std::make_unique<FileStream>("CRHDBRVDTHTH.dcc")));
+        dccs[componentHD] = &otherDCC;
+        CHECK(compositor.getDirection(cof, dccs, direction) == nullptr);
+        CHECK(compositor.getCacheSize() == 1);
+    }
+}
@@ -0,0 +1,38 @@
+/**
+ * @file COFTestUtils.h
+ * @brief Helpers shared by the tests that need COF files.
+ */
+#pragma once
+
+#include <Vector.h>
+#include <cof.h>
+#include <string.h>
+
+namespace WorldStone
+{
+namespace Tests
+{
+/**Writes a COF file with the given layers, even and odd frames using different draw orders.
+ * @param header    The header of the file, header.layers must be the number of layers
+ * @param layers    The layers of the file
+ * @param evenOrder The layers draw order of the even frames of every direction
+ * @param oddOrder  The layers draw order of the odd frames of every direction
+ */
+inline Vector<uint8_t> makeCOF(const COF::Header& header, const Vector<COF::Layer>& layers,
+                               const Vector<uint8_t>& evenOrder, const Vector<uint8_t>& oddOrder)
+{
+    Vector<uint8_t> file(sizeof(header) + layers.size() * sizeof(COF::Layer) + header.frames);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), layers.data(), layers.size() * sizeof(COF::Layer));
+    for (size_t dir = 0; dir < header.directions; dir++)
+    {
+        for (size_t frame = 0; frame < header.frames; frame++)
+        {
+            const Vector<uint8_t>& order = frame % 2 ? oddOrder : evenOrder;
+            file.insert(file.end(), order.begin(), order.end());
+        }
+    }
+    return file;
+}
+} // namespace Tests
+} // namespace WorldStone
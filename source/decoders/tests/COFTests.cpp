@@ -0,0 +1,164 @@
+/**
+ * @file COFTests.cpp
+ * @brief Tests of the COF decoder and the loading of its components.
+ */
+#include <Archive.h>
+#include <FileStream.h>
+#include <MemoryStream.h>
+#include <TaskExecutor.h>
+#include <cof.h>
+#include <doctest.h>
+#include <string.h>
+#include <map>
+#include <mutex>
+#include "COFTestUtils.h"
+
+using WorldStone::Archive;
+using WorldStone::COF;
+using WorldStone::DCC;
+using WorldStone::FileStream;
+using WorldStone::MemoryStream;
+using WorldStone::SimpleImageProvider;
+using WorldStone::StreamPtr;
+using WorldStone::Tests::makeCOF;
+using WorldStone::Vector;
+
+namespace
+{
+/// Maps the paths of the game to the files of the working directory, and records the accesses
+class TestArchive : public Archive
+{
+    std::map<Path, Path> files;
+    std::mutex           openedMutex;
+
+protected:
+    bool load() override { return true; }
+    bool is_loaded() override { return true; }
+    bool unload() override { return true; }
+
+public:
+    Vector<Path> openedPaths;
+
+    explicit TestArchive(std::map<Path, Path> _files) : files(std::move(_files)) {}
+
+    bool exists(const Path& filePath) override { return files.count(filePath) != 0; }
+    StreamPtr open(const Path& filePath) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(openedMutex);
+            openedPaths.push_back(filePath);
+        }
+        auto file = files.find(filePath);
+        if (file == files.end()) return nullptr;
+        return std::make_unique<FileStream>(file->second);
+    }
+};
+} // namespace
+
+/**@testimpl{WorldStone::COF,COF_LoadComponents}
+ * Loads the components of a COF from an archive, with a missing head and concurrently.
+ */
+TEST_CASE("COF components loading")
+{
+    const char* trPath = "data\\global\\monsters\\HZ\\TR\\HZTRLITA1HTH.dcc";
+    const char* s1Path = "data\\global\\monsters\\HZ\\S1\\HZS1LITA11HS.dcc";
+    CHECK(COF::getComponentPath("data\\global\\monsters", "HZ", 1, "LIT", "A1", "HTH") == trPath);
+    const char unterminatedWeaponClass[4] = {'1', 'H', 'S', 'X'};
+    CHECK(COF::getComponentPath("data\\global\\monsters", "HZ", 8, "LIT", "A1",
+                                unterminatedWeaponClass) == s1Path);
+
+    TestArchive archive({{trPath, "HZTRLITA1HTH.dcc"}, {s1Path, "HZTRLITA1HTH.dcc"}});
+    DCC         dcc;
+    REQUIRE(dcc.initDecoder(std::make_unique<FileStream>("HZTRLITA1HTH.dcc")));
+
+    // The torso uses the weapon class of the animation, the S1 layer has its own
+    COF::Header header{};
+    header.layers     = 3;
+    header.frames     = uint8_t(dcc.getHeader().framesPerDir);
+    header.directions = dcc.getHeader().directions;
+    header.version    = 20;
+    header.animRate   = 256;
+    const Vector<COF::Layer> layers{{0, 1, 1, 0, 0, {'H', 'T', 'H', '\0'}},
+                                    {1, 1, 1, 0, 0, {'\0', '\0', '\0', '\0'}},
+                                    {8, 0, 0, 0, 0, {'1', 'H', 'S', '\0'}}};
+    COF cof;
+    REQUIRE(cof.read(
+        std::make_unique<MemoryStream>(makeCOF(header, layers, {0, 1, 8}, {0, 1, 8}))));
+
+    COF::Equipment equipment{};
+    equipment[1] = "LIT";
+    equipment[8] = "LIT";
+    const Vector<uint32_t> directions{5, 2};
+
+    COF::Components components;
+    REQUIRE(cof.loadComponents(archive, "HZ", "A1", "HTH", equipment, directions, components,
+                               WorldStone::makeThreadExecutor(4), "data\\global\\monsters"));
+    CHECK(archive.openedPaths.size() == 2);
+    for (size_t component = 0; component < COF::componentsNumber; component++)
+        CHECK((components[component] != nullptr) == (component == 1 || component == 8));
+    REQUIRE(components[1]);
+    REQUIRE(components[8]);
+    CHECK(components[1]->path == trPath);
+    CHECK(components[8]->path == s1Path);
+
+    bool framesEqual = true;
+    for (size_t dirIndex = 0; dirIndex < directions.size(); dirIndex++)
+    {
+        DCC::Direction               dir;
+        SimpleImageProvider<uint8_t> expected;
+        REQUIRE(dcc.readDirection(dir, directions[dirIndex], expected));
+        for (size_t component : {1, 8})
+        {
+            const SimpleImageProvider<uint8_t>& frames = components[component]->frames[dirIndex];
+            REQUIRE(frames.getImagesNumber() == expected.getImagesNumber());
+            CHECK(components[component]->directions[dirIndex].extents.width() ==
+                  dir.extents.width());
+            for (size_t frame = 0; frame < frames.getImagesNumber(); frame++)
+            {
+                const auto expectedFrame =
+                    static_cast<const SimpleImageProvider<uint8_t>&>(expected).getImage(frame);
+                const auto frameImage = frames.getImage(frame);
+                framesEqual &= frameImage.width == expectedFrame.width &&
+                               frameImage.height == expectedFrame.height &&
+                               memcmp(frameImage.buffer, expectedFrame.buffer,
+                                      frameImage.width * frameImage.height) == 0;
+            }
+        }
+    }
+    CHECK(framesEqual);
+
+    SUBCASE("Missing component")
+    {
+        equipment[0] = "LIT";
+        CHECK_FALSE(cof.loadComponents(archive, "HZ", "A1", "HTH", equipment, directions,
+                                       components, WorldStone::makeThreadExecutor(4),
+                                       "data\\global\\monsters"));
+        REQUIRE(components[0]);
+        CHECK(components[0]->path == "data\\global\\monsters\\HZ\\HD\\HZHDLITA1HTH.dcc");
+    }
+
+    SUBCASE("Invalid direction")
+    {
+        CHECK_FALSE(cof.loadComponents(archive, "HZ", "A1", "HTH", equipment, {100}, components,
+                                       WorldStone::sequentialExecutor, "data\\global\\monsters"));
+    }
+
+    SUBCASE("Several layers of the same component")
+    {
+        // The second torso layer would use a file that does not exist
+        Vector<COF::Layer> duplicatedLayers = layers;
+        duplicatedLayers.push_back({1, 1, 1, 0, 0, {'1', 'H', 'S', '\0'}});
+        header.layers = uint8_t(duplicatedLayers.size());
+        COF duplicatedCOF;
+        REQUIRE(duplicatedCOF.read(std::make_unique<MemoryStream>(
+            makeCOF(header, duplicatedLayers, {0, 1, 8, 1}, {0, 1, 8, 1}))));
+
+        archive.openedPaths.clear();
+        REQUIRE(duplicatedCOF.loadComponents(archive, "HZ", "A1", "HTH", equipment, directions,
+                                             components, WorldStone::makeThreadExecutor(4),
+                                             "data\\global\\monsters"));
+        CHECK(archive.openedPaths.size() == 2);
+        REQUIRE(components[1]);
+        CHECK(components[1]->path == trPath);
+    }
+}
@@ -0,0 +1,605 @@
+/**
+ * @file DC6Tests.cpp
+ * @brief Tests of the DC6 decoder, using files built in memory.
+ */
+#include <MemoryStream.h>
+#include <dc6.h>
+#include <doctest.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <stddef.h>
+#include <string.h>
+
+using WorldStone::DC6;
+using WorldStone::ImageView;
+using WorldStone::MemoryStream;
+using WorldStone::Vector;
+
+namespace
+{
+/// A frame of a test file, pixels are stored from top to bottom
+struct TestFrame
+{
+    int32_t         width;
+    int32_t         height;
+    Vector<uint8_t> pixels;
+};
+
+template<class T>
+void appendRaw(Vector<uint8_t>& out, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+/// Encodes the rows of a frame from the bottom to the top like the game files, unless flipped
+Vector<uint8_t> encodeFrameRLE(const TestFrame& frame, bool flip)
+{
+    Vector<uint8_t> data;
+    for (int32_t rowIndex = 0; rowIndex < frame.height; rowIndex++)
+    {
+        const int32_t  y   = flip ? rowIndex : frame.height - 1 - rowIndex;
+        const uint8_t* row = frame.pixels.data() + y * frame.width;
+        int32_t        x   = 0;
+        while (x < frame.width)
+        {
+            const bool transparent = row[x] == 0;
+            int32_t    runEnd      = x;
+            while (runEnd < frame.width && (row[runEnd] == 0) == transparent && runEnd - x < 0x7F)
+                runEnd++;
+            if (transparent) {
+                if (runEnd != frame.width) data.push_back(uint8_t(0x80 | (runEnd - x)));
+            }
+            else
+            {
+                data.push_back(uint8_t(runEnd - x));
+                data.insert(data.end(), row + x, row + runEnd);
+            }
+            x = runEnd;
+        }
+        data.push_back(0x80);
+    }
+    return data;
+}
+
+/**Builds a DC6 file.
+ * @param leadingZeros If true, frames data is preceded by 3 zeros, like the D2:Remaster files.
+ *                     Otherwise followed by 3 bytes of garbage like the original game files.
+ * @param flip         If true, scanlines are stored from top to bottom
+ */
+Vector<uint8_t> makeDC6(uint32_t directions, const Vector<TestFrame>& frames, bool leadingZeros,
+                        bool flip = false)
+{
+    DC6::Header header{6, DC6::IsSerialized, 0, {0xEE, 0xEE, 0xEE, 0xEE}, directions,
+                       uint32_t(frames.size()) / directions};
+    Vector<uint8_t> file;
+    appendRaw(file, header);
+    const size_t pointersPos = file.size();
+    file.resize(file.size() + frames.size() * sizeof(uint32_t));
+    for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+    {
+        const uint32_t framePointer = uint32_t(file.size());
+        memcpy(&file[pointersPos + frameIndex * sizeof(uint32_t)], &framePointer,
+               sizeof(framePointer));
+
+        const TestFrame&      frame = frames[frameIndex];
+        const Vector<uint8_t> data  = encodeFrameRLE(frame, flip);
+        DC6::FrameHeader      frameHeader{flip, frame.width, frame.height, 0, 0, 0, 0,
+                                     uint32_t(data.size())};
+        frameHeader.nextBlock = int32_t(framePointer + sizeof(frameHeader) + data.size() + 3);
+        appendRaw(file, frameHeader);
+        if (leadingZeros) file.insert(file.end(), 3, 0);
+        file.insert(file.end(), data.begin(), data.end());
+        if (!leadingZeros) file.insert(file.end(), 3, 0xEE);
+    }
+    return file;
+}
+
+/// Frames with transparent runs, long color runs and fully transparent rows
+Vector<TestFrame> makeTestFrames(size_t nbFrames)
+{
+    Vector<TestFrame> frames;
+    for (size_t frameIndex = 0; frameIndex < nbFrames; frameIndex++)
+    {
+        TestFrame frame{int32_t(140 + frameIndex), int32_t(5 + frameIndex), {}};
+        frame.pixels.resize(size_t(frame.width * frame.height));
+        for (size_t pixelIndex = 0; pixelIndex < frame.pixels.size(); pixelIndex++)
+        {
+            const size_t x = pixelIndex % size_t(frame.width);
+            const size_t y = pixelIndex / size_t(frame.width);
+            if (y != 1 && (x + y * 3 + frameIndex) % 11 < 8)
+                frame.pixels[pixelIndex] = uint8_t(1 + (pixelIndex * 13 + frameIndex) % 255);
+        }
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+/// Frames shaped like an ellipse filling the frame, with random colors and a few holes
+Vector<TestFrame> makeEllipseFrames(size_t nbFrames, int32_t width, int32_t height)
+{
+    std::minstd_rand                       random(1);
+    std::uniform_int_distribution<int>     color(1, 255);
+    std::uniform_real_distribution<double> hole(0., 1.);
+    Vector<TestFrame>                      frames;
+    for (size_t frameIndex = 0; frameIndex < nbFrames; frameIndex++)
+    {
+        TestFrame frame{width, height, Vector<uint8_t>(size_t(width * height), 0)};
+        for (int32_t y = 0; y < height; y++)
+        {
+            for (int32_t x = 0; x < width; x++)
+            {
+                const double dx = (x - width / 2.) / (width / 2.);
+                const double dy = (y - height / 2.) / (height / 2.);
+                if (dx * dx + dy * dy < 1. && hole(random) > 0.1)
+                    frame.pixels[size_t(y * width + x)] = uint8_t(color(random));
+            }
+        }
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+/// Gives images with a stride bigger than their width, filled with garbage
+class PaddedImageProvider : public WorldStone::IImageProvider<uint8_t>
+{
+public:
+    static constexpr size_t padding = 7;
+    Vector<Vector<uint8_t>> buffers;
+    Vector<ImageView<uint8_t>> images;
+
+    ImageView<uint8_t> getNewImage(size_t width, size_t height) override
+    {
+        buffers.emplace_back((width + padding) * height, uint8_t(0xCD));
+        images.emplace_back(buffers.back().data(), width, height, width + padding);
+        return images.back();
+    }
+};
+} // namespace
+
+/**@testimpl{WorldStone::DC6,DC6_Decoding}
+ * Frames must be decoded from both the original and the D2:Remaster layouts, and invalid data
+ * must be reported.
+ */
+TEST_CASE("DC6 decoding")
+{
+    const Vector<TestFrame> frames = makeTestFrames(6);
+    for (bool leadingZeros : {false, true})
+    {
+        CAPTURE(leadingZeros);
+        DC6 dc6;
+        REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(makeDC6(2, frames, leadingZeros))));
+        CHECK(dc6.getHeader().directions == 2);
+        CHECK(dc6.getHeader().framesPerDir == 3);
+        REQUIRE(dc6.getFrameHeaders().size() == frames.size());
+
+        bool allFramesEqual = true;
+        for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+        {
+            const DC6::FrameHeader& frameHeader = dc6.getFrameHeaders()[frameIndex];
+            CHECK(frameHeader.width == frames[frameIndex].width);
+            CHECK(frameHeader.height == frames[frameIndex].height);
+            allFramesEqual &= dc6.decompressFrame(frameIndex) == frames[frameIndex].pixels;
+        }
+        CHECK(allFramesEqual);
+    }
+    SUBCASE("Invalid files")
+    {
+        Vector<uint8_t> file = makeDC6(2, frames, false);
+        DC6             truncatedHeaders;
+        CHECK_FALSE(truncatedHeaders.initDecoder(
+            std::make_unique<MemoryStream>(Vector<uint8_t>(file.begin(), file.begin() + 40))));
+
+        // Frame data going past the end of the file
+        DC6 truncatedData;
+        REQUIRE(truncatedData.initDecoder(
+            std::make_unique<MemoryStream>(Vector<uint8_t>(file.begin(), file.end() - 20))));
+        CHECK(truncatedData.decompressFrame(frames.size() - 1).empty());
+
+        // Run of colors wider than the frame
+        const size_t  firstFramePos = sizeof(DC6::Header) + frames.size() * sizeof(uint32_t);
+        const uint8_t firstRunSize  = file[firstFramePos + sizeof(DC6::FrameHeader)];
+        REQUIRE(firstRunSize > 1);
+        REQUIRE(firstRunSize < 0x80);
+        const int32_t smallerWidth = firstRunSize - 1;
+        memcpy(&file[firstFramePos + offsetof(DC6::FrameHeader, width)], &smallerWidth,
+               sizeof(smallerWidth));
+        DC6 invalidRun;
+        REQUIRE(invalidRun.initDecoder(std::make_unique<MemoryStream>(file)));
+        CHECK(invalidRun.decompressFrame(0).empty());
+        CHECK(invalidRun.decompressFrame(1) == frames[1].pixels);
+    }
+}
+
+/**@testimpl{WorldStone::DC6,DC6_DecodingInView}
+ * Frames must be written in views with any stride, top to bottom even if stored flipped.
+ */
+TEST_CASE("DC6 decoding in ImageView")
+{
+    const Vector<TestFrame> frames = makeTestFrames(3);
+    for (bool flip : {false, true})
+    {
+        CAPTURE(flip);
+        DC6 dc6;
+        REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(makeDC6(1, frames, false, flip))));
+        for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+        {
+            CAPTURE(frameIndex);
+            const TestFrame& frame = frames[frameIndex];
+            const size_t     width = size_t(frame.width), height = size_t(frame.height);
+            // Decode in the middle of a bigger image, whose borders must not be touched
+            Vector<uint8_t>          atlas((width + 10) * (height + 4), uint8_t(0xCD));
+            const ImageView<uint8_t> atlasView{atlas.data(), width + 10, height + 4, width + 10};
+            ImageView<uint8_t>       frameView = atlasView.subView(3, 2, width, height);
+            frameView.fillBytes(0, 0, width, height, 0);
+            REQUIRE(dc6.decompressFrameIn(frameIndex, frameView));
+
+            bool pixelsEqual = true, bordersUntouched = true;
+            for (size_t y = 0; y < atlasView.height; y++)
+            {
+                for (size_t x = 0; x < atlasView.width; x++)
+                {
+                    const bool inFrame = x >= 3 && x < 3 + width && y >= 2 && y < 2 + height;
+                    if (inFrame)
+                        pixelsEqual &= atlasView(x, y) == frame.pixels[x - 3 + (y - 2) * width];
+                    else
+                        bordersUntouched &= atlasView(x, y) == 0xCD;
+                }
+            }
+            CHECK(pixelsEqual);
+            CHECK(bordersUntouched);
+            const ImageView<uint8_t> tooSmall = atlasView.subView(0, 0, width, height - 1);
+            CHECK_FALSE(dc6.decompressFrameIn(frameIndex, tooSmall));
+        }
+    }
+}
+
+/**@testimpl{WorldStone::DC6,DC6_DecodingColors}
+ * Decoding to colors must give the colors of the decoded indices, transparent ones included.
+ */
+TEST_CASE("DC6 decoding colors")
+{
+    using WorldStone::Palette;
+    Palette palette;
+    for (size_t i = 0; i < Palette::colorCount; i++)
+        palette.colors[i] = {uint8_t(i), uint8_t(i * 3), uint8_t(255 - i), 0};
+    WorldStone::PalShiftTransform shift;
+    for (size_t i = 0; i < Palette::colorCount; i++)
+        shift.indices[i] = uint8_t(i ^ 0x55);
+    const WorldStone::ColorLookupTable colors(palette, shift);
+    const Palette::Color               garbage{1, 2, 3, 4};
+
+    const Vector<TestFrame> frames = makeTestFrames(3);
+    for (bool flip : {false, true})
+    {
+        CAPTURE(flip);
+        DC6 dc6;
+        REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(makeDC6(1, frames, false, flip))));
+        for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+        {
+            CAPTURE(frameIndex);
+            const TestFrame& frame  = frames[frameIndex];
+            const size_t     width  = size_t(frame.width);
+            const size_t     stride = width + 5;
+            Vector<Palette::Color> pixels(stride * size_t(frame.height), garbage);
+            const ImageView<Palette::Color> image{pixels.data(), width, size_t(frame.height),
+                                                  stride};
+            REQUIRE(dc6.decompressFrameIn(frameIndex, image, colors));
+
+            bool colorsEqual = true, paddingUntouched = true;
+            for (size_t y = 0; y < image.height; y++)
+            {
+                for (size_t x = 0; x < stride; x++)
+                {
+                    const Palette::Color color = pixels[x + y * stride];
+                    if (x >= width) {
+                        paddingUntouched &= color == garbage && color._padding == 4;
+                        continue;
+                    }
+                    const Palette::Color expected = colors.colors[frame.pixels[x + y * width]];
+                    colorsEqual &= color == expected && color._padding == expected._padding;
+                }
+            }
+            CHECK(colorsEqual);
+            CHECK(paddingUntouched);
+        }
+    }
+}
+
+/**@testimpl{WorldStone::DC6,DC6_Trim}
+ * Trimmed frames must have the same pixels at the same position on screen.
+ */
+TEST_CASE("DC6 frames trimming")
+{
+    // Frames with transparent columns on both sides
+    Vector<TestFrame> frames = makeTestFrames(2);
+    for (TestFrame& frame : frames)
+    {
+        for (size_t y = 0; y < size_t(frame.height); y++)
+        {
+            frame.pixels[y * size_t(frame.width)]                           = 0;
+            frame.pixels[y * size_t(frame.width) + size_t(frame.width) - 1] = 0;
+        }
+    }
+    frames.push_back({8, 3, Vector<uint8_t>(24, 0)}); // Fully transparent
+    for (bool flip : {false, true})
+    {
+        CAPTURE(flip);
+        DC6 dc6;
+        REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(makeDC6(1, frames, false, flip))));
+        WorldStone::SimpleImageProvider<uint8_t> images;
+        REQUIRE(dc6.decompressAllFrames(images));
+        std::vector<DC6::FrameHeader> trimmedHeaders;
+        CHECK(dc6.trimFrames(images, trimmedHeaders) > 0);
+        REQUIRE(trimmedHeaders.size() == frames.size());
+
+        bool allPixelsKept = true;
+        for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+        {
+            const TestFrame&               frame   = frames[frameIndex];
+            const DC6::FrameHeader&        header  = dc6.getFrameHeaders()[frameIndex];
+            const DC6::FrameHeader&        trimmed = trimmedHeaders[frameIndex];
+            const ImageView<const uint8_t> image =
+                static_cast<const WorldStone::SimpleImageProvider<uint8_t>&>(images).getImage(
+                    frameIndex);
+            REQUIRE(size_t(trimmed.width) == image.width);
+            REQUIRE(size_t(trimmed.height) == image.height);
+            // Top edges on screen
+            const int32_t top        = flip ? header.offsetY : header.offsetY - header.height;
+            const int32_t trimmedTop = flip ? trimmed.offsetY : trimmed.offsetY - trimmed.height;
+            for (int32_t y = 0; y < frame.height; y++)
+            {
+                for (int32_t x = 0; x < frame.width; x++)
+                {
+                    const int32_t trimmedX = x + header.offsetX - trimmed.offsetX;
+                    const int32_t trimmedY = y + top - trimmedTop;
+                    const bool    inside   = trimmedX >= 0 && trimmedY >= 0 &&
+                                        trimmedX < trimmed.width && trimmedY < trimmed.height;
+                    const uint8_t trimmedPixel =
+                        inside ? image(size_t(trimmedX), size_t(trimmedY)) : uint8_t(0);
+                    allPixelsKept &= frame.pixels[size_t(x + y * frame.width)] == trimmedPixel;
+                }
+            }
+        }
+        CHECK(allPixelsKept);
+        CHECK(trimmedHeaders.back().width == 0);
+        CHECK(trimmedHeaders[0].width == frames[0].width - 2);
+        CHECK(trimmedHeaders[0].height == frames[0].height);
+    }
+}
+
+/**@testimpl{WorldStone::DC6,DC6_DecodingRuns}
+ * Decoding frames as runs must give the same pixels as decoding them to images.
+ */
+TEST_CASE("DC6 decoding runs")
+{
+    Vector<TestFrame> frames = makeTestFrames(3);
+    // Opaque scanlines wider than the longest run of the file format
+    frames.push_back({300, 2, Vector<uint8_t>(600, uint8_t(42))});
+    for (bool flip : {false, true})
+    {
+        CAPTURE(flip);
+        DC6 dc6;
+        REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(makeDC6(1, frames, true, flip))));
+        WorldStone::RunListSprite sprite;
+        for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+        {
+            CAPTURE(frameIndex);
+            const TestFrame& frame = frames[frameIndex];
+            REQUIRE(dc6.decompressFrameRuns(frameIndex, sprite));
+            REQUIRE(sprite.width == frame.width);
+            REQUIRE(sprite.height == frame.height);
+            // Runs longer than 0x7F are split in the file but not in the sprite
+            const WorldStone::RunListSprite fromImage = WorldStone::RunListSprite::fromImage(
+                {frame.pixels.data(), sprite.width, sprite.height, sprite.width});
+            CHECK(sprite.firstRun == fromImage.firstRun);
+            CHECK(sprite.pixels.size() == fromImage.pixels.size());
+
+            Vector<uint8_t> pixels(frame.pixels.size(), 0);
+            sprite.blitTo(ImageView<uint8_t>{pixels.data(), sprite.width, sprite.height,
+                                             sprite.width},
+                          0, 0);
+            CHECK(pixels == frame.pixels);
+        }
+    }
+}
+
+/**@testimpl{WorldStone::DC6,DC6_DecompressAllFrames}
+ * Decoding all the frames concurrently must give the same result as decoding them one by one.
+ */
+TEST_CASE("DC6 decompressAllFrames")
+{
+    const Vector<TestFrame> frames = makeTestFrames(8);
+    DC6                     dc6;
+    REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(makeDC6(4, frames, true))));
+    for (size_t nbThreads : {1, 4})
+    {
+        CAPTURE(nbThreads);
+        PaddedImageProvider provider;
+        CHECK(dc6.decompressAllFrames(provider, WorldStone::makeThreadExecutor(nbThreads)));
+        REQUIRE(provider.images.size() == frames.size());
+
+        bool allFramesEqual = true;
+        for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+        {
+            const TestFrame&         frame = frames[frameIndex];
+            const ImageView<uint8_t> image = provider.images[frameIndex];
+            REQUIRE(image.width == size_t(frame.width));
+            REQUIRE(image.height == size_t(frame.height));
+            for (size_t y = 0; y < image.height; y++)
+            {
+                allFramesEqual &= std::equal(frame.pixels.begin() + ptrdiff_t(y * image.width),
+                                             frame.pixels.begin() + ptrdiff_t((y + 1) * image.width),
+                                             &image(0, y));
+            }
+        }
+        CHECK(allFramesEqual);
+    }
+    SUBCASE("Invalid frame")
+    {
+        Vector<uint8_t> file = makeDC6(4, frames, true);
+        file.resize(file.size() - 20);
+        DC6 truncated;
+        REQUIRE(truncated.initDecoder(std::make_unique<MemoryStream>(file)));
+        WorldStone::SimpleImageProvider<uint8_t> provider;
+        CHECK_FALSE(truncated.decompressAllFrames(provider));
+        CHECK(provider.getImagesNumber() == frames.size());
+    }
+}
+
+/**@testimpl{WorldStone::DC6,DC6_Encoder}
+ * A frame assembled by hand the way the game files encode it must be encoded back to the same
+ * bytes. Files built by makeDC6 must decode to the same frames once encoded, in both layouts.
+ */
+TEST_CASE("DC6 encoding")
+{
+    // A 300x3 frame, the scanlines are stored from the bottom to the top
+    Vector<uint8_t> gameData;
+    // 130 pixels of color 9 need 2 runs, the 170 transparent pixels at the end are not encoded
+    gameData.push_back(0x7F);
+    gameData.insert(gameData.end(), 127, uint8_t(9));
+    gameData.insert(gameData.end(), {0x03, 9, 9, 9, 0x80});
+    // A fully transparent scanline
+    gameData.push_back(0x80);
+    // 140 transparent pixels need 2 runs, then 10 pixels of color 5
+    gameData.insert(gameData.end(), {0xFF, 0x8D, 0x0A});
+    gameData.insert(gameData.end(), 10, uint8_t(5));
+    gameData.push_back(0x80);
+
+    Vector<uint8_t> gameFile;
+    for (int32_t value : {6, 1, 0}) // version, flags, format
+        appendRaw(gameFile, value);
+    gameFile.insert(gameFile.end(), 4, uint8_t(0xEE)); // skipColor
+    for (uint32_t value : {1u, 1u, 28u}) // directions, framesPerDir, frame pointer
+        appendRaw(gameFile, value);
+    const int32_t nextBlock = int32_t(28 + 32 + gameData.size() + 3);
+    // flip, width, height, offsetX, offsetY, allocSize, nextBlock, length
+    for (int32_t value : {0, 300, 3, -150, 40, 0, nextBlock, int32_t(gameData.size())})
+        appendRaw(gameFile, value);
+    gameFile.insert(gameFile.end(), gameData.begin(), gameData.end());
+    gameFile.insert(gameFile.end(), 3, uint8_t(0xEE));
+
+    DC6 gameDC6;
+    REQUIRE(gameDC6.initDecoder(std::make_unique<MemoryStream>(gameFile)));
+    Vector<uint8_t> gamePixels = gameDC6.decompressFrame(0);
+    REQUIRE(gamePixels.size() == 900);
+    CHECK(std::count(gamePixels.begin(), gamePixels.end(), uint8_t(5)) == 10);
+    CHECK(gamePixels[140] == 5);
+    CHECK(std::count(gamePixels.begin(), gamePixels.end(), uint8_t(9)) == 130);
+    CHECK(gamePixels[600 + 129] == 9);
+    std::vector<uint8_t> gameEncoded;
+    REQUIRE(DC6::encode(gameDC6.getHeader(),
+                        {{{gamePixels.data(), 300, 3, 300}, gameDC6.getFrameHeaders()[0]}},
+                        gameEncoded));
+    CHECK(gameEncoded == gameFile);
+
+    Vector<TestFrame> frames = makeTestFrames(5);
+    // Runs longer than what a control byte can describe, and trailing transparent pixels
+    TestFrame longRuns{300, 3, Vector<uint8_t>(900, uint8_t(7))};
+    std::fill(longRuns.pixels.begin() + 310, longRuns.pixels.begin() + 590, uint8_t(0));
+    std::fill(longRuns.pixels.begin() + 700, longRuns.pixels.end(), uint8_t(0));
+    frames.push_back(std::move(longRuns));
+    for (bool leadingZeros : {false, true})
+    {
+        for (bool flip : {false, true})
+        {
+            CAPTURE(leadingZeros);
+            CAPTURE(flip);
+            const Vector<uint8_t> file = makeDC6(3, frames, leadingZeros, flip);
+            DC6                   dc6;
+            REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(file)));
+
+            Vector<Vector<uint8_t>>        images;
+            std::vector<DC6::EncoderFrame> encoderFrames;
+            for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+            {
+                const DC6::FrameHeader& header = dc6.getFrameHeaders()[frameIndex];
+                images.push_back(dc6.decompressFrame(frameIndex));
+                const size_t width = size_t(header.width), height = size_t(header.height);
+                encoderFrames.push_back({{images.back().data(), width, height, width}, header});
+            }
+            // Reallocations moved the images
+            for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+                encoderFrames[frameIndex].image.buffer = images[frameIndex].data();
+
+            const DC6::Layout layout = leadingZeros ? DC6::Layout::Remaster : DC6::Layout::Original;
+            std::vector<uint8_t> encoded;
+            REQUIRE(DC6::encode(dc6.getHeader(), encoderFrames, encoded, layout,
+                                WorldStone::makeThreadExecutor(3)));
+            // makeDC6 encodes the first 127 trailing transparent pixels of wide scanlines
+            CHECK(encoded.size() < file.size());
+
+            DC6 encodedDC6;
+            REQUIRE(encodedDC6.initDecoder(std::make_unique<MemoryStream>(encoded)));
+            bool allFramesEqual = true;
+            for (size_t frameIndex = 0; frameIndex < frames.size(); frameIndex++)
+            {
+                const DC6::FrameHeader& header        = dc6.getFrameHeaders()[frameIndex];
+                const DC6::FrameHeader& encodedHeader = encodedDC6.getFrameHeaders()[frameIndex];
+                allFramesEqual &= encodedDC6.decompressFrame(frameIndex) == images[frameIndex] &&
+                                  encodedHeader.flip == header.flip &&
+                                  encodedHeader.width == header.width &&
+                                  encodedHeader.height == header.height;
+            }
+            CHECK(allFramesEqual);
+        }
+    }
+    SUBCASE("Empty frames and invalid inputs")
+    {
+        DC6::Header header{6, DC6::IsSerialized, 0, {0xEE, 0xEE, 0xEE, 0xEE}, 1, 2};
+        const TestFrame& frame = frames[0];
+        std::vector<DC6::EncoderFrame> encoderFrames(2);
+        encoderFrames[0].image = {frame.pixels.data(), size_t(frame.width),
+                                  size_t(frame.height), size_t(frame.width)};
+        encoderFrames[0].header.offsetX = -5;
+        encoderFrames[0].header.offsetY = 12;
+
+        std::vector<uint8_t> encoded;
+        REQUIRE(DC6::encode(header, encoderFrames, encoded));
+        DC6 dc6;
+        REQUIRE(dc6.initDecoder(std::make_unique<MemoryStream>(encoded)));
+        CHECK(dc6.decompressFrame(0) == frame.pixels);
+        CHECK(dc6.getFrameHeaders()[0].offsetX == -5);
+        CHECK(dc6.getFrameHeaders()[0].offsetY == 12);
+        CHECK(dc6.getFrameHeaders()[1].width == 0);
+        CHECK(dc6.getFrameHeaders()[1].length == 0);
+
+        header.framesPerDir = 3;
+        CHECK_FALSE(DC6::encode(header, encoderFrames, encoded));
+    }
+}
+
+/**Measures the time needed to read and decode a large file, 8 directions of 16 frames of 256x256.
+ * Disabled by default, run it with --no-skip on a release build to compare decoder changes.
+ */
+TEST_CASE("DC6 decoding benchmark" * doctest::skip())
+{
+    constexpr int         nbRuns = 20;
+    const Vector<uint8_t> file   = makeDC6(8, makeEllipseFrames(8 * 16, 256, 256), false);
+
+    double bestInitTime   = std::numeric_limits<double>::max();
+    double bestDecodeTime = std::numeric_limits<double>::max();
+    for (int run = 0; run < nbRuns; run++)
+    {
+        DC6                   dc6;
+        WorldStone::StreamPtr stream = std::make_unique<MemoryStream>(file);
+        const auto            start  = std::chrono::steady_clock::now();
+        REQUIRE(dc6.initDecoder(std::move(stream)));
+        const auto initEnd = std::chrono::steady_clock::now();
+        bool       success = true;
+        for (size_t frameIndex = 0; frameIndex < dc6.getFrameHeaders().size(); frameIndex++)
+            success &= !dc6.decompressFrame(frameIndex).empty();
+        const auto decodeEnd = std::chrono::steady_clock::now();
+        REQUIRE(success);
+
+        const std::chrono::duration<double, std::milli> initTime   = initEnd - start;
+        const std::chrono::duration<double, std::milli> decodeTime = decodeEnd - initEnd;
+        bestInitTime   = std::min(bestInitTime, initTime.count());
+        bestDecodeTime = std::min(bestDecodeTime, decodeTime.count());
+    }
+    MESSAGE(file.size() << " bytes file, best of " << nbRuns << " runs: initDecoder "
+                        << bestInitTime << " ms, decompressFrame of all frames " << bestDecodeTime
+                        << " ms");
+}
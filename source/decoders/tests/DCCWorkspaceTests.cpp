@@ -0,0 +1,123 @@
+/**
+ * @file DCCWorkspaceTests.cpp
+ * @brief Checks that the DCC decoder does not allocate memory when using a DCCDecodeWorkspace.
+ */
+#include <Platform.h>
+#include <dcc.h>
+#include <doctest.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+using WorldStone::DCC;
+using WorldStone::DCCDecodeWorkspace;
+using WorldStone::FileStream;
+using WorldStone::ImageView;
+using WorldStone::SimpleImageProvider;
+
+// Replace the global allocation functions to count the number of allocations.
+// Note that this applies to the whole test executable, including the tests using threads.
+static std::atomic<size_t> allocationsCount{0};
+
+// GCC can not tell that the replaced operator new uses malloc
+WS_PRAGMA_DIAGNOSTIC_PUSH()
+WS_PRAGMA_DIAGNOSTIC_IGNORED_GNU("-Wmismatched-new-delete")
+void* operator new(size_t size)
+{
+    allocationsCount++;
+    if (void* ptr = malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc{};
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+WS_PRAGMA_DIAGNOSTIC_POP()
+
+/// An image provider that gives views of a preallocated buffer, and thus never allocates memory
+class PreallocatedImageProvider : public WorldStone::IImageProvider<uint8_t>
+{
+    WorldStone::Vector<uint8_t> buffer;
+    size_t                      usedSize = 0;
+
+public:
+    explicit PreallocatedImageProvider(size_t size) : buffer(size) {}
+
+    /// Release all the images, so that their memory can be used again
+    void reset() { usedSize = 0; }
+    /// Returns the pixels of the images, in allocation order
+    const uint8_t* data() const { return buffer.data(); }
+
+    ImageView<uint8_t> getNewImage(size_t width, size_t height) override
+    {
+        if (!width || !height || usedSize + width * height > buffer.size()) return {};
+        ImageView<uint8_t> image{buffer.data() + usedSize, width, height, width};
+        usedSize += width * height;
+        return image;
+    }
+};
+
+/**@testimpl{WorldStone::DCCDecodeWorkspace,DCC_Workspace}
+ * Decode all the directions of the test files twice with the same workspace. The second time,
+ * no memory should be allocated since the workspace buffers are big enough.
+ */
+TEST_CASE("DCC decoding with a workspace does not allocate")
+{
+    const char* filenames[] = {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "BloodSmall01.dcc",
+                               "HZTRLITA1HTH.dcc"};
+    DCC decoders[4];
+    for (size_t fileIndex = 0; fileIndex < 4; fileIndex++)
+    {
+        REQUIRE(decoders[fileIndex].initDecoder(
+            std::make_unique<FileStream>(filenames[fileIndex])));
+    }
+
+    DCCDecodeWorkspace        workspace;
+    DCC::Direction            dir;
+    PreallocatedImageProvider imgProvider{16 * 1024 * 1024};
+    DCC::DecodeOptions        options;
+    options.images    = &imgProvider;
+    options.workspace = &workspace;
+
+    const auto decodeAllDirections = [&]() {
+        bool success = true;
+        for (DCC& dcc : decoders)
+        {
+            for (uint32_t dirIndex = 0; dirIndex < dcc.getHeader().directions; dirIndex++)
+            {
+                imgProvider.reset();
+                success &= dcc.readDirection(dir, dirIndex, options);
+            }
+        }
+        return success;
+    };
+
+    // Warm up the workspace buffers
+    REQUIRE(decodeAllDirections());
+
+    const size_t allocationsBefore = allocationsCount;
+    const bool   success           = decodeAllDirections();
+    const size_t allocationsDuring = allocationsCount - allocationsBefore;
+    REQUIRE(success);
+    CHECK(allocationsDuring == 0);
+
+    // The reused buffers must not change the result
+    SimpleImageProvider<uint8_t> expectedImages;
+    DCC::Direction               expectedDir;
+    REQUIRE(decoders[0].readDirection(expectedDir, 0, expectedImages));
+    imgProvider.reset();
+    REQUIRE(decoders[0].readDirection(dir, 0, options));
+    // Images are allocated contiguously in the preallocated buffer
+    const uint8_t* decodedPixels = imgProvider.data();
+    bool           allFramesEqual = true;
+    for (size_t imageIndex = 0; imageIndex < expectedImages.getImagesNumber(); imageIndex++)
+    {
+        const ImageView<const uint8_t> expected  = expectedImages.getImage(imageIndex);
+        const size_t                   imageSize = expected.width * expected.height;
+        allFramesEqual &= std::equal(expected.buffer, expected.buffer + imageSize, decodedPixels);
+        decodedPixels += imageSize;
+    }
+    CHECK(allFramesEqual);
+}
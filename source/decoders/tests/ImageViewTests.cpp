@@ -128,3 +128,68 @@ TEST_CASE("SimpleImageViewProvider")
         CHECK(imageProvider.getImagesNumber() == 0);
     }
 }
+
+/**@testimpl{WorldStone::computeOpaqueBounds(),OpaqueBounds}
+ * The bounds must be tight, whatever the position of the pixels relative to the 8 bytes words.
+ */
+TEST_CASE("Opaque bounds")
+{
+    constexpr size_t width = 37, height = 11, stride = 40;
+    Vector<uint8_t>  buffer(stride * height, 0);
+    // Bytes of the stride padding must be ignored
+    for (size_t y = 0; y < height; y++)
+        buffer[y * stride + width] = 0xFF;
+    const ImmutableImageView image{buffer.data(), width, height, stride};
+
+    WorldStone::ImageRect bounds = WorldStone::computeOpaqueBounds(image);
+    CHECK(bounds.width == 0);
+    CHECK(bounds.height == 0);
+
+    bool allBoundsTight = true;
+    for (size_t firstX : {0, 5, 8, 17})
+    {
+        for (size_t lastX : {firstX, size_t(23), width - 1})
+        {
+            std::fill(buffer.begin(), buffer.end(), uint8_t(0));
+            buffer[firstX + 4 * stride]               = 1;
+            buffer[lastX + 7 * stride]                = 2;
+            buffer[(firstX + lastX) / 2 + 5 * stride] = 3;
+            bounds = WorldStone::computeOpaqueBounds(image);
+            allBoundsTight &= bounds.x == firstX && bounds.width == lastX + 1 - firstX &&
+                              bounds.y == 4 && bounds.height == 4;
+        }
+    }
+    CHECK(allBoundsTight);
+}
+
+/**@testimpl{WorldStone::SimpleImageProvider,TrimImages}
+ * Trimmed images must keep all their opaque pixels and report their position.
+ */
+TEST_CASE("SimpleImageProvider trimming")
+{
+    SimpleImageProvider<uint8_t> imageProvider;
+    ImageView<uint8_t>           image = imageProvider.getNewImage(20, 10);
+    image(3, 2)                  = 1;
+    image(12, 6)                 = 2;
+    imageProvider.getNewImage(5, 5); // Fully transparent
+    image = imageProvider.getNewImage(4, 3);
+    image.fillBytes(0, 0, 4, 3, 9); // Fully opaque
+
+    CHECK(imageProvider.trimImages() == (20 * 10 - 10 * 5) + 5 * 5);
+    const ImmutableImageView trimmed = imageProvider.getImage(0);
+    REQUIRE(trimmed.width == 10);
+    REQUIRE(trimmed.height == 5);
+    CHECK(trimmed(0, 0) == 1);
+    CHECK(trimmed(9, 4) == 2);
+    const WorldStone::ImageRect bounds = imageProvider.getImageBounds(0);
+    CHECK(bounds.x == 3);
+    CHECK(bounds.y == 2);
+    CHECK(bounds.width == 10);
+    CHECK(bounds.height == 5);
+
+    CHECK_FALSE(imageProvider.getImage(1).isValid());
+    CHECK(imageProvider.getImageBounds(2).width == 4);
+    CHECK(imageProvider.getImage(2)(3, 2) == 9);
+    // Trimming again does nothing
+    CHECK(imageProvider.trimImages() == 0);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file PL2CacheTests.cpp
+ * @brief Tests of the persistent PL2 cache, stored in the working directory.
+ */
+#include <PL2Cache.h>
+#include <doctest.h>
+#include <stdio.h>
+#include <string.h>
+
+using WorldStone::Palette;
+using WorldStone::PL2;
+using WorldStone::PL2Cache;
+
+namespace
+{
+void writeFile(const WorldStone::IOBase::Path& path, const PL2& pl2, size_t size)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    REQUIRE(file);
+    REQUIRE(fwrite(&pl2, size, 1, file) == 1);
+    REQUIRE(fclose(file) == 0);
+}
+} // namespace
+
+/**@testimpl{WorldStone::PL2Cache,PL2Cache}
+ * Creates an entry for a modified palette, then checks that existing entries are used as is
+ * unless they are invalid.
+ */
+TEST_CASE("PL2 cache")
+{
+    Palette palette;
+    REQUIRE(palette.decode("pal.dat"));
+    palette.colors[42] = {1, 2, 3, 0};
+    Palette otherPalette = palette;
+    otherPalette.colors[42].b++;
+    CHECK(PL2Cache::hashPalette(palette) != PL2Cache::hashPalette(otherPalette));
+
+    const std::unique_ptr<PL2> expected = PL2::CreateFromPalette(palette);
+    PL2Cache                   cache(".");
+    const WorldStone::IOBase::Path entryPath = cache.getEntryPath(palette);
+    remove(entryPath.c_str());
+
+    const PL2* pl2 = cache.get(palette);
+    REQUIRE(pl2 != nullptr);
+    CHECK(memcmp(pl2, expected.get(), sizeof(PL2)) == 0);
+    CHECK(cache.get(palette) == pl2);
+    CHECK(cache.getEntriesNumber() == 1);
+    cache.clear();
+    CHECK(cache.getEntriesNumber() == 0);
+
+    SUBCASE("Existing entries are not regenerated")
+    {
+        std::unique_ptr<PL2> modified = std::make_unique<PL2>(*expected);
+        modified->additiveBlend[1].indices[1]++;
+        writeFile(entryPath, *modified, sizeof(PL2));
+
+        PL2Cache   otherCache(".");
+        const PL2* cached = otherCache.get(palette);
+        REQUIRE(cached != nullptr);
+        CHECK(memcmp(cached, modified.get(), sizeof(PL2)) == 0);
+    }
+
+    SUBCASE("Invalid entries are regenerated")
+    {
+        std::unique_ptr<PL2> otherPL2 = PL2::CreateFromPalette(otherPalette);
+        for (size_t size : {sizeof(PL2), sizeof(PL2) - 1})
+        {
+            writeFile(entryPath, size == sizeof(PL2) ? *otherPL2 : *expected, size);
+            PL2Cache   otherCache(".");
+            const PL2* cached = otherCache.get(palette, WorldStone::makeThreadExecutor(4));
+            REQUIRE(cached != nullptr);
+            CHECK(memcmp(cached, expected.get(), sizeof(PL2)) == 0);
+        }
+    }
+
+    SUBCASE("Missing directory")
+    {
+        PL2Cache missingCache("missingDirectory");
+        CHECK(missingCache.get(palette) == nullptr);
+    }
+
+    remove(entryPath.c_str());
+}
@@ -6,12 +6,17 @@
 #include <FileStream.h>
 #include <Palette.h>
 #include <SystemUtils.h>
+#include <TaskExecutor.h>
 #include <doctest.h>
+#include <string.h>
 
 using WorldStone::Palette;
 using WorldStone::PL2;
 using WorldStone::FileStream;
 
+/**@testimpl{WorldStone::PL2,PL2_Creation}
+ * The generated tables must match the ones of the game, also when created concurrently.
+ */
 TEST_CASE("PL2 creation")
 {
     Palette basePalette;
@@ -64,4 +69,75 @@ TEST_CASE("PL2 creation")
         CHECK(pl2->textColors[i] == pl2File->textColors[i]);
         CHECK(pl2->textColorShifts[i].indices == pl2File->textColorShifts[i].indices);
     }
+
+    std::unique_ptr<PL2> pl2Threaded =
+        PL2::CreateFromPalette(basePalette, WorldStone::makeThreadExecutor(4));
+    REQUIRE(pl2Threaded);
+    CHECK(memcmp(pl2Threaded.get(), pl2File.get(), sizeof(PL2)) == 0);
+}
+
+/**@testimpl{WorldStone::ClosestColorFinder,ClosestColorFinder}
+ * Must give the same results as Palette::GetClosestColorIndex, ties included.
+ */
+TEST_CASE("ClosestColorFinder")
+{
+    Palette palette;
+    REQUIRE(palette.decode("pal.dat"));
+
+    // Lots of duplicated colors to check that the ties are resolved the same way
+    Palette duplicates = palette;
+    for (size_t i = 0; i < Palette::colorCount; i++)
+        duplicates.colors[i] = palette.colors[(i * 37) % 64];
+
+    for (const Palette* pal : {&palette, &duplicates})
+    {
+        const WorldStone::ClosestColorFinder finder(*pal);
+        bool                                 sameIndices = true;
+        for (int r = 0; r < 256; r += 5)
+            for (int g = 0; g < 256; g += 3)
+                for (int b = 0; b < 256; b += 7)
+                {
+                    const Palette::Color color{uint8_t(r), uint8_t(g), uint8_t(b), 0};
+                    sameIndices &= finder.GetClosestColorIndex(color)
+                                   == pal->GetClosestColorIndex(color);
+                }
+        for (const Palette::Color& color : pal->colors)
+            sameIndices &= finder.GetClosestColorIndex(color) == pal->GetClosestColorIndex(color);
+        CHECK(sameIndices);
+    }
+}
+
+/**@testimpl{WorldStone::ColorLookupTable,ColorLookupTable}
+ * Converting indices must give the palette colors, with index 0 as the only transparent one.
+ */
+TEST_CASE("ColorLookupTable")
+{
+    Palette palette;
+    REQUIRE(palette.decode("pal.dat"));
+    WorldStone::PalShiftTransform reversed;
+    for (size_t i = 0; i < Palette::colorCount; i++)
+        reversed.indices[i] = uint8_t(Palette::colorCount - 1 - i);
+
+    // Odd number of indices so that both the SIMD and the scalar paths are used
+    std::vector<uint8_t> indices(Palette::colorCount + 5);
+    for (size_t i = 0; i < indices.size(); i++)
+        indices[i] = uint8_t(i * 7);
+    std::vector<Palette::Color> colors(indices.size());
+
+    const WorldStone::ColorLookupTable table(palette);
+    table.convert(indices.data(), colors.data(), colors.size());
+    const WorldStone::ColorLookupTable shiftedTable(palette, reversed);
+    std::vector<Palette::Color> shiftedColors(indices.size());
+    shiftedTable.convert(indices.data(), shiftedColors.data(), shiftedColors.size());
+
+    bool colorsEqual = true, alphasEqual = true;
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        const uint8_t alpha = indices[i] ? 0xFF : 0;
+        colorsEqual &= colors[i] == palette.colors[indices[i]];
+        colorsEqual &= shiftedColors[i] == palette.colors[reversed.indices[indices[i]]];
+        alphasEqual &= colors[i]._padding == alpha && shiftedColors[i]._padding == alpha;
+    }
+    CHECK(colorsEqual);
+    CHECK(alphasEqual);
 }
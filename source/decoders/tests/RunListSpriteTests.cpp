@@ -0,0 +1,112 @@
+/**
+ * @file RunListSpriteTests.cpp
+ * @brief Tests of the run list sprites, built from decoded DCC frames.
+ */
+#include <FileStream.h>
+#include <RunListSprite.h>
+#include <dcc.h>
+#include <doctest.h>
+
+using WorldStone::DCC;
+using WorldStone::FileStream;
+using WorldStone::ImageView;
+using WorldStone::Palette;
+using WorldStone::RunListSprite;
+using WorldStone::SimpleImageProvider;
+using WorldStone::Vector;
+
+namespace
+{
+/// Reference implementation of the blit, pixel per pixel
+void blitReference(ImageView<const uint8_t> src, ImageView<uint8_t> dst, int32_t dstX,
+                   int32_t dstY)
+{
+    for (int32_t y = 0; y < int32_t(src.height); y++)
+    {
+        for (int32_t x = 0; x < int32_t(src.width); x++)
+        {
+            const int32_t outX = x + dstX, outY = y + dstY;
+            if (outX < 0 || outY < 0 || outX >= int32_t(dst.width) || outY >= int32_t(dst.height))
+                continue;
+            const uint8_t pixel = src(size_t(x), size_t(y));
+            if (pixel) dst(size_t(outX), size_t(outY)) = pixel;
+        }
+    }
+}
+} // namespace
+
+/**@testimpl{WorldStone::RunListSprite,RunListSprite}
+ * Converting decoded DCC frames to run lists must keep all the opaque pixels.
+ */
+TEST_CASE("RunListSprite from DCC frames")
+{
+    DCC dcc;
+    REQUIRE(dcc.initDecoder(std::make_unique<FileStream>("CRHDBRVDTHTH.dcc")));
+    DCC::Direction               dir;
+    SimpleImageProvider<uint8_t> imgProvider;
+    REQUIRE(dcc.readDirection(dir, 0, imgProvider));
+
+    bool blitsEqual = true, hitTestsEqual = true;
+    for (size_t frameIndex = 0; frameIndex < imgProvider.getImagesNumber(); frameIndex++)
+    {
+        const ImageView<const uint8_t> frame =
+            static_cast<const SimpleImageProvider<uint8_t>&>(imgProvider).getImage(frameIndex);
+        const RunListSprite sprite = RunListSprite::fromImage(frame);
+        REQUIRE(sprite.width == frame.width);
+        REQUIRE(sprite.height == frame.height);
+        REQUIRE(sprite.firstRun.size() == frame.height + 1);
+
+        for (int32_t y = -1; y <= int32_t(frame.height); y++)
+        {
+            for (int32_t x = -1; x <= int32_t(frame.width); x++)
+            {
+                const bool inside = x >= 0 && y >= 0 && x < int32_t(frame.width) &&
+                                    y < int32_t(frame.height);
+                const bool opaque = inside && frame(size_t(x), size_t(y)) != 0;
+                hitTestsEqual &= sprite.isOpaque(x, y) == opaque;
+            }
+        }
+
+        // Blit at various positions, including partially and fully clipped ones
+        const size_t dstWidth = 60, dstHeight = 50;
+        for (int32_t offset : {-1000, -25, -3, 0, 7, 45, 1000})
+        {
+            Vector<uint8_t> expected(dstWidth * dstHeight, 0xCD), actual(expected);
+            blitReference(frame, {expected.data(), dstWidth, dstHeight, dstWidth}, offset,
+                          offset / 2);
+            sprite.blitTo(ImageView<uint8_t>{actual.data(), dstWidth, dstHeight, dstWidth},
+                          offset, offset / 2);
+            blitsEqual &= actual == expected;
+        }
+    }
+    CHECK(blitsEqual);
+    CHECK(hitTestsEqual);
+
+    SUBCASE("RGBA blit")
+    {
+        Palette palette;
+        REQUIRE(palette.decode("pal.dat"));
+        const ImageView<const uint8_t> frame =
+            static_cast<const SimpleImageProvider<uint8_t>&>(imgProvider).getImage(0);
+        const RunListSprite sprite = RunListSprite::fromImage(frame);
+
+        const Palette::Color    background{1, 2, 3, 0};
+        Vector<Palette::Color>  colors(frame.width * frame.height, background);
+        ImageView<Palette::Color> colorView{colors.data(), frame.width, frame.height, frame.width};
+        sprite.blitTo(colorView, 0, 0, palette);
+        bool colorsEqual = true;
+        for (size_t y = 0; y < frame.height; y++)
+        {
+            for (size_t x = 0; x < frame.width; x++)
+            {
+                const uint8_t        index = frame(x, y);
+                const Palette::Color color = colorView(x, y);
+                if (index)
+                    colorsEqual &= color == palette.colors[index] && color._padding == 0xFF;
+                else
+                    colorsEqual &= color == background && color._padding == 0;
+            }
+        }
+        CHECK(colorsEqual);
+    }
+}
@@ -3,11 +3,39 @@
  * @brief Implementation of the tests for the various file decoders.
  */
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include <MemoryStream.h>
 #include <dcc.h>
 #include <doctest.h>
+#include <algorithm>
+#include <chrono>
+#include <limits>
 using WorldStone::DCC;
 using WorldStone::SimpleImageProvider;
 using WorldStone::FileStream;
+using WorldStone::MemoryStream;
+
+/**Computes a FNV-1a hash of the pixels of the images allocated by the provider.
+ * Used to make sure the decoded frames do not change when optimizing the decoder.
+ * @param firstImage The index of the first image to take into account.
+ */
+static uint32_t hashDecodedFrames(const SimpleImageProvider<uint8_t>& imgProvider,
+                                  size_t                              firstImage = 0)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t imageIndex = firstImage; imageIndex < imgProvider.getImagesNumber(); imageIndex++)
+    {
+        const WorldStone::ImageView<const uint8_t> image = imgProvider.getImage(imageIndex);
+        for (size_t y = 0; y < image.height; y++)
+        {
+            for (size_t x = 0; x < image.width; x++)
+            {
+                hash ^= image(x, y);
+                hash *= 16777619u;
+            }
+        }
+    }
+    return hash;
+}
 
 /**Try to decode BaalSpirit.dcc.
  * This is the DCC file with the biggest number of frames (but only 1 direction).
@@ -48,6 +76,9 @@ TEST_CASE("DCC decoding BaalSpirit.dcc")
     CHECK(dir0.extents.yUpper   ==  (45+1));
     CHECK(dir0.extents.width()  ==     195);
     CHECK(dir0.extents.height() ==     224);
+
+    CHECK(imgProvider.getImagesNumber() == 200);
+    CHECK(hashDecodedFrames(imgProvider) == 0x8C224BE2);
     // clang-format on
 }
 
@@ -89,6 +120,9 @@ TEST_CASE("DCC decoding CRHDBRVDTHTH.dcc")
     CHECK(dir0.extents.yUpper   == (-15+1));
     CHECK(dir0.extents.width()  ==      59);
     CHECK(dir0.extents.height() ==      61);
+
+    CHECK(imgProvider.getImagesNumber() == 24);
+    CHECK(hashDecodedFrames(imgProvider) == 0x2C8F2A14);
     // clang-format on
 }
 
@@ -131,6 +165,9 @@ TEST_CASE("DCC decoding BloodSmall01.dcc")
     CHECK(dir0.extents.yUpper   ==   (9+1));
     CHECK(dir0.extents.width()  ==      32);
     CHECK(dir0.extents.height() ==      54);
+
+    CHECK(imgProvider.getImagesNumber() == 9);
+    CHECK(hashDecodedFrames(imgProvider) == 0xEAA584FD);
     // clang-format on
 }
 
@@ -173,6 +210,9 @@ TEST_CASE("DCC decoding HZTRLITA1HTH.dcc")
     CHECK(dir.extents.width()  ==      56);
     CHECK(dir.extents.height() ==      62);
 
+    CHECK(imgProvider.getImagesNumber() == 12);
+    CHECK(hashDecodedFrames(imgProvider) == 0x69404A4A);
+
     REQUIRE(dcc.readDirection(dir, 4, imgProvider));
 
     CHECK(dir.header.outsizeCoded        ==  9774);
@@ -192,5 +232,753 @@ TEST_CASE("DCC decoding HZTRLITA1HTH.dcc")
     CHECK(dir.extents.yUpper   ==  (-1+1));
     CHECK(dir.extents.width()  ==      24);
     CHECK(dir.extents.height() ==      62);
+
+    CHECK(imgProvider.getImagesNumber() == 24);
+    CHECK(hashDecodedFrames(imgProvider, 12) == 0x597F2559);
     // clang-format on
 }
+
+/**@testimpl{WorldStone::DCC,DCC_Headers}
+ * Reading only the headers must give the same information as decoding the whole direction.
+ */
+TEST_CASE("DCC headers only reading")
+{
+    for (const char* filename :
+         {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "BloodSmall01.dcc", "HZTRLITA1HTH.dcc"})
+    {
+        CAPTURE(filename);
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+
+        WorldStone::Vector<DCC::Direction> headersOnly;
+        REQUIRE(dcc.readAllDirectionHeaders(headersOnly));
+        REQUIRE(headersOnly.size() == dcc.getHeader().directions);
+
+        for (uint32_t dirIndex = 0; dirIndex < dcc.getHeader().directions; dirIndex++)
+        {
+            CAPTURE(dirIndex);
+            DCC::Direction               decoded;
+            SimpleImageProvider<uint8_t> imgProvider;
+            REQUIRE(dcc.readDirection(decoded, dirIndex, imgProvider));
+
+            const DCC::Direction& dir = headersOnly[dirIndex];
+            CHECK(dir.header.outsizeCoded == decoded.header.outsizeCoded);
+            CHECK(dir.header.codedBytesBits == decoded.header.codedBytesBits);
+            CHECK(dir.extents.xLower == decoded.extents.xLower);
+            CHECK(dir.extents.yLower == decoded.extents.yLower);
+            CHECK(dir.extents.xUpper == decoded.extents.xUpper);
+            CHECK(dir.extents.yUpper == decoded.extents.yUpper);
+            REQUIRE(dir.frameHeaders.size() == decoded.frameHeaders.size());
+            bool allFramesEqual = true;
+            for (size_t frameIndex = 0; frameIndex < dir.frameHeaders.size(); frameIndex++)
+            {
+                const DCC::FrameHeader& frame         = dir.frameHeaders[frameIndex];
+                const DCC::FrameHeader& expectedFrame = decoded.frameHeaders[frameIndex];
+                allFramesEqual &= frame.width == expectedFrame.width &&
+                                  frame.height == expectedFrame.height &&
+                                  frame.xOffset == expectedFrame.xOffset &&
+                                  frame.yOffset == expectedFrame.yOffset &&
+                                  frame.codedBytes == expectedFrame.codedBytes;
+            }
+            CHECK(allFramesEqual);
+        }
+    }
+}
+
+/**@testimpl{WorldStone::DCC,DCC_RandomAccess}
+ * Decoding a single frame from the direction index must give the same result as decoding the
+ * whole direction. Frames are decoded in reverse order so that no state can leak between them.
+ */
+TEST_CASE("DCC random access frames decoding")
+{
+    for (const char* filename : {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "HZTRLITA1HTH.dcc"})
+    {
+        CAPTURE(filename);
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+
+        DCC::DirectionIndex          dirIndex;
+        SimpleImageProvider<uint8_t> directionImages;
+        REQUIRE(dcc.indexDirection(dirIndex, 0, directionImages));
+        const uint32_t nbFrames = dcc.getHeader().framesPerDir;
+        REQUIRE(directionImages.getImagesNumber() == nbFrames);
+        // The kept cells are stored with their colors indices, not as pixels
+        CHECK(dirIndex.keptCells.size() < dirIndex.encodedDirection.size() / 2);
+
+        SimpleImageProvider<uint8_t> frameImages;
+        for (uint32_t frameIndex = nbFrames; frameIndex-- > 0;)
+        {
+            REQUIRE(DCC::readFrame(dirIndex, frameIndex, frameImages));
+        }
+        CHECK_FALSE(DCC::readFrame(dirIndex, nbFrames, frameImages));
+        REQUIRE(frameImages.getImagesNumber() == nbFrames);
+
+        bool allFramesEqual = true;
+        for (uint32_t frameIndex = 0; frameIndex < nbFrames; frameIndex++)
+        {
+            const auto expected = directionImages.getImage(frameIndex);
+            const auto frame    = frameImages.getImage(nbFrames - 1 - frameIndex);
+            allFramesEqual &= frame.width == expected.width && frame.height == expected.height &&
+                              std::equal(frame.buffer, frame.buffer + frame.width * frame.height,
+                                         expected.buffer);
+        }
+        CHECK(allFramesEqual);
+    }
+}
+
+/**@testimpl{WorldStone::DCC,DCC_Tiled}
+ * The frames rebuilt from the deduplicated blocks must be the same as the decoded images.
+ * Blocks are only kept when they use less memory than the frames.
+ */
+TEST_CASE("DCC tiled decoding")
+{
+    struct TiledFile
+    {
+        const char* filename;
+        uint32_t    direction;
+        bool        expectTiled;
+    };
+    for (const TiledFile& file : {TiledFile{"BaalSpirit.dcc", 0, true},
+                                  TiledFile{"CRHDBRVDTHTH.dcc", 1, false},
+                                  TiledFile{"BloodSmall01.dcc", 2, false},
+                                  TiledFile{"HZTRLITA1HTH.dcc", 0, true}})
+    {
+        const char* filename = file.filename;
+        CAPTURE(filename);
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+
+        DCC::Direction               dir;
+        SimpleImageProvider<uint8_t> expectedImages;
+        REQUIRE(dcc.readDirection(dir, file.direction, expectedImages));
+
+        DCC::TiledDirection tiles;
+        DCC::DecodeOptions  options;
+        options.tiles = &tiles;
+        REQUIRE(dcc.readDirection(dir, file.direction, options));
+        REQUIRE(tiles.frames.size() == expectedImages.getImagesNumber());
+        size_t framesSize = 0;
+        for (size_t frameIndex = 0; frameIndex < expectedImages.getImagesNumber(); frameIndex++)
+        {
+            const auto expected = expectedImages.getImage(frameIndex);
+            framesSize += expected.width * expected.height;
+        }
+        REQUIRE(tiles.isTiled() == file.expectTiled);
+        if (tiles.isTiled()) {
+            CHECK(tiles.nbBlocks() <= DCC::TiledDirection::maxBlocks);
+            CHECK(tiles.framesPixels.empty());
+            CHECK(tiles.blocksPixels.size() + tiles.blockIndices.size() * sizeof(uint16_t) <
+                  framesSize);
+            CHECK(std::all_of(tiles.blocksPixels.begin(),
+                              tiles.blocksPixels.begin() + DCC::TiledDirection::blockPixels,
+                              [](uint8_t pixel) { return pixel == 0; }));
+        }
+        else
+        {
+            CHECK(tiles.blockIndices.empty());
+            CHECK(tiles.framesPixels.size() == framesSize);
+        }
+
+        SimpleImageProvider<uint8_t> tiledImages;
+        bool                         allFramesEqual = true;
+        for (size_t frameIndex = 0; frameIndex < tiles.frames.size(); frameIndex++)
+        {
+            const auto expected = expectedImages.getImage(frameIndex);
+            const auto frame    = tiledImages.getNewImage(expected.width, expected.height);
+            tiles.copyFrameTo(frameIndex, frame);
+            allFramesEqual &= std::equal(frame.buffer, frame.buffer + frame.width * frame.height,
+                                         expected.buffer);
+        }
+        CHECK(allFramesEqual);
+    }
+}
+
+/// Checks that the packed frames of the first direction unpack to the decoded images
+static void checkPackedDirection(DCC& dcc, unsigned expectedBitsPerPixel)
+{
+    // The images are decoded at the same time to compare them with the packed frames
+    DCC::Direction               dir;
+    SimpleImageProvider<uint8_t> images;
+    DCC::PackedDirection         packed;
+    DCC::DecodeOptions           options;
+    options.images = &images;
+    options.packed = &packed;
+    REQUIRE(dcc.readDirection(dir, 0, options));
+    CHECK(packed.bitsPerPixel == expectedBitsPerPixel);
+    REQUIRE(packed.palette.size() == size_t(1) << packed.bitsPerPixel);
+    CHECK(packed.palette[0] == 0);
+    REQUIRE(packed.frames.size() == images.getImagesNumber());
+
+    SimpleImageProvider<uint8_t> unpackedImages;
+    bool                         allFramesEqual = true;
+    size_t                       nbPixels       = 0;
+    for (size_t frameIndex = 0; frameIndex < packed.frames.size(); frameIndex++)
+    {
+        const auto expected = images.getImage(frameIndex);
+        const auto frame    = unpackedImages.getNewImage(expected.width, expected.height);
+        packed.unpackFrame(frameIndex, frame);
+        allFramesEqual &= std::equal(frame.buffer, frame.buffer + frame.width * frame.height,
+                                     expected.buffer);
+        nbPixels += frame.width * frame.height;
+    }
+    CHECK(allFramesEqual);
+    CHECK(packed.pixels.size() <= nbPixels * packed.bitsPerPixel / 8 + packed.frames.size() * 8);
+}
+
+/**@testimpl{WorldStone::DCC,DCC_Packed}
+ * Packed frames must unpack to the same pixels, with the smallest number of bits per pixel.
+ */
+TEST_CASE("DCC packed decoding")
+{
+    SUBCASE("Decoded files")
+    {
+        const std::pair<const char*, unsigned> files[] = {{"BaalSpirit.dcc", 8},
+                                                          {"CRHDBRVDTHTH.dcc", 8},
+                                                          {"BloodSmall01.dcc", 4},
+                                                          {"HZTRLITA1HTH.dcc", 8}};
+        for (const auto& file : files)
+        {
+            CAPTURE(file.first);
+            DCC dcc;
+            REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(file.first)));
+            checkPackedDirection(dcc, file.second);
+        }
+    }
+    SUBCASE("Few colors")
+    {
+        // Frames wider than 16 pixels and with odd widths to use both the SIMD and scalar paths
+        for (size_t nbColors : {3, 4, 15, 16})
+        {
+            CAPTURE(nbColors);
+            constexpr size_t            frameWidth  = 37;
+            constexpr size_t            frameHeight = 9;
+            WorldStone::Vector<uint8_t> pixels(frameWidth * frameHeight);
+            for (size_t pixelIndex = 0; pixelIndex < pixels.size(); pixelIndex++)
+            {
+                // Each cell uses at most 4 colors, the values themselves are far apart
+                const size_t cellIndex = (pixelIndex % frameWidth) / 4;
+                const size_t color     = (cellIndex + pixelIndex % 2) % nbColors;
+                pixels[pixelIndex]     = uint8_t(color == 0 ? 0 : 255 - color * 7);
+            }
+            const DCC::EncoderFrame frame{{pixels.data(), frameWidth, frameHeight, frameWidth},
+                                          -3,
+                                          int32_t(frameHeight) - 2};
+            WorldStone::Vector<uint8_t> encodedFile;
+            REQUIRE(DCC::encode({{frame, frame}}, encodedFile));
+
+            DCC dcc;
+            REQUIRE(dcc.initDecoder(std::make_unique<MemoryStream>(encodedFile)));
+            checkPackedDirection(dcc, nbColors <= 4 ? 2 : 4);
+        }
+    }
+}
+
+/**@testimpl{WorldStone::DCC,DCC_Colors}
+ * Decoding to colors must give the same result as decoding to 8bpp then looking up the colors.
+ */
+TEST_CASE("DCC color decoding")
+{
+    using WorldStone::Palette;
+    Palette palette;
+    REQUIRE(palette.decode("pal.dat"));
+    const WorldStone::ColorLookupTable colors(palette);
+
+    for (const char* file : {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "BloodSmall01.dcc"})
+    {
+        CAPTURE(file);
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(file)));
+        DCC::Direction               dir;
+        SimpleImageProvider<uint8_t> images;
+        REQUIRE(dcc.readDirection(dir, 0, images));
+        DCC::Direction                      colorDir;
+        SimpleImageProvider<Palette::Color> colorImages;
+        DCC::DecodeOptions                  options;
+        options.colorImages = &colorImages;
+        REQUIRE_FALSE(dcc.readDirection(colorDir, 0, options));
+        options.colors = &colors;
+        REQUIRE(dcc.readDirection(colorDir, 0, options));
+        REQUIRE(colorImages.getImagesNumber() == images.getImagesNumber());
+
+        bool allFramesEqual = true;
+        for (size_t frameIndex = 0; frameIndex < images.getImagesNumber(); frameIndex++)
+        {
+            const auto frame      = images.getImage(frameIndex);
+            const auto colorFrame = colorImages.getImage(frameIndex);
+            REQUIRE(colorFrame.width == frame.width);
+            REQUIRE(colorFrame.height == frame.height);
+            for (size_t pixel = 0; pixel < frame.width * frame.height; pixel++)
+            {
+                const Palette::Color expected = colors.colors[frame.buffer[pixel]];
+                const Palette::Color actual   = colorFrame.buffer[pixel];
+                allFramesEqual &= actual == expected && actual._padding == expected._padding;
+            }
+        }
+        CHECK(allFramesEqual);
+    }
+}
+
+/**@testimpl{WorldStone::DCC,DCC_Trim}
+ * Trimmed frames must have the same pixels at the same position in the direction.
+ */
+TEST_CASE("DCC frames trimming")
+{
+    DCC dcc;
+    REQUIRE(dcc.initDecoder(std::make_unique<FileStream>("BaalSpirit.dcc")));
+    DCC::Direction               dir;
+    SimpleImageProvider<uint8_t> images;
+    REQUIRE(dcc.readDirection(dir, 0, images));
+    DCC::Direction               trimmedDir = dir;
+    SimpleImageProvider<uint8_t> trimmedImages;
+    REQUIRE(dcc.readDirection(trimmedDir, 0, trimmedImages));
+
+    size_t totalBytes = 0;
+    for (size_t frameIndex = 0; frameIndex < images.getImagesNumber(); frameIndex++)
+        totalBytes += images.getImage(frameIndex).width * images.getImage(frameIndex).height;
+    const size_t bytesSaved = DCC::trimFrames(trimmedDir, trimmedImages);
+    CHECK(bytesSaved > 0);
+
+    size_t trimmedBytes = 0;
+    bool   allPixelsKept = true;
+    for (size_t frameIndex = 0; frameIndex < images.getImagesNumber(); frameIndex++)
+    {
+        const auto frame   = images.getImage(frameIndex);
+        const auto trimmed = trimmedImages.getImage(frameIndex);
+        trimmedBytes += trimmed.width * trimmed.height;
+        const auto& extents        = dir.frameHeaders[frameIndex].extents;
+        const auto& trimmedExtents = trimmedDir.frameHeaders[frameIndex].extents;
+        REQUIRE(size_t(trimmedExtents.width()) == trimmed.width);
+        REQUIRE(size_t(trimmedExtents.height()) == trimmed.height);
+        for (size_t y = 0; y < frame.height; y++)
+        {
+            for (size_t x = 0; x < frame.width; x++)
+            {
+                // Position of the pixel in the trimmed frame, outside pixels must be transparent
+                const int32_t trimmedX = int32_t(x) + extents.xLower - trimmedExtents.xLower;
+                const int32_t trimmedY = int32_t(y) + extents.yLower - trimmedExtents.yLower;
+                const bool    inside   = trimmedX >= 0 && trimmedY >= 0 &&
+                                    trimmedX < trimmedExtents.width() &&
+                                    trimmedY < trimmedExtents.height();
+                const uint8_t trimmedPixel =
+                    inside ? trimmed(size_t(trimmedX), size_t(trimmedY)) : uint8_t(0);
+                allPixelsKept &= frame(x, y) == trimmedPixel;
+            }
+        }
+    }
+    CHECK(allPixelsKept);
+    CHECK(totalBytes - trimmedBytes == bytesSaved);
+}
+
+/// Checks that updating the dirty rectangles of each frame gives the frame drawn in a cleared image
+static void checkDirtyRegions(DCC& dcc)
+{
+    DCC::Direction               dir;
+    SimpleImageProvider<uint8_t> images;
+    DCC::DirtyRegions            regions;
+    DCC::DecodeOptions           options;
+    options.images       = &images;
+    options.dirtyRegions = &regions;
+    REQUIRE(dcc.readDirection(dir, 0, options));
+    const size_t nbFrames = images.getImagesNumber();
+    REQUIRE(regions.firstRect.size() == nbFrames + 1);
+    REQUIRE(regions.firstRect.back() == regions.rects.size());
+
+    using WorldStone::ImageView;
+    const size_t                dirWidth  = size_t(dir.extents.width());
+    const size_t                dirHeight = size_t(dir.extents.height());
+    WorldStone::Vector<uint8_t> expected(dirWidth * dirHeight);
+    WorldStone::Vector<uint8_t> updated(dirWidth * dirHeight, 0xFF); // Garbage at first
+    size_t                      dirtyPixels    = 0;
+    bool                        allRectsInside = true;
+    bool                        allFramesEqual = true;
+    for (size_t frameIndex = 0; frameIndex < nbFrames; frameIndex++)
+    {
+        const DCC::FrameHeader&  frameHeader = dir.frameHeaders[frameIndex];
+        const ImageView<uint8_t> frame       = images.getImage(frameIndex);
+        const ImageView<uint8_t> expectedView{expected.data(), dirWidth, dirHeight, dirWidth};
+        std::fill(expected.begin(), expected.end(), uint8_t(0));
+        frame.copyTo(expectedView.subView(size_t(frameHeader.extents.xLower - dir.extents.xLower),
+                                          size_t(frameHeader.extents.yLower - dir.extents.yLower),
+                                          frame.width, frame.height));
+
+        for (size_t rectIndex = regions.firstRect[frameIndex];
+             rectIndex < regions.firstRect[frameIndex + 1]; rectIndex++)
+        {
+            const DCC::DirtyRegions::Rect& rect = regions.rects[rectIndex];
+            allRectsInside &= size_t(rect.x + rect.width) <= dirWidth
+                              && size_t(rect.y + rect.height) <= dirHeight;
+            if (!allRectsInside) break;
+            for (size_t y = rect.y; y < size_t(rect.y + rect.height); y++)
+            {
+                memcpy(&updated[rect.x + y * dirWidth], &expected[rect.x + y * dirWidth],
+                       rect.width);
+            }
+            dirtyPixels += size_t(rect.width) * size_t(rect.height);
+        }
+        allFramesEqual &= updated == expected;
+    }
+    CHECK(allRectsInside);
+    CHECK(allFramesEqual);
+    if (nbFrames > 1) CHECK(dirtyPixels < nbFrames * dirWidth * dirHeight);
+}
+
+/**@testimpl{WorldStone::DCC,DCC_DirtyRegions}
+ * Updating only the dirty rectangles of a direction sized image must give the same result as
+ * drawing each frame in a cleared image.
+ */
+TEST_CASE("DCC dirty regions")
+{
+    SUBCASE("Decoded files")
+    {
+        for (const char* filename :
+             {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "BloodSmall01.dcc", "HZTRLITA1HTH.dcc"})
+        {
+            CAPTURE(filename);
+            DCC dcc;
+            REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+            checkDirtyRegions(dcc);
+        }
+    }
+    SUBCASE("Equal cells kept from an older frame")
+    {
+        // The last frame is the same as the first one, so its cells are encoded as equal cells,
+        // but the second frame is elsewhere and the first frame pixels were cleared meanwhile.
+        constexpr size_t            frameSize = 16;
+        WorldStone::Vector<uint8_t> pixels(frameSize * frameSize);
+        for (size_t pixelIndex = 0; pixelIndex < pixels.size(); pixelIndex++)
+            pixels[pixelIndex] = uint8_t(1 + (pixelIndex / 4) % 4 + (pixelIndex * 7) % 4 * 16);
+        const uint8_t smallFrame[4 * 4] = {1, 2, 3, 4, 1, 2, 3, 4, 1, 2, 3, 4, 1, 2, 3, 4};
+
+        const DCC::EncoderFrame largeFrame{{pixels.data(), frameSize, frameSize, frameSize}, 0,
+                                           int32_t(frameSize) - 1};
+        WorldStone::Vector<WorldStone::Vector<DCC::EncoderFrame>> directions{
+            {largeFrame, {{smallFrame, 4, 4, 4}, int32_t(frameSize), 3}, largeFrame}};
+        WorldStone::Vector<uint8_t> encodedFile;
+        REQUIRE(DCC::encode(directions, encodedFile));
+
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<MemoryStream>(encodedFile)));
+        DCC::Direction dir;
+        REQUIRE(dcc.readDirectionHeaders(dir, 0));
+        CHECK(dir.header.compressEqualCells);
+        checkDirtyRegions(dcc);
+    }
+}
+
+/**@testimpl{WorldStone::DCC,DCC_IndexedBlocks}
+ * Every frame can be stored as blocks of 2-bit indices, and the pixels must stay the same.
+ */
+TEST_CASE("DCC indexed blocks encoding")
+{
+    SUBCASE("Decoded frames")
+    {
+        for (const char* filename :
+             {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "BloodSmall01.dcc", "HZTRLITA1HTH.dcc"})
+        {
+            CAPTURE(filename);
+            DCC dcc;
+            REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+
+            DCC::Direction               dir;
+            SimpleImageProvider<uint8_t> images;
+            REQUIRE(dcc.readDirection(dir, 0, images));
+
+            DCC::IndexedBlocksFrame indexedFrame;
+            bool                    allFramesEncoded = true;
+            bool                    allFramesEqual   = true;
+            for (size_t frameIndex = 0; frameIndex < images.getImagesNumber(); frameIndex++)
+            {
+                const auto image = images.getImage(frameIndex);
+                allFramesEncoded &= DCC::encodeIndexedBlocks(dir, frameIndex, image, indexedFrame);
+                allFramesEqual &= indexedFrame.blocks.size() ==
+                                  size_t(indexedFrame.nbBlocksX) * indexedFrame.nbBlocksY;
+                for (size_t y = 0; y < image.height; y++)
+                {
+                    for (size_t x = 0; x < image.width; x++)
+                        allFramesEqual &= indexedFrame(x, y) == image(x, y);
+                }
+            }
+            CHECK(allFramesEncoded);
+            CHECK(allFramesEqual);
+        }
+    }
+    SUBCASE("Blocks alignment and too many colors")
+    {
+        DCC::Direction dir;
+        dir.frameHeaders.resize(1);
+        dir.frameHeaders[0].extents = {5, 2, 7, 4};
+        dir.extents                 = {0, 0, 10, 10};
+
+        uint8_t                 pixels[2 * 2] = {1, 2, 3, 4};
+        DCC::IndexedBlocksFrame indexedFrame;
+        REQUIRE(DCC::encodeIndexedBlocks(dir, 0, {pixels, 2, 2, 2}, indexedFrame));
+        CHECK(indexedFrame.originX == 1);
+        CHECK(indexedFrame.originY == 2);
+        CHECK(indexedFrame.nbBlocksX == 1);
+        CHECK(indexedFrame.nbBlocksY == 1);
+        CHECK(indexedFrame(0, 0) == 1);
+        CHECK(indexedFrame(1, 0) == 2);
+        CHECK(indexedFrame(0, 1) == 3);
+        CHECK(indexedFrame(1, 1) == 4);
+
+        // Straddling the blocks boundaries
+        dir.frameHeaders[0].extents = {3, 3, 5, 5};
+        CHECK(DCC::encodeIndexedBlocks(dir, 0, {pixels, 2, 2, 2}, indexedFrame));
+        CHECK(indexedFrame.nbBlocksX == 2);
+        CHECK(indexedFrame.nbBlocksY == 2);
+        // A single block can not use more than 4 colors
+        uint8_t fiveColors[3 * 2]   = {1, 2, 3, 4, 5, 6};
+        dir.frameHeaders[0].extents = {4, 0, 7, 2};
+        CHECK_FALSE(DCC::encodeIndexedBlocks(dir, 0, {fiveColors, 3, 2, 3}, indexedFrame));
+    }
+}
+
+/**@testimpl{WorldStone::DCC,DCC_Progressive}
+ * Each frame must be notified once, in order, as soon as it is decoded and before the next ones.
+ */
+TEST_CASE("DCC progressive decoding")
+{
+    DCC dcc;
+    REQUIRE(dcc.initDecoder(std::make_unique<FileStream>("BaalSpirit.dcc")));
+
+    SimpleImageProvider<uint8_t> expectedImages;
+    DCC::Direction               dir;
+    REQUIRE(dcc.readDirection(dir, 0, expectedImages));
+    const uint32_t nbFrames = dcc.getHeader().framesPerDir;
+
+    const auto isEmpty = [](WorldStone::ImageView<const uint8_t> image) {
+        return std::all_of(image.buffer, image.buffer + image.width * image.height,
+                           [](uint8_t pixel) { return pixel == 0; });
+    };
+    // Used to check that the first frame is notified before the next ones are decoded
+    uint32_t lastNonEmptyFrame = nbFrames - 1;
+    while (lastNonEmptyFrame > 0 && isEmpty(expectedImages.getImage(lastNonEmptyFrame)))
+        lastNonEmptyFrame--;
+    REQUIRE(lastNonEmptyFrame > 0);
+
+    SimpleImageProvider<uint8_t> images;
+    WorldStone::Vector<uint32_t> notifiedFrames;
+    bool                         framesComplete  = true;
+    bool                         nextFramesEmpty = false;
+    const DCC::FrameDecodedCallback onFrameDecoded =
+        [&](uint32_t frameIndex, WorldStone::ImageView<const uint8_t> frame) {
+            notifiedFrames.push_back(frameIndex);
+            const auto expected = expectedImages.getImage(frameIndex);
+            framesComplete &= frame.buffer == images.getImage(frameIndex).buffer &&
+                              std::equal(frame.buffer, frame.buffer + frame.width * frame.height,
+                                         expected.buffer);
+            // The images of the next frames are allocated but not decoded yet
+            if (frameIndex == 0) nextFramesEmpty = isEmpty(images.getImage(lastNonEmptyFrame));
+        };
+    DCC::DecodeOptions options;
+    options.images         = &images;
+    options.onFrameDecoded = &onFrameDecoded;
+    REQUIRE(dcc.readDirection(dir, 0, options));
+    REQUIRE(notifiedFrames.size() == nbFrames);
+    for (uint32_t frameIndex = 0; frameIndex < nbFrames; frameIndex++)
+        CHECK(notifiedFrames[frameIndex] == frameIndex);
+    CHECK(framesComplete);
+    CHECK(nextFramesEmpty);
+    CHECK(hashDecodedFrames(images) == hashDecodedFrames(expectedImages));
+}
+
+/**@testimpl{WorldStone::DCC,DCC_DecodeStats}
+ * The statistics must be consistent with the content of the files, or 0 if disabled.
+ */
+TEST_CASE("DCC decoding statistics")
+{
+    for (const char* filename : {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc"})
+    {
+        CAPTURE(filename);
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+
+        WorldStone::DCCDecodeWorkspace workspace;
+        DCC::Direction                 dir;
+        SimpleImageProvider<uint8_t>   images;
+        DCC::DecodeStats               stats;
+        DCC::DecodeOptions             options;
+        options.images    = &images;
+        options.workspace = &workspace;
+        options.stats     = &stats;
+        REQUIRE(dcc.readDirection(dir, 0, options));
+        SimpleImageProvider<uint8_t> expectedImages;
+        REQUIRE(dcc.readDirection(dir, 0, expectedImages));
+        CHECK(hashDecodedFrames(images) == hashDecodedFrames(expectedImages));
+
+        if (!DCC::decodeStatsEnabled) {
+            CHECK(stats.cells == 0);
+            CHECK(stats.stage1Time == 0.0);
+            CHECK(stats.pixelMaskBits == 0);
+            continue;
+        }
+        CHECK(stats.stage1Time > 0.0);
+        CHECK(stats.stage2Time > 0.0);
+        CHECK(stats.cells > 0);
+        CHECK(stats.cells ==
+              stats.equalCells + stats.solidFillCells + stats.oneBitCells + stats.twoBitCells);
+        CHECK(stats.pixelMaskBits % 4 == 0);
+        CHECK(stats.equalCellBits >= stats.equalCells);
+        // Cells are 1x1 to 5x5 pixels
+        const size_t indicesBitsPerPixel = stats.oneBitCells + 2 * stats.twoBitCells;
+        CHECK(stats.pixelCodeIndicesBits >= indicesBitsPerPixel);
+        CHECK(stats.pixelCodeIndicesBits <= indicesBitsPerPixel * 25);
+        CHECK((stats.rawCells > 0) == dir.header.hasRawPixelEncoding);
+        CHECK(stats.rawPixelUsageBits >= stats.rawCells);
+        CHECK(stats.rawPixelCodesBits % 8 == 0);
+    }
+}
+
+/**@testimpl{WorldStone::DCC,DCC_Encoder}
+ * Encoded files must decode to the same frames.
+ */
+TEST_CASE("DCC encoding")
+{
+    using EncoderDirection = WorldStone::Vector<DCC::EncoderFrame>;
+    SUBCASE("Re-encoding files")
+    {
+        for (const char* filename :
+             {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "BloodSmall01.dcc", "HZTRLITA1HTH.dcc"})
+        {
+            CAPTURE(filename);
+            DCC dcc;
+            REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+            const DCC::Header& header = dcc.getHeader();
+
+            WorldStone::Vector<DCC::Direction> dirs(header.directions);
+            SimpleImageProvider<uint8_t>       images;
+            for (uint32_t dirIndex = 0; dirIndex < header.directions; dirIndex++)
+                REQUIRE(dcc.readDirection(dirs[dirIndex], dirIndex, images));
+
+            WorldStone::Vector<EncoderDirection> directions(header.directions);
+            for (uint32_t dirIndex = 0; dirIndex < header.directions; dirIndex++)
+            {
+                for (uint32_t frameIndex = 0; frameIndex < header.framesPerDir; frameIndex++)
+                {
+                    const DCC::FrameHeader& frameHeader = dirs[dirIndex].frameHeaders[frameIndex];
+                    directions[dirIndex].push_back(
+                        {images.getImage(dirIndex * header.framesPerDir + frameIndex),
+                         frameHeader.xOffset, frameHeader.yOffset});
+                }
+            }
+            WorldStone::Vector<uint8_t> encodedFile;
+            REQUIRE(DCC::encode(directions, encodedFile));
+
+            DCC encodedDcc;
+            REQUIRE(encodedDcc.initDecoder(std::make_unique<MemoryStream>(encodedFile)));
+            const DCC::Header& encodedHeader = encodedDcc.getHeader();
+            CHECK(encodedHeader.signature == header.signature);
+            CHECK(encodedHeader.version == header.version);
+            CHECK(encodedHeader.directions == header.directions);
+            CHECK(encodedHeader.framesPerDir == header.framesPerDir);
+            CHECK(encodedHeader.finalDc6Size == header.finalDc6Size);
+
+            SimpleImageProvider<uint8_t> decodedImages;
+            bool                         sameFrameHeaders = true;
+            for (uint32_t dirIndex = 0; dirIndex < header.directions; dirIndex++)
+            {
+                DCC::Direction dir;
+                REQUIRE(encodedDcc.readDirection(dir, dirIndex, decodedImages));
+                CHECK(dir.header.outsizeCoded == dirs[dirIndex].header.outsizeCoded);
+                CHECK(dir.extents.xLower == dirs[dirIndex].extents.xLower);
+                CHECK(dir.extents.yLower == dirs[dirIndex].extents.yLower);
+                CHECK(dir.extents.xUpper == dirs[dirIndex].extents.xUpper);
+                CHECK(dir.extents.yUpper == dirs[dirIndex].extents.yUpper);
+                for (uint32_t frameIndex = 0; frameIndex < header.framesPerDir; frameIndex++)
+                {
+                    const DCC::FrameHeader& expected = dirs[dirIndex].frameHeaders[frameIndex];
+                    const DCC::FrameHeader& frame    = dir.frameHeaders[frameIndex];
+                    sameFrameHeaders &= frame.width == expected.width &&
+                                        frame.height == expected.height &&
+                                        frame.xOffset == expected.xOffset &&
+                                        frame.yOffset == expected.yOffset &&
+                                        frame.codedBytes == expected.codedBytes;
+                }
+            }
+            CHECK(sameFrameHeaders);
+            CHECK(hashDecodedFrames(decodedImages) == hashDecodedFrames(images));
+        }
+    }
+    SUBCASE("Equal cells and raw pixels encodings")
+    {
+        // The first frame uses every pixel value, the next ones use codes that are far apart,
+        // which are cheaper to encode as raw pixels than as displacements.
+        constexpr size_t                     frameSize = 32;
+        WorldStone::Vector<uint8_t>          pixels[3];
+        WorldStone::Vector<EncoderDirection> directions(1);
+        for (size_t frameIndex = 0; frameIndex < 3; frameIndex++)
+        {
+            pixels[frameIndex].resize(frameSize * frameSize);
+            for (size_t y = 0; y < frameSize; y++)
+            {
+                for (size_t x = 0; x < frameSize; x++)
+                {
+                    const size_t cellIndex  = x / 4 + (y / 4) * (frameSize / 4);
+                    const size_t valueIndex = (x + y) % 4;
+                    pixels[frameIndex][x + y * frameSize] =
+                        uint8_t(frameIndex == 0 ? cellIndex * 4 + valueIndex
+                                                : cellIndex + valueIndex * 64);
+                }
+            }
+            directions[0].push_back({{pixels[frameIndex].data(), frameSize, frameSize, frameSize},
+                                     -16,
+                                     int32_t(frameSize) - 20});
+        }
+        WorldStone::Vector<uint8_t> encodedFile;
+        REQUIRE(DCC::encode(directions, encodedFile));
+
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<MemoryStream>(encodedFile)));
+        DCC::Direction               dir;
+        SimpleImageProvider<uint8_t> images;
+        REQUIRE(dcc.readDirection(dir, 0, images));
+        CHECK(dir.header.hasRawPixelEncoding);
+        CHECK(dir.header.compressEqualCells);
+        REQUIRE(images.getImagesNumber() == 3);
+        for (size_t frameIndex = 0; frameIndex < 3; frameIndex++)
+        {
+            CAPTURE(frameIndex);
+            const auto image = images.getImage(frameIndex);
+            CHECK(std::equal(image.buffer, image.buffer + frameSize * frameSize,
+                             pixels[frameIndex].data()));
+        }
+    }
+    SUBCASE("Invalid frames")
+    {
+        WorldStone::Vector<uint8_t> encodedFile;
+        uint8_t                     fiveColors[5] = {1, 2, 3, 4, 5};
+        CHECK_FALSE(DCC::encode({{{{fiveColors, 5, 1, 5}, 0, 0}}}, encodedFile));
+        CHECK_FALSE(DCC::encode({{{{fiveColors, 4, 1, 5}, 0, 0}}, {}}, encodedFile));
+        CHECK_FALSE(DCC::encode({{{{}, 0, 0}}}, encodedFile));
+        CHECK(DCC::encode({{{{fiveColors, 4, 1, 5}, 0, 0}}}, encodedFile));
+    }
+}
+
+/**Measures the time needed to decode all the directions of the test files.
+ * Disabled by default, run it with --no-skip on a release build to compare decoder changes.
+ */
+TEST_CASE("DCC decoding benchmark" * doctest::skip())
+{
+    constexpr int nbRuns = 200;
+    for (const char* filename :
+         {"BaalSpirit.dcc", "CRHDBRVDTHTH.dcc", "BloodSmall01.dcc", "HZTRLITA1HTH.dcc"})
+    {
+        DCC dcc;
+        REQUIRE(dcc.initDecoder(std::make_unique<FileStream>(filename)));
+        double bestTime = std::numeric_limits<double>::max();
+        for (int run = 0; run < nbRuns; run++)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (uint32_t dirIndex = 0; dirIndex < dcc.getHeader().directions; dirIndex++)
+            {
+                DCC::Direction               dir;
+                SimpleImageProvider<uint8_t> images;
+                REQUIRE(dcc.readDirection(dir, dirIndex, images));
+            }
+            const std::chrono::duration<double, std::milli> elapsed =
+                std::chrono::steady_clock::now() - start;
+            bestTime = std::min(bestTime, elapsed.count());
+        }
+        MESSAGE(filename << ": best of " << nbRuns << " runs " << bestTime << " ms");
+    }
+}
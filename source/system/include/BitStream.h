@@ -9,8 +9,10 @@
 #include <algorithm>
 #include <assert.h>
 #include <climits>
+#include <string.h>
 #include <type_traits>
 #include "IOBase.h"
+#include "Vector.h"
 namespace WorldStone
 {
 
@@ -26,7 +28,6 @@ namespace WorldStone
  * Use @ref MemoryStream instead.
  * @warning As this class acts as a view, the buffer must outlive the usage of this class.
  * @todo Add some bounds checking and set io flags on error ?
- * @todo Implement a MemoryStream class
  * @test{System,RO_bitstream}
  */
 
@@ -66,7 +67,7 @@ public:
     /// Set the current position, in bits
     void setPosition(size_t newPosition)
     {
-        assert(newPosition >= 0_z && newPosition < size);
+        assert(newPosition >= 0_z && newPosition <= size);
         currentBitPosition = newPosition + firstBitOffset;
     }
     /// Returns the current position in the buffer (ignoring the first bit position) in bits
@@ -74,7 +75,7 @@ public:
     /// Skips the next nbBits bits
     void skip(size_t nbBits)
     {
-        assert(currentBitPosition + nbBits < bufferSizeInBits());
+        assert(currentBitPosition + nbBits <= bufferSizeInBits());
         currentBitPosition += nbBits;
     }
 
@@ -136,6 +137,23 @@ public:
         return value;
     }
 
+    /** Returns the next bits of the stream without moving the current position.
+     * The first bit of the stream is the least significant bit of the returned value.
+     * At least 57 bits are valid, except near the end of the buffer where the missing bits are 0.
+     */
+    uint64_t peek64() const
+    {
+        const size_t curBytesPos     = currentBitPosition / CHAR_BIT;
+        const size_t bitPosInCurByte = currentBitPosition % CHAR_BIT;
+        const size_t nbBytes         = bufferSizeInBytes();
+        uint64_t     value           = 0;
+        if (curBytesPos < nbBytes) {
+            // TODO : ENDIAN
+            memcpy(&value, buffer + curBytesPos, std::min(sizeof(value), nbBytes - curBytesPos));
+        }
+        return value >> bitPosInCurByte;
+    }
+
     uint8_t readUnsigned8OrLess(const int nbBits)
     {
         const size_t curBytesPos     = currentBitPosition / CHAR_BIT;
@@ -175,4 +193,44 @@ public:
         return 0;
     }
 };
+
+/**
+ * @brief Writes variable bitsize values to a growing buffer, counterpart of BitStreamView.
+ *
+ * Values are written in the same little endian order that BitStreamView uses to read them, and
+ * signed values are encoded using 2's complement.
+ * @test{System,WO_bitstream}
+ */
+class BitStreamWriter
+{
+    Vector<uint8_t> buffer;   ///< The bytes written so far, the last one may be partially used
+    size_t          size = 0; ///< Size of the bitstream in bits
+
+public:
+    /// Returns the current size of the stream in bits, which is also the position of the next bit
+    size_t sizeInBits() const { return size; }
+    /// Returns the current size of the stream in bytes, rounded up
+    size_t sizeInBytes() const { return buffer.size(); }
+    /// Returns the written bytes, the unused bits of the last byte are set to 0
+    const Vector<uint8_t>& getBuffer() const { return buffer; }
+
+    /// Writes a single bit
+    void writeBool(bool value) { writeUnsigned(value ? 1u : 0u, 1); }
+
+    /** Writes the nbBits lowest bits of value
+     * @param nbBits The number of bits to write, at most 32.
+     */
+    void writeUnsigned(uint32_t value, unsigned nbBits);
+
+    /** Writes a signed value using 2's complement on nbBits bits.
+     * @warning The value must fit in nbBits, no check is done.
+     */
+    void writeSigned(int32_t value, unsigned nbBits) { writeUnsigned(uint32_t(value), nbBits); }
+
+    /// Pads the stream with 0 bits until the size is a multiple of 8
+    void alignToByte() { size = buffer.size() * CHAR_BIT; }
+
+    /// Appends the whole content of another bitstream, bit by bit
+    void append(const BitStreamWriter& other);
+};
 }
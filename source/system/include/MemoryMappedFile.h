@@ -0,0 +1,46 @@
+/**
+ * @file MemoryMappedFile.h
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "IOBase.h"
+
+namespace WorldStone
+{
+
+/**
+ * @brief A read-only view of a whole file, mapped in memory.
+ *
+ * The pages are loaded by the system when they are accessed, and shared with the other processes
+ * that map the same file. The content must not be modified while it is mapped.
+ * An empty file can not be mapped.
+ * @test{System,MemoryMappedFile}
+ */
+class MemoryMappedFile
+{
+    const uint8_t* mappedData = nullptr;
+    size_t         mappedSize = 0;
+
+public:
+    MemoryMappedFile() = default;
+    explicit MemoryMappedFile(const IOBase::Path& filename) { open(filename); }
+    ~MemoryMappedFile() { close(); }
+
+    MemoryMappedFile(MemoryMappedFile&& other) noexcept;
+    MemoryMappedFile& operator=(MemoryMappedFile&& other) noexcept;
+    MemoryMappedFile(const MemoryMappedFile&) = delete;
+    MemoryMappedFile& operator=(const MemoryMappedFile&) = delete;
+
+    /**Maps the whole file, after closing the current one.
+     * @return true on success, false if the file can not be opened or is empty
+     */
+    bool open(const IOBase::Path& filename);
+    void close();
+
+    bool           is_open() const { return mappedData != nullptr; }
+    const uint8_t* data() const { return mappedData; }
+    size_t         size() const { return mappedSize; }
+};
+}
@@ -0,0 +1,35 @@
+/**
+ * @file MemoryStream.h
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "Stream.h"
+#include "Vector.h"
+
+namespace WorldStone
+{
+
+/**
+ * @brief A read-only stream over data in memory, behaves like FileStream.
+ *
+ * The stream owns its buffer, so that it can be given to decoders that take ownership of their
+ * stream (for example data produced by an encoder).
+ * @test{System,RO_memorystream}
+ */
+class MemoryStream : public IStream
+{
+    Vector<uint8_t> buffer;
+    size_t          position = 0;
+
+public:
+    explicit MemoryStream(Vector<uint8_t> data) : buffer(std::move(data)) {}
+
+    long   tell() override { return long(position); }
+    bool   seek(long offset, seekdir origin) override;
+    long   size() override { return long(buffer.size()); }
+    size_t read(void* outBuffer, size_t size) override;
+    int    getc() override;
+};
+}
@@ -45,6 +45,29 @@
 
 ///@}
 
+///@name Instruction sets defines
+///@{
+
+#ifdef FORCE_DOXYGEN
+#   define WS_SSSE3 ///< Defined if SSSE3 instructions (pshufb) are enabled, eg. with -mssse3
+#   define WS_AVX2  ///< Defined if AVX2 instructions (gathers) are enabled, eg. with -mavx2
+#   define WS_NEON  ///< Defined if AArch64 NEON instructions (tbl) are available
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__)
+#   define WS_SSSE3
+#endif
+
+#if defined(__AVX2__)
+#   define WS_AVX2
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#   define WS_NEON
+#endif
+
+///@}
+
 
 
 #ifdef FORCE_DOXYGEN
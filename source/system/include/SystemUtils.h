@@ -146,6 +146,39 @@ inline uint64_t popCount(uint64_t value)
 #endif
 }
 
+/** Counts the number of bits set to 0 before the first bit set to 1, starting from the LSB.
+ * @return The index of the lowest bit set, or 32 if value is 0.
+ * @test{System,CountTrailingZeros}
+ */
+inline uint32_t countTrailingZeros(uint32_t value)
+{
+    if (!value) return 32;
+#if defined(WS_GCC_FAMILY)
+    return uint32_t(__builtin_ctz(value));
+#elif defined(WS_MSC)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return uint32_t(index);
+#else
+    return popCount(uint32_t((value & (~value + 1u)) - 1u));
+#endif
+}
+
+/// @overload uint64_t countTrailingZeros(uint64_t value)
+inline uint64_t countTrailingZeros(uint64_t value)
+{
+    if (!value) return 64;
+#if defined(WS_GCC_FAMILY)
+    return uint64_t(__builtin_ctzll(value));
+#elif defined(WS_MSC) && defined(WS_64BITS)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return uint64_t(index);
+#else
+    return popCount(uint64_t((value & (~value + 1u)) - 1u));
+#endif
+}
+
 template<class T, std::size_t N>
 constexpr size_t Size(const T (&array)[N]) noexcept
 {
@@ -0,0 +1,59 @@
+/**
+ * @file TaskExecutor.h
+ * @brief Minimal abstraction used by the decoders to run independent tasks concurrently
+ */
+#pragma once
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace WorldStone
+{
+
+/**A function that runs task(0) to task(nbTasks - 1), possibly concurrently, and returns once all of
+ * them are done.
+ * This lets the user plug their own thread pool / job system. Tasks do not depend on each other and
+ * can be run in any order.
+ * @see sequentialExecutor, makeThreadExecutor
+ */
+using TaskExecutor =
+    std::function<void(size_t nbTasks, const std::function<void(size_t taskIndex)>& task)>;
+
+/// Runs the tasks one after the other on the calling thread
+inline void sequentialExecutor(size_t nbTasks, const std::function<void(size_t taskIndex)>& task)
+{
+    for (size_t taskIndex = 0; taskIndex < nbTasks; taskIndex++)
+        task(taskIndex);
+}
+
+/**Creates an executor that spawns up to nbThreads threads for each call.
+ * The calling thread also runs tasks. Tasks are picked one at a time, so that a few big tasks
+ * do not end up on the same thread.
+ * @param nbThreads Total number of threads to use, 0 means std::thread::hardware_concurrency()
+ * @test{System,TaskExecutor}
+ */
+inline TaskExecutor makeThreadExecutor(size_t nbThreads = 0)
+{
+    if (nbThreads == 0) nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    return [nbThreads](size_t nbTasks, const std::function<void(size_t)>& task) {
+        std::atomic<size_t> nextTask{0};
+        auto                worker = [&]() {
+            for (size_t taskIndex = nextTask++; taskIndex < nbTasks; taskIndex = nextTask++)
+                task(taskIndex);
+        };
+        std::vector<std::thread> threads;
+        const size_t             nbSpawned = std::min(nbThreads, nbTasks) - (nbTasks ? 1 : 0);
+        threads.reserve(nbSpawned);
+        for (size_t threadIndex = 0; threadIndex < nbSpawned; threadIndex++)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads)
+            thread.join();
+    };
+}
+
+} // namespace WorldStone
@@ -7,4 +7,40 @@
 
 namespace WorldStone
 {
+
+void BitStreamWriter::writeUnsigned(uint32_t value, unsigned nbBits)
+{
+    assert(nbBits <= 32);
+    if (nbBits < 32) value &= (uint32_t(1) << nbBits) - 1u;
+
+    size_t bitPosInCurByte = size % CHAR_BIT;
+    size += nbBits;
+    buffer.resize((size + CHAR_BIT - 1) / CHAR_BIT, 0);
+
+    size_t curBytePos = (size - nbBits) / CHAR_BIT;
+    while (nbBits > 0)
+    {
+        // How many bits we can write in this byte ?
+        const unsigned bitsToWriteInCurByte =
+            std::min(unsigned(CHAR_BIT - bitPosInCurByte), nbBits);
+        buffer[curBytePos++] |= uint8_t(value << bitPosInCurByte);
+        value >>= bitsToWriteInCurByte;
+        nbBits -= bitsToWriteInCurByte;
+        bitPosInCurByte = 0;
+    }
+}
+
+void BitStreamWriter::append(const BitStreamWriter& other)
+{
+    if (size % CHAR_BIT == 0) {
+        buffer.insert(buffer.end(), other.buffer.begin(), other.buffer.end());
+        size += other.size;
+        return;
+    }
+    const size_t nbFullBytes = other.size / CHAR_BIT;
+    for (size_t byteIndex = 0; byteIndex < nbFullBytes; byteIndex++)
+        writeUnsigned(other.buffer[byteIndex], CHAR_BIT);
+    const unsigned remainingBits = unsigned(other.size % CHAR_BIT);
+    if (remainingBits) writeUnsigned(other.buffer[nbFullBytes], remainingBits);
+}
 }
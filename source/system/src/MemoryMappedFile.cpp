@@ -0,0 +1,96 @@
+#include "MemoryMappedFile.h"
+#include <Platform.h>
+#include <utility>
+
+#ifdef WS_PLATFORM_WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WorldStone
+{
+
+MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& other) noexcept
+    : mappedData(other.mappedData), mappedSize(other.mappedSize)
+{
+    other.mappedData = nullptr;
+    other.mappedSize = 0;
+}
+
+MemoryMappedFile& MemoryMappedFile::operator=(MemoryMappedFile&& other) noexcept
+{
+    if (this != &other) {
+        close();
+        std::swap(mappedData, other.mappedData);
+        std::swap(mappedSize, other.mappedSize);
+    }
+    return *this;
+}
+
+#ifdef WS_PLATFORM_WINDOWS
+
+bool MemoryMappedFile::open(const IOBase::Path& filename)
+{
+    close();
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    HANDLE        mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 &&
+        uint64_t(fileSize.QuadPart) <= SIZE_MAX) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    // The view keeps the mapping and the file alive
+    CloseHandle(file);
+    if (!mapping) return false;
+    mappedData = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (!mappedData) return false;
+    mappedSize = size_t(fileSize.QuadPart);
+    return true;
+}
+
+void MemoryMappedFile::close()
+{
+    if (mappedData) UnmapViewOfFile(mappedData);
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+#else
+
+bool MemoryMappedFile::open(const IOBase::Path& filename)
+{
+    close();
+    const int file = ::open(filename.c_str(), O_RDONLY);
+    if (file == -1) return false;
+
+    struct stat fileStat;
+    void*       mapping = MAP_FAILED;
+    if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0 &&
+        uint64_t(fileStat.st_size) <= SIZE_MAX) {
+        mapping = mmap(nullptr, size_t(fileStat.st_size), PROT_READ, MAP_SHARED, file, 0);
+    }
+    // The mapping stays valid after the file is closed
+    ::close(file);
+    if (mapping == MAP_FAILED) return false;
+    mappedData = static_cast<const uint8_t*>(mapping);
+    mappedSize = size_t(fileStat.st_size);
+    return true;
+}
+
+void MemoryMappedFile::close()
+{
+    if (mappedData) munmap(const_cast<uint8_t*>(mappedData), mappedSize);
+    mappedData = nullptr;
+    mappedSize = 0;
+}
+
+#endif
+}
@@ -0,0 +1,45 @@
+/**
+ * @file MemoryStream.cpp
+ */
+
+#include "MemoryStream.h"
+#include <algorithm>
+#include <string.h>
+
+namespace WorldStone
+{
+
+bool MemoryStream::seek(long offset, seekdir origin)
+{
+    long newPosition = offset;
+    if (origin == cur)
+        newPosition += long(position);
+    else if (origin == end)
+        newPosition += long(buffer.size());
+    // Same as fseek, seeking past the end is valid but the next read will fail
+    if (newPosition < 0)
+        setstate(failbit);
+    else
+        position = size_t(newPosition);
+    return good();
+}
+
+size_t MemoryStream::read(void* outBuffer, size_t size)
+{
+    const size_t available = position < buffer.size() ? buffer.size() - position : 0;
+    const size_t readSize  = std::min(size, available);
+    if (readSize) memcpy(outBuffer, buffer.data() + position, readSize);
+    position += readSize;
+    if (readSize != size) setstate(eofbit | failbit);
+    return readSize;
+}
+
+int MemoryStream::getc()
+{
+    if (position >= buffer.size()) {
+        setstate(eofbit | failbit);
+        return -1;
+    }
+    return buffer[position++];
+}
+}
@@ -6,6 +6,7 @@
 #include "doctest.h"
 
 using WorldStone::BitStreamView;
+using WorldStone::BitStreamWriter;
 
 /**Test the Bitstream usage in read-only.
  * @testimpl{WorldStone::BitStreamView,RO_bitstream}
@@ -81,6 +82,16 @@ TEST_CASE("BitStreamView read.")
 
         CHECK(bitstream.tell() == 2 + 6 + 1);
     }
+    SUBCASE("Peeking")
+    {
+        CHECK(bitstream.peek64() == 0xEFCDAB8967452301);
+        bitstream.skip(12);
+        CHECK(bitstream.peek64() == 0xEFCDAB8967452301 >> 12); // Bits past the end are 0
+        CHECK(bitstream.tell() == 12);
+        CHECK(bitstream.readUnsigned(20) == 0x67452);
+        bitstream.skip(32);
+        CHECK(bitstream.peek64() == 0);
+    }
     SUBCASE("Aligning to byte")
     {
         // Check if we align to the next byte correctly
@@ -125,3 +136,55 @@ TEST_CASE("BitStreamView read.")
     CHECK(bitstream.good());
     // TODO : set badbit on failure
 }
+
+/**Test that BitStreamWriter writes what BitStreamView reads.
+ * @testimpl{WorldStone::BitStreamWriter,WO_bitstream}
+ */
+TEST_CASE("BitStreamWriter write.")
+{
+    const uint8_t expected[] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF};
+
+    BitStreamWriter writer;
+    // Same splits as the reads of the read-only tests
+    writer.writeUnsigned(0, 0);
+    writer.writeUnsigned(0x01, 8);
+    writer.writeUnsigned(0x4523, 16);
+    writer.writeUnsigned(0x67, 3); // Only the 3 lowest bits must be written
+    writer.writeUnsigned(0x8967 >> 3, 13);
+    writer.writeUnsigned(0xCDAB & 0x1FFF, 13);
+    writer.writeSigned(-2, 2); // 0b10
+    writer.writeUnsigned(0xEFCDAB >> 15, 9);
+    CHECK(writer.sizeInBits() == sizeof(expected) * CHAR_BIT);
+    REQUIRE(writer.sizeInBytes() == sizeof(expected));
+    CHECK(std::equal(writer.getBuffer().begin(), writer.getBuffer().end(), expected));
+
+    SUBCASE("Round trip through BitStreamView")
+    {
+        BitStreamWriter roundTrip;
+        roundTrip.writeBool(true);
+        roundTrip.writeSigned(-50, 9);
+        roundTrip.writeUnsigned(0xDEADBEEF, 32);
+        roundTrip.alignToByte();
+        CHECK(roundTrip.sizeInBits() == 48);
+        roundTrip.writeUnsigned(5, 3);
+
+        BitStreamView view{roundTrip.getBuffer().data(), roundTrip.sizeInBits()};
+        CHECK(view.readBool());
+        CHECK(view.readSigned<9>() == -50);
+        CHECK(view.readUnsigned(32) == 0xDEADBEEF);
+        view.alignToByte();
+        CHECK(view.readUnsigned(3) == 5);
+    }
+    SUBCASE("Appending at an unaligned position")
+    {
+        BitStreamWriter appended;
+        appended.writeUnsigned(0b101, 3);
+        appended.append(writer);
+        CHECK(appended.sizeInBits() == 3 + writer.sizeInBits());
+
+        BitStreamView view{appended.getBuffer().data(), appended.sizeInBits()};
+        CHECK(view.readUnsigned(3) == 0b101);
+        for (uint8_t byte : expected)
+            CHECK(view.readUnsigned(8) == byte);
+    }
+}
@@ -0,0 +1,34 @@
+/**
+ * @file MemoryMappedFileTests.cpp
+ */
+
+#include <MemoryMappedFile.h>
+#include <string.h>
+#include <utility>
+#include "doctest.h"
+
+using WorldStone::MemoryMappedFile;
+
+/// @testimpl{WorldStone::MemoryMappedFile,MemoryMappedFile}
+TEST_CASE("Memory mapped files")
+{
+    MemoryMappedFile file("test.txt");
+    REQUIRE(file.is_open());
+    REQUIRE(file.size() == 4);
+    CHECK(memcmp(file.data(), "test", 4) == 0);
+
+    MemoryMappedFile moved = std::move(file);
+    CHECK_FALSE(file.is_open());
+    CHECK(file.data() == nullptr);
+    REQUIRE(moved.is_open());
+    CHECK(memcmp(moved.data(), "test", 4) == 0);
+
+    moved.close();
+    CHECK_FALSE(moved.is_open());
+    CHECK(moved.size() == 0);
+
+    CHECK_FALSE(moved.open("nonexistent.txt"));
+    CHECK_FALSE(moved.is_open());
+    // Directories can not be mapped
+    CHECK_FALSE(moved.open("subfolder1"));
+}
@@ -0,0 +1,52 @@
+/**
+ * @file MemoryStreamTests.cpp
+ */
+
+#include <MemoryStream.h>
+#include <string.h>
+#include "doctest.h"
+
+using WorldStone::MemoryStream;
+
+/// @testimpl{WorldStone::MemoryStream,RO_memorystream}
+TEST_CASE("Read-only memory stream")
+{
+    const char*          content = "test";
+    MemoryStream         stream{{content, content + strlen(content)}};
+    WorldStone::IStream& streamRef = stream; // Test it through the interface
+    CHECK(streamRef.good());
+    CHECK(streamRef.tell() == 0);
+    CHECK(streamRef.size() == 4);
+
+    SUBCASE("Reading the whole stream")
+    {
+        char buffer[8] = {};
+        CHECK(streamRef.read(buffer, 4) == 4);
+        CHECK(!strcmp("test", buffer));
+        CHECK(streamRef.tell() == 4);
+        CHECK(streamRef.good());
+        CHECK(streamRef.getc() < 0);
+        CHECK(streamRef.eof());
+        CHECK(streamRef.fail());
+    }
+    SUBCASE("Reading more than the stream")
+    {
+        char buffer[8] = {};
+        streamRef.seek(1, WorldStone::IStream::beg);
+        CHECK(streamRef.read(buffer, 8) == 3);
+        CHECK(!strcmp("est", buffer));
+        CHECK(streamRef.eof());
+        CHECK(streamRef.fail());
+    }
+    SUBCASE("Seeking")
+    {
+        CHECK(streamRef.seek(-1, WorldStone::IStream::end));
+        CHECK(streamRef.getc() == 't');
+        CHECK(streamRef.seek(-2, WorldStone::IStream::cur));
+        CHECK(streamRef.getc() == 's');
+        CHECK(streamRef.seek(10, WorldStone::IStream::end)); // Same as fseek
+        CHECK(streamRef.good());
+        CHECK_FALSE(streamRef.seek(-1, WorldStone::IStream::beg));
+        CHECK(streamRef.fail());
+    }
+}
@@ -71,3 +71,20 @@ TEST_CASE("PopCount 16bits")
     CHECK(popCount(uint64_t(0x000000000000FF00)) == 8);
     CHECK(popCount(uint64_t(0xFFFFFFFFFFFFFFFF)) == 64);
 }
+
+using WorldStone::Utils::countTrailingZeros;
+/**
+ * @testimpl{WorldStone::Utils::countTrailingZeros(),CountTrailingZeros}
+ */
+TEST_CASE("CountTrailingZeros")
+{
+    CHECK(countTrailingZeros(uint32_t(0x00000000)) == 32);
+    CHECK(countTrailingZeros(uint32_t(0x00000001)) == 0);
+    CHECK(countTrailingZeros(uint32_t(0x000F0F00)) == 8);
+    CHECK(countTrailingZeros(uint32_t(0x80000000)) == 31);
+
+    CHECK(countTrailingZeros(uint64_t(0x0000000000000000)) == 64);
+    CHECK(countTrailingZeros(uint64_t(0x0000000000000001)) == 0);
+    CHECK(countTrailingZeros(uint64_t(0x0000001000000000)) == 36);
+    CHECK(countTrailingZeros(uint64_t(0x8000000000000000)) == 63);
+}
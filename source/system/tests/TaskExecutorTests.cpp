@@ -0,0 +1,31 @@
+/**
+ * @file TaskExecutorTests.cpp
+ */
+#include <TaskExecutor.h>
+#include <doctest.h>
+#include <atomic>
+#include <vector>
+
+/**Every task must be run exactly once, whatever the number of threads.
+ * @testimpl{WorldStone::makeThreadExecutor(),TaskExecutor}
+ */
+TEST_CASE("TaskExecutor")
+{
+    for (size_t nbThreads : {1, 3, 16})
+    {
+        CAPTURE(nbThreads);
+        const WorldStone::TaskExecutor executor = WorldStone::makeThreadExecutor(nbThreads);
+        for (size_t nbTasks : {0, 1, 2, 100})
+        {
+            CAPTURE(nbTasks);
+            std::vector<std::atomic<int>> runs(nbTasks);
+            for (std::atomic<int>& run : runs)
+                run = 0;
+            executor(nbTasks, [&](size_t taskIndex) { runs[taskIndex]++; });
+            bool allRunOnce = true;
+            for (const std::atomic<int>& run : runs)
+                allRunOnce &= run == 1;
+            CHECK(allRunOnce);
+        }
+    }
+}